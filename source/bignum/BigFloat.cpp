@@ -0,0 +1,324 @@
+// ======================================================================================
+// BigFloat.cpp
+//
+// Rounding looks at the bit below the kept ones (the round bit) and, only when that
+// is set, at whether any bit below it is set (the sticky bit), which is a count of
+// trailing zeros.
+//
+// Division and square root compute two bits more than the precision with an integer
+// divide or square root, and fold a non-zero remainder into one more bit at the
+// bottom. That bit stands in for everything below it: it can't be the round bit
+// of an exact tie, so the rounding comes out as if the whole result were there.
+//
+// An add keeps every bit of both operands, unless the smaller one lies wholly below
+// a quarter of the result's last bit and below the bigger one's last bit. Then only
+// its sign matters to the rounding, and it is replaced by a single bit just under
+// those limits, so an add never shifts by much more than the precision.
+// ======================================================================================
+
+#include "BigFloat.h"
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+static void check_precision(int64_t precision)
+{
+    assert(precision >= 1 && precision <= (int64_t(1) << 30) && "precision out of range");
+    (void) precision;
+}
+
+// Round m * 2^e to precision bits (to nearest, ties to even) and make m odd
+static void round_to(Num& m, int64_t& e, int64_t precision)
+{
+    int32_t sign = m.data.sign;
+    m.data.sign = 0;
+
+    int64_t shift = m.bit_length() - precision;
+    if (shift > 0)
+    {
+        bool half = m.test_bit(int(shift - 1));
+        bool sticky = half && m.ctz() < shift - 1;
+        m >>= int(shift);
+        e += shift;
+        if (half && (sticky || m.test_bit(0)))
+        {
+            m += Num(1);
+            if (m.bit_length() > precision)
+            {
+                m >>= 1;
+                e += 1;
+            }
+        }
+    }
+
+    if (m.data.len == 0)
+    {
+        e = 0;
+        return;
+    }
+    int zeros = m.ctz();
+    if (zeros != 0)
+    {
+        m >>= zeros;
+        e += zeros;
+    }
+    m.data.sign = sign;
+}
+
+BigFloat::BigFloat(const Num& n, int64_t exponent, int64_t precision)
+    : mantissa(n), exponent(exponent), prec(precision)
+{
+    check_precision(precision);
+    round();
+}
+
+BigFloat::BigFloat(double v, int64_t precision) : prec(precision)
+{
+    assert(std::isfinite(v));
+    check_precision(precision);
+    int e;
+    double m = std::frexp(v, &e);
+    mantissa.from_double(std::ldexp(m, 53));
+    exponent = e - 53;
+    round();
+}
+
+void BigFloat::round()
+{
+    round_to(mantissa, exponent, prec);
+}
+
+BigFloat& BigFloat::set_precision(int64_t precision)
+{
+    check_precision(precision);
+    prec = precision;
+    round();
+    return *this;
+}
+
+double BigFloat::to_double() const
+{
+    if (is_zero())
+        return 0.0;
+
+    // Below 2^-1022 a double keeps only the bits down to 2^-1074, so round to those
+    // here, once, and the scaling below is exact. Rounding to 53 bits first and then
+    // again in ldexp could round twice.
+    constexpr int min_exp = std::numeric_limits<double>::min_exponent;
+    constexpr int bits = std::numeric_limits<double>::digits;
+    int64_t t = top();
+    if (t < min_exp)
+    {
+        int64_t keep = t - (min_exp - bits);
+        if (keep <= 0)
+        {
+            // Below 2^-1075 is zero. In [2^-1075, 2^-1074), exactly half the smallest
+            // subnormal rounds to even, which is zero, and anything above it rounds up.
+            bool half = keep == 0 && mantissa.bit_length() - 1 == mantissa.ctz();
+            double d = keep < 0 || half ? 0.0 : std::ldexp(1.0, min_exp - bits);
+            return mantissa.data.sign ? -d : d;
+        }
+
+        Num m = mantissa;
+        int64_t e = exponent;
+        round_to(m, e, keep);
+        int64_t me;
+        double d = m.to_double_with_exponent(&me);
+        return std::ldexp(d, int(me + e));
+    }
+
+    int64_t e;
+    double m = mantissa.to_double_with_exponent(&e);
+    e += exponent;
+
+    // ldexp takes an int, and anything past these is infinity or zero anyway
+    if (e > 4096)
+        e = 4096;
+    if (e < -4096)
+        e = -4096;
+    return std::ldexp(m, int(e));
+}
+
+Num BigFloat::to_num() const
+{
+    Num n = mantissa;
+    int32_t sign = n.data.sign;
+    n.data.sign = 0;
+    if (exponent >= 0)
+        n <<= int(exponent);
+    else if (-exponent >= n.bit_length())
+        return Num();
+    else
+        n >>= int(-exponent);
+    if (n.data.len != 0)
+        n.data.sign = sign;
+    return n;
+}
+
+std::string BigFloat::to_string(int64_t digits) const
+{
+    assert(digits >= 0);
+    Num ten = 10;
+    BigFloat scaled(multiply(mantissa, ten ^ Num((long long) digits)), exponent, int64_t(1) << 30);
+    Num n = scaled.to_num();
+
+    std::string s = n.to_string();
+    bool negative = mantissa.data.sign != 0;
+    if (n.data.sign)
+        s.erase(0, 1);
+    if (int64_t(s.size()) <= digits)
+        s.insert(0, size_t(digits + 1 - int64_t(s.size())), '0');
+    if (digits != 0)
+        s.insert(s.size() - size_t(digits), 1, '.');
+    if (negative)
+        s.insert(0, 1, '-');
+    return s;
+}
+
+BigFloat BigFloat::operator-() const
+{
+    BigFloat r = *this;
+    if (!r.is_zero())
+        r.mantissa.data.sign = r.mantissa.data.sign ? 0 : -1;
+    return r;
+}
+
+// ======================================================================================
+
+BigFloat add(const BigFloat& a, const BigFloat& b, int64_t precision)
+{
+    check_precision(precision);
+    if (b.is_zero())
+        return BigFloat(a.mantissa, a.exponent, precision);
+    if (a.is_zero())
+        return BigFloat(b.mantissa, b.exponent, precision);
+
+    // x is the one with the higher top bit
+    const BigFloat& x = a.top() >= b.top() ? a : b;
+    const BigFloat& y = a.top() >= b.top() ? b : a;
+    Num mx = x.mantissa;
+    Num my = y.mantissa;
+    int64_t ex = x.exponent;
+    int64_t ey = y.exponent;
+
+    // The result's last bit is at least at x.top() - precision - 1, as the sum has at
+    // least x.top() - 1 bits. A y below a quarter of that, and below x's last bit,
+    // rounds the same as any other value of its sign down there.
+    int64_t limit = x.top() - precision - 3;
+    if (ex < limit)
+        limit = ex;
+    if (y.top() <= limit)
+    {
+        my = my.data.sign ? Num(-1) : Num(1);
+        ey = limit - 1;
+    }
+
+    // Line up the exponents and add
+    int64_t e = ex < ey ? ex : ey;
+    mx <<= int(ex - e);
+    my <<= int(ey - e);
+    mx += my;
+    return BigFloat(mx, e, precision);
+}
+
+BigFloat sub(const BigFloat& a, const BigFloat& b, int64_t precision)
+{
+    return add(a, -b, precision);
+}
+
+BigFloat mul(const BigFloat& a, const BigFloat& b, int64_t precision)
+{
+    check_precision(precision);
+    Num ma = a.mantissa, mb = b.mantissa;
+    int64_t ea = a.exponent, eb = b.exponent;
+    round_to(ma, ea, precision);
+    round_to(mb, eb, precision);
+    return BigFloat(multiply(ma, mb), ea + eb, precision);
+}
+
+BigFloat div(const BigFloat& a, const BigFloat& b, int64_t precision)
+{
+    check_precision(precision);
+    assert(!b.is_zero() && "division by zero");
+    if (a.is_zero())
+        return BigFloat(Num(), 0, precision);
+
+    Num ma = a.mantissa, mb = b.mantissa;
+    int64_t ea = a.exponent, eb = b.exponent;
+    round_to(ma, ea, precision);
+    round_to(mb, eb, precision);
+    int32_t sign = ma.data.sign != mb.data.sign ? -1 : 0;
+    ma.data.sign = 0;
+    mb.data.sign = 0;
+
+    // A quotient of precision + 2 or 3 bits; the shift is at least 2, since ma has
+    // at most precision bits
+    int64_t shift = precision + 2 + mb.bit_length() - ma.bit_length();
+    ma <<= int(shift);
+    Num q, r;
+    ma.divmod(mb, q, r);
+    if (r.data.len != 0)
+    {
+        q <<= 1;
+        q += Num(1);
+        shift += 1;
+    }
+    q.data.sign = sign;
+    return BigFloat(q, ea - eb - shift, precision);
+}
+
+BigFloat sqrt(const BigFloat& a, int64_t precision)
+{
+    check_precision(precision);
+    assert(a.mantissa.data.sign == 0 && "square root of a negative number");
+    if (a.is_zero())
+        return BigFloat(Num(), 0, precision);
+
+    Num m = a.mantissa;
+    int64_t e = a.exponent;
+    round_to(m, e, precision);
+
+    // Scale m up to 2 * (precision + 2) bits or more, leaving an even exponent, so
+    // the root has precision + 2 bits or more
+    int64_t shift = 2 * (precision + 2) - m.bit_length();
+    if (shift < 0)
+        shift = 0;
+    if ((e - shift) & 1)
+        shift += 1;
+    m <<= int(shift);
+    e -= shift;
+
+    Num root = isqrt(m);
+    if (multiply(root, root).magcmp(m) != 0)
+    {
+        root <<= 1;
+        root += Num(1);
+        e -= 2;
+    }
+    return BigFloat(root, e / 2, precision);
+}
+
+int compare(const BigFloat& lhs, const BigFloat& rhs)
+{
+    int ls = lhs.is_zero() ? 0 : lhs.mantissa.data.sign ? -1 : 1;
+    int rs = rhs.is_zero() ? 0 : rhs.mantissa.data.sign ? -1 : 1;
+    if (ls != rs)
+        return ls < rs ? -1 : 1;
+    if (ls == 0)
+        return 0;
+
+    // Same sign: compare magnitudes by top bit, and then by the bits lined up
+    int mag;
+    if (lhs.top() != rhs.top())
+        mag = lhs.top() < rhs.top() ? -1 : 1;
+    else
+    {
+        Num l = lhs.mantissa, r = rhs.mantissa;
+        int64_t e = lhs.exponent < rhs.exponent ? lhs.exponent : rhs.exponent;
+        l <<= int(lhs.exponent - e);
+        r <<= int(rhs.exponent - e);
+        mag = l.magcmp(r);
+    }
+    return ls < 0 ? -mag : mag;
+}
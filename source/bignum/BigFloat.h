@@ -0,0 +1,110 @@
+// ======================================================================================
+// BigFloat.h
+// - arbitrary-precision binary floating point
+//
+// A BigFloat is mantissa * 2^exponent, with a Num mantissa of at most precision bits
+// and a 64-bit exponent. Results are rounded to nearest, ties to even, like IEEE
+// doubles, so a BigFloat with 53 bits of precision gives the same answers as a
+// double (without the exponent limits, subnormals, infinities or NaNs).
+//
+// The mantissa is kept odd (or zero) by moving its trailing zero bits into the
+// exponent, so every value has one representation, and small integers and powers of
+// two have one-digit mantissas whatever the precision.
+//
+// The cost of an operation follows the precision, not the size of the numbers: a
+// multiply or divide first rounds its operands to the precision of the result, and
+// an add of numbers of very different size doesn't shift the bigger one down to the
+// exponent of the smaller one.
+//
+// Each value carries its precision. The operators give a result with the larger
+// precision of their operands; the named functions take the precision of the result.
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+
+#include <cstdint>
+#include <string>
+
+class BigFloat
+{
+public:
+    static constexpr int64_t default_precision = 256;
+
+    // Zero
+    BigFloat() {}
+
+    // n * 2^exponent, rounded to precision bits
+    explicit BigFloat(const Num& n, int64_t precision = default_precision) : BigFloat(n, 0, precision) {}
+    BigFloat(const Num& n, int64_t exponent, int64_t precision);
+
+    // A double, which is exact with a precision of 53 bits or more
+    explicit BigFloat(double v, int64_t precision = default_precision);
+
+    int64_t precision() const { return prec; }
+
+    // Round to a new precision (a larger one changes nothing but later results)
+    BigFloat& set_precision(int64_t precision);
+
+    bool is_zero() const { return mantissa.data.len == 0; }
+
+    // The exponent of the top bit plus one, so |x| is in [2^(top-1), 2^top) (0 for zero)
+    int64_t top() const { return is_zero() ? 0 : exponent + mantissa.bit_length(); }
+
+    // Rounded to the nearest double. Beyond the double range this gives infinity or
+    // zero.
+    double to_double() const;
+
+    // Truncated toward zero
+    Num to_num() const;
+
+    // Fixed-point decimal with digits digits after the point, truncated toward zero
+    std::string to_string(int64_t digits = 20) const;
+
+    BigFloat& operator+=(const BigFloat& rhs);
+    BigFloat& operator-=(const BigFloat& rhs);
+    BigFloat& operator*=(const BigFloat& rhs);
+    BigFloat& operator/=(const BigFloat& rhs);
+
+    BigFloat operator-() const;
+
+    Num mantissa;         // odd or zero, at most prec bits
+    int64_t exponent = 0; // zero when the mantissa is zero
+    int64_t prec = default_precision;
+
+private:
+    void round();
+};
+
+// Correctly rounded results at the given precision. mul, div and sqrt round their
+// operands to that precision first, so they give the correctly rounded result for
+// the rounded operands.
+BigFloat add(const BigFloat& a, const BigFloat& b, int64_t precision);
+BigFloat sub(const BigFloat& a, const BigFloat& b, int64_t precision);
+BigFloat mul(const BigFloat& a, const BigFloat& b, int64_t precision);
+BigFloat div(const BigFloat& a, const BigFloat& b, int64_t precision);
+BigFloat sqrt(const BigFloat& a, int64_t precision);
+inline BigFloat sqrt(const BigFloat& a) { return sqrt(a, a.prec); }
+
+// -1, 0 or 1
+int compare(const BigFloat& lhs, const BigFloat& rhs);
+
+inline int64_t max_precision(const BigFloat& a, const BigFloat& b) { return a.prec > b.prec ? a.prec : b.prec; }
+
+inline BigFloat operator+(const BigFloat& a, const BigFloat& b) { return add(a, b, max_precision(a, b)); }
+inline BigFloat operator-(const BigFloat& a, const BigFloat& b) { return sub(a, b, max_precision(a, b)); }
+inline BigFloat operator*(const BigFloat& a, const BigFloat& b) { return mul(a, b, max_precision(a, b)); }
+inline BigFloat operator/(const BigFloat& a, const BigFloat& b) { return div(a, b, max_precision(a, b)); }
+
+inline BigFloat& BigFloat::operator+=(const BigFloat& rhs) { return *this = *this + rhs; }
+inline BigFloat& BigFloat::operator-=(const BigFloat& rhs) { return *this = *this - rhs; }
+inline BigFloat& BigFloat::operator*=(const BigFloat& rhs) { return *this = *this * rhs; }
+inline BigFloat& BigFloat::operator/=(const BigFloat& rhs) { return *this = *this / rhs; }
+
+inline bool operator==(const BigFloat& lhs, const BigFloat& rhs) { return compare(lhs, rhs) == 0; }
+inline bool operator!=(const BigFloat& lhs, const BigFloat& rhs) { return compare(lhs, rhs) != 0; }
+inline bool operator<(const BigFloat& lhs, const BigFloat& rhs) { return compare(lhs, rhs) < 0; }
+inline bool operator<=(const BigFloat& lhs, const BigFloat& rhs) { return compare(lhs, rhs) <= 0; }
+inline bool operator>(const BigFloat& lhs, const BigFloat& rhs) { return compare(lhs, rhs) > 0; }
+inline bool operator>=(const BigFloat& lhs, const BigFloat& rhs) { return compare(lhs, rhs) >= 0; }
@@ -0,0 +1,158 @@
+// ======================================================================================
+// Digits.h
+// - digit-array kernels shared by Num and FixedNum
+//
+// These work on little-endian arrays of uint32_t digits with explicit lengths, and
+// know nothing about signs, allocation or normalization. They are constexpr so that
+// FixedNum can use them in constant expressions; when the length is a compile-time
+// constant (as it is for FixedNum), the compiler unrolls the loops completely.
+//
+// Unless noted otherwise, the result may be the same array as an input.
+// ======================================================================================
+
+#pragma once
+
+#include <cstdint>
+
+// r = a + b over n digits, returns the carry out (0 or 1)
+constexpr uint32_t add_digits(uint32_t* r, const uint32_t* a, const uint32_t* b, int n)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++)
+    {
+        carry = carry + a[i] + b[i];
+        r[i] = uint32_t(carry);
+        carry >>= 32;
+    }
+    return uint32_t(carry);
+}
+
+// r = a + carry over n digits, returns the carry out. When r is a, this stops as soon
+// as the carry is absorbed.
+constexpr uint32_t add_digit(uint32_t* r, const uint32_t* a, int n, uint32_t carry)
+{
+    int i = 0;
+    for (; i < n && carry != 0; i++)
+    {
+        uint64_t t = uint64_t(a[i]) + carry;
+        r[i] = uint32_t(t);
+        carry = uint32_t(t >> 32);
+    }
+    if (r != a)
+        for (; i < n; i++)
+            r[i] = a[i];
+    return carry;
+}
+
+// r = a - b over n digits, returns the borrow out (0 or 1)
+constexpr uint32_t sub_digits(uint32_t* r, const uint32_t* a, const uint32_t* b, int n)
+{
+    uint32_t borrow = 0;
+    for (int i = 0; i < n; i++)
+    {
+        uint64_t t = uint64_t(a[i]) - b[i] - borrow;
+        r[i] = uint32_t(t);
+        borrow = uint32_t(t >> 63);
+    }
+    return borrow;
+}
+
+// r = a - borrow over n digits, returns the borrow out. When r is a, this stops as
+// soon as the borrow is absorbed.
+constexpr uint32_t sub_digit(uint32_t* r, const uint32_t* a, int n, uint32_t borrow)
+{
+    int i = 0;
+    for (; i < n && borrow != 0; i++)
+    {
+        uint32_t d = a[i];
+        r[i] = d - borrow;
+        borrow = d < borrow ? 1 : 0;
+    }
+    if (r != a)
+        for (; i < n; i++)
+            r[i] = a[i];
+    return borrow;
+}
+
+// r += a * d over n digits, returns the carry out digit. This is one row of a
+// schoolbook multiply. r must not overlap a.
+constexpr uint32_t mul_add_digit(uint32_t* r, const uint32_t* a, int n, uint32_t d)
+{
+    // This won't overflow:
+    // (2^n-1)*(2^n-1) + (2^n-1) + (2^n-1) = 2^(2n) - 1
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++)
+    {
+        carry = carry + r[i] + uint64_t(a[i]) * d;
+        r[i] = uint32_t(carry);
+        carry >>= 32;
+    }
+    return uint32_t(carry);
+}
+
+// r -= a * d over n digits, returns the borrow out digit. r must not overlap a.
+constexpr uint32_t sub_mul_digit(uint32_t* r, const uint32_t* a, int n, uint32_t d)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < n; i++)
+    {
+        uint64_t p = uint64_t(a[i]) * d + borrow;
+        uint32_t lo = uint32_t(p);
+        borrow = (p >> 32) + (r[i] < lo ? 1 : 0);
+        r[i] -= lo;
+    }
+    return uint32_t(borrow);
+}
+
+// r = a * d + carry over n digits, returns the carry out digit
+constexpr uint32_t mul_digit(uint32_t* r, const uint32_t* a, int n, uint32_t d, uint32_t carry = 0)
+{
+    uint64_t t = carry;
+    for (int i = 0; i < n; i++)
+    {
+        t = t + uint64_t(a[i]) * d;
+        r[i] = uint32_t(t);
+        t >>= 32;
+    }
+    return uint32_t(t);
+}
+
+// r = a * b (schoolbook). r has an+bn digits and must not overlap a or b.
+constexpr void mul_digits(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn)
+{
+    for (int i = 0; i < an; i++)
+        r[i] = 0;
+
+    // The carry out of each row is a digit higher than any seen so far, so it
+    // is stored rather than added.
+    for (int j = 0; j < bn; j++)
+        r[j+an] = mul_add_digit(r + j, a, an, b[j]);
+}
+
+// Compare a and b over n digits: -1, 0 or 1
+constexpr int cmp_digits(const uint32_t* a, const uint32_t* b, int n)
+{
+    for (int i = n - 1; i >= 0; i--)
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+// Inverse of an odd d modulo 2^32 and 2^64, by Newton iteration: x = d is already
+// correct to 3 bits (d*d == 1 mod 8 for any odd d), and each step doubles the
+// correct bits.
+constexpr uint32_t inverse_digit(uint32_t d)
+{
+    uint32_t x = d;
+    for (int i = 0; i < 4; i++)
+        x *= 2 - d * x;
+    return x;
+}
+
+constexpr uint64_t inverse_digit64(uint64_t d)
+{
+    uint64_t x = d;
+    for (int i = 0; i < 5; i++)
+        x *= 2 - d * x;
+    return x;
+}
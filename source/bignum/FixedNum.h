@@ -0,0 +1,321 @@
+// ======================================================================================
+// FixedNum.h
+// - fixed-width unsigned numbers
+//
+// A FixedNum<Bits> is an unsigned Bits-bit number held in a plain array of digits.
+// There is no sign, no length, no small/big buffer and no heap, and arithmetic wraps
+// modulo 2^Bits just like the built-in unsigned types. This is meant for code that
+// works on values of a known size (256-bit keys, 1024-bit moduli) where Num would pay
+// for normalization and allocation on every operation.
+//
+// Everything except division is constexpr. The arithmetic uses the same digit kernels
+// as Num (Digits.h), and because the length is a template parameter the compiler can
+// unroll them completely. Division goes through MultiwordDivide, like Num's.
+//
+// Converting to and from Num is a copy of the digits.
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+#include "Digits.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+template<int Bits>
+class FixedNum
+{
+public:
+    static_assert(Bits > 0 && Bits % 32 == 0, "FixedNum width must be a multiple of 32 bits");
+
+    // Number of digits in a FixedNum
+    static constexpr int ndigits = Bits / 32;
+
+    constexpr FixedNum() : digits{} {}
+
+    // Construct from integral primitives. Negative values wrap modulo 2^Bits.
+    constexpr FixedNum(int v) : FixedNum((long long) v) {}
+    constexpr FixedNum(unsigned int v) : FixedNum((unsigned long long) v) {}
+    constexpr FixedNum(long long v) : FixedNum((unsigned long long) v)
+    {
+        if (v < 0)
+            for (int i = 2; i < ndigits; i++)
+                digits[i] = 0xFFFF'FFFF;
+    }
+    constexpr FixedNum(unsigned long long v) : digits{}
+    {
+        digits[0] = uint32_t(v);
+        if constexpr (ndigits > 1)
+            digits[1] = uint32_t(v >> 32);
+    }
+
+    // Construct from a string of digits in the given base (2 to 36), with optional '
+    // separators like Num. Parsing stops at the first character that isn't a digit,
+    // and the value wraps modulo 2^Bits.
+    constexpr explicit FixedNum(char const* p, int base = 10) : digits{}
+    {
+        for (; *p != 0; p++)
+        {
+            int c = *p;
+            if (c == '\'')
+                continue;
+            int v = (c >= '0' && c <= '9') ? c - '0'
+                  : (c >= 'a' && c <= 'z') ? c - 'a' + 10
+                  : (c >= 'A' && c <= 'Z') ? c - 'A' + 10
+                  : base;
+            if (v >= base)
+                break;
+            mul_digit(digits, digits, ndigits, uint32_t(base), uint32_t(v));
+        }
+    }
+
+    // Truncate or zero-extend from a FixedNum of another width
+    template<int OtherBits>
+    constexpr explicit FixedNum(const FixedNum<OtherBits>& other) : digits{}
+    {
+        constexpr int n = ndigits < FixedNum<OtherBits>::ndigits ? ndigits : FixedNum<OtherBits>::ndigits;
+        for (int i = 0; i < n; i++)
+            digits[i] = other.digits[i];
+    }
+
+    // Convert from Num, modulo 2^Bits (negative values are two's complement)
+    explicit FixedNum(const Num& n) : digits{}
+    {
+        int len = n.data.length() < ndigits ? n.data.length() : ndigits;
+        memcpy(digits, n.cdatabuffer(), len * sizeof(uint32_t));
+        if (n.data.sign)
+            *this = -*this;
+    }
+
+    // Convert to Num
+    Num to_num() const
+    {
+        Num n;
+        memcpy(n.resize(ndigits), digits, sizeof(digits));
+        n.trim();
+        return n;
+    }
+
+    std::string to_string(int base = 10) const
+    {
+        char buf[Bits + 1]; // enough for base 2
+        to_num().to_cstring(buf, sizeof(buf), base);
+        return buf;
+    }
+
+    // Low 64 bits
+    constexpr uint64_t to_uint64() const
+    {
+        if constexpr (ndigits > 1)
+            return (uint64_t(digits[1]) << 32) | digits[0];
+        else
+            return digits[0];
+    }
+
+    // Arithmetic, modulo 2^Bits
+
+    constexpr FixedNum& operator+=(const FixedNum& rhs)
+    {
+        add_digits(digits, digits, rhs.digits, ndigits);
+        return *this;
+    }
+
+    constexpr FixedNum& operator-=(const FixedNum& rhs)
+    {
+        sub_digits(digits, digits, rhs.digits, ndigits);
+        return *this;
+    }
+
+    // Only the low Bits of the product are computed: row j of the schoolbook
+    // multiply needs just ndigits - j digits.
+    constexpr FixedNum& operator*=(const FixedNum& rhs)
+    {
+        uint32_t r[ndigits]{};
+        for (int j = 0; j < ndigits; j++)
+            mul_add_digit(r + j, digits, ndigits - j, rhs.digits[j]);
+        for (int i = 0; i < ndigits; i++)
+            digits[i] = r[i];
+        return *this;
+    }
+
+    FixedNum& operator/=(const FixedNum& rhs)
+    {
+        FixedNum remainder;
+        divmod(rhs, *this, remainder);
+        return *this;
+    }
+
+    FixedNum& operator%=(const FixedNum& rhs)
+    {
+        FixedNum quotient;
+        divmod(rhs, quotient, *this);
+        return *this;
+    }
+
+    constexpr FixedNum operator+(const FixedNum& rhs) const { FixedNum t{*this}; return t += rhs; }
+    constexpr FixedNum operator-(const FixedNum& rhs) const { FixedNum t{*this}; return t -= rhs; }
+    constexpr FixedNum operator*(const FixedNum& rhs) const { FixedNum t{*this}; return t *= rhs; }
+    FixedNum operator/(const FixedNum& rhs) const { FixedNum t{*this}; return t /= rhs; }
+    FixedNum operator%(const FixedNum& rhs) const { FixedNum t{*this}; return t %= rhs; }
+
+    // 2^Bits - x
+    constexpr FixedNum operator-() const
+    {
+        FixedNum t;
+        return t -= *this;
+    }
+
+    // Full double-width product
+    constexpr FixedNum<2 * Bits> mul_wide(const FixedNum& rhs) const
+    {
+        FixedNum<2 * Bits> r;
+        mul_digits(r.digits, digits, ndigits, rhs.digits, ndigits);
+        return r;
+    }
+
+    // quotient, remainder = *this / divisor. The divisor must be non-zero, and the
+    // outputs may be the same objects as the inputs.
+    void divmod(const FixedNum& rhs, FixedNum& quotient, FixedNum& remainder) const
+    {
+        int m = length();
+        int n = rhs.length();
+        assert(n != 0);
+
+        FixedNum q, r;
+        if (m < n)
+            r = *this;
+        else
+        {
+            uint32_t scratch[2 * ndigits + 1];
+            bool ok = MultiwordDivide<uint32_t>(q.digits, r.digits, digits, rhs.digits, m, n, scratch);
+            assert(ok);
+            (void) ok;
+        }
+        quotient = q;
+        remainder = r;
+    }
+
+    // Shifts - bits shifted past either end are lost. A negative shift count shifts
+    // the other way.
+
+    constexpr FixedNum& operator<<=(int s)
+    {
+        if (s < 0)
+            return *this >>= -s;
+        if (s >= Bits)
+            return *this = FixedNum();
+
+        int q = s / 32;
+        int b = s % 32;
+        for (int i = ndigits - 1; i >= 0; i--)
+        {
+            uint32_t hi = i - q >= 0 ? digits[i - q] : 0;
+            uint32_t lo = i - q - 1 >= 0 ? digits[i - q - 1] : 0;
+            digits[i] = b == 0 ? hi : (hi << b) | (lo >> (32 - b));
+        }
+        return *this;
+    }
+
+    constexpr FixedNum& operator>>=(int s)
+    {
+        if (s < 0)
+            return *this <<= -s;
+        if (s >= Bits)
+            return *this = FixedNum();
+
+        int q = s / 32;
+        int b = s % 32;
+        for (int i = 0; i < ndigits; i++)
+        {
+            uint32_t lo = i + q < ndigits ? digits[i + q] : 0;
+            uint32_t hi = i + q + 1 < ndigits ? digits[i + q + 1] : 0;
+            digits[i] = b == 0 ? lo : (lo >> b) | (hi << (32 - b));
+        }
+        return *this;
+    }
+
+    constexpr FixedNum operator<<(int s) const { FixedNum t{*this}; return t <<= s; }
+    constexpr FixedNum operator>>(int s) const { FixedNum t{*this}; return t >>= s; }
+
+    // Bitwise operators. As with Num, xor is a named function for symmetry, even though
+    // ^ isn't taken here.
+
+    constexpr FixedNum& operator&=(const FixedNum& rhs)
+    {
+        for (int i = 0; i < ndigits; i++)
+            digits[i] &= rhs.digits[i];
+        return *this;
+    }
+
+    constexpr FixedNum& operator|=(const FixedNum& rhs)
+    {
+        for (int i = 0; i < ndigits; i++)
+            digits[i] |= rhs.digits[i];
+        return *this;
+    }
+
+    constexpr FixedNum& bit_xor(const FixedNum& rhs)
+    {
+        for (int i = 0; i < ndigits; i++)
+            digits[i] ^= rhs.digits[i];
+        return *this;
+    }
+
+    constexpr FixedNum operator&(const FixedNum& rhs) const { FixedNum t{*this}; return t &= rhs; }
+    constexpr FixedNum operator|(const FixedNum& rhs) const { FixedNum t{*this}; return t |= rhs; }
+
+    constexpr FixedNum operator~() const
+    {
+        FixedNum t;
+        for (int i = 0; i < ndigits; i++)
+            t.digits[i] = ~digits[i];
+        return t;
+    }
+
+    // Queries
+
+    // Number of significant digits
+    constexpr int length() const
+    {
+        int n = ndigits;
+        while (n > 0 && digits[n - 1] == 0)
+            n -= 1;
+        return n;
+    }
+
+    constexpr bool is_zero() const { return length() == 0; }
+
+    constexpr int bit_length() const
+    {
+        int n = length();
+        if (n == 0)
+            return 0;
+        int bits = (n - 1) * 32;
+        for (uint32_t top = digits[n - 1]; top != 0; top >>= 1)
+            bits += 1;
+        return bits;
+    }
+
+    constexpr bool test_bit(int i) const
+    {
+        return i >= 0 && i < Bits && ((digits[i / 32] >> (i % 32)) & 1) != 0;
+    }
+
+    // Comparisons
+
+    friend constexpr bool operator==(const FixedNum& lhs, const FixedNum& rhs) { return cmp_digits(lhs.digits, rhs.digits, ndigits) == 0; }
+    friend constexpr bool operator!=(const FixedNum& lhs, const FixedNum& rhs) { return cmp_digits(lhs.digits, rhs.digits, ndigits) != 0; }
+    friend constexpr bool operator<(const FixedNum& lhs, const FixedNum& rhs) { return cmp_digits(lhs.digits, rhs.digits, ndigits) < 0; }
+    friend constexpr bool operator<=(const FixedNum& lhs, const FixedNum& rhs) { return cmp_digits(lhs.digits, rhs.digits, ndigits) <= 0; }
+    friend constexpr bool operator>(const FixedNum& lhs, const FixedNum& rhs) { return cmp_digits(lhs.digits, rhs.digits, ndigits) > 0; }
+    friend constexpr bool operator>=(const FixedNum& lhs, const FixedNum& rhs) { return cmp_digits(lhs.digits, rhs.digits, ndigits) >= 0; }
+
+    uint32_t digits[ndigits]; // least significant digit first
+};
+
+using Num256 = FixedNum<256>;
+using Num512 = FixedNum<512>;
+using Num1024 = FixedNum<1024>;
@@ -0,0 +1,119 @@
+// ======================================================================================
+// Intrinsics.h
+// - bit counting and wide multiply primitives for digit kernels
+//
+// These map to single instructions (lzcnt/bsr, tzcnt/bsf, popcnt, mul) where the
+// compiler offers them, with portable code as a last resort. The count functions
+// return the width of the type for a zero input, like lzcnt/tzcnt do.
+// ======================================================================================
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Count leading zero bits
+inline int clz32(uint32_t v)
+{
+    #if defined(_MSC_VER)
+    unsigned long index;
+    return _BitScanReverse(&index, v) ? 31 - int(index) : 32;
+    #elif defined(__GNUC__) || defined(__clang__)
+    return v ? __builtin_clz(v) : 32;
+    #else
+    int n = 0;
+    for (uint32_t bit = 0x8000'0000; bit != 0 && (v & bit) == 0; bit >>= 1)
+        n += 1;
+    return n;
+    #endif
+}
+
+inline int clz64(uint64_t v)
+{
+    #if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    return _BitScanReverse64(&index, v) ? 63 - int(index) : 64;
+    #elif defined(__GNUC__) || defined(__clang__)
+    return v ? __builtin_clzll(v) : 64;
+    #else
+    uint32_t hi = uint32_t(v >> 32);
+    return hi ? clz32(hi) : 32 + clz32(uint32_t(v));
+    #endif
+}
+
+// Count trailing zero bits
+inline int ctz32(uint32_t v)
+{
+    #if defined(_MSC_VER)
+    unsigned long index;
+    return _BitScanForward(&index, v) ? int(index) : 32;
+    #elif defined(__GNUC__) || defined(__clang__)
+    return v ? __builtin_ctz(v) : 32;
+    #else
+    int n = 0;
+    for (uint32_t bit = 1; bit != 0 && (v & bit) == 0; bit <<= 1)
+        n += 1;
+    return n;
+    #endif
+}
+
+inline int ctz64(uint64_t v)
+{
+    #if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    return _BitScanForward64(&index, v) ? int(index) : 64;
+    #elif defined(__GNUC__) || defined(__clang__)
+    return v ? __builtin_ctzll(v) : 64;
+    #else
+    uint32_t lo = uint32_t(v);
+    return lo ? ctz32(lo) : 32 + ctz32(uint32_t(v >> 32));
+    #endif
+}
+
+// 64 x 64 -> 128 bit multiply. Returns the low half and stores the high half.
+inline uint64_t mul64(uint64_t a, uint64_t b, uint64_t* hi)
+{
+    #if defined(_MSC_VER) && defined(_M_X64)
+    return _umul128(a, b, hi);
+    #elif defined(__SIZEOF_INT128__)
+    unsigned __int128 p = (unsigned __int128) a * b;
+    *hi = uint64_t(p >> 64);
+    return uint64_t(p);
+    #else
+    uint64_t a0 = uint32_t(a), a1 = a >> 32;
+    uint64_t b0 = uint32_t(b), b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + uint32_t(p01) + uint32_t(p10);
+    *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+    return (mid << 32) | uint32_t(p00);
+    #endif
+}
+
+// Count one bits
+inline int popcount32(uint32_t v)
+{
+    #if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    return int(__popcnt(v));
+    #elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(v);
+    #else
+    v = v - ((v >> 1) & 0x5555'5555);
+    v = (v & 0x3333'3333) + ((v >> 2) & 0x3333'3333);
+    v = (v + (v >> 4)) & 0x0F0F'0F0F;
+    return int((v * 0x0101'0101) >> 24);
+    #endif
+}
+
+inline int popcount64(uint64_t v)
+{
+    #if defined(_MSC_VER) && defined(_M_X64)
+    return int(__popcnt64(v));
+    #elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(v);
+    #else
+    return popcount32(uint32_t(v)) + popcount32(uint32_t(v >> 32));
+    #endif
+}
@@ -0,0 +1,240 @@
+// ======================================================================================
+// Montgomery.cpp
+// - modular arithmetic in Montgomery form for a fixed odd modulus
+//
+// See "Modern Computer Arithmetic" (Brent, Zimmermann) 2.4.2 for Montgomery reduction.
+// Multiplication uses the CIOS (coarsely integrated operand scanning) form, which
+// interleaves the multiply and the reduction one digit of b at a time so that the
+// scratch space is only k+2 digits.
+// ======================================================================================
+
+#include "Montgomery.h"
+#include "Digits.h"
+
+#include <cassert>
+
+// --------------------------------------------------------------------------------------
+
+// Copy a Num into exactly k digits, zero-extending it (the Num must fit)
+static void load_digits(uint32_t* r, const Num& a, int k)
+{
+    int len = a.data.length();
+    assert(len <= k);
+    memcpy(r, a.cdatabuffer(), len * sizeof(uint32_t));
+    memset(r + len, 0, (k - len) * sizeof(uint32_t));
+}
+
+// ======================================================================================
+// Construction
+// ======================================================================================
+
+Montgomery::Montgomery(const Num& modulus) : n(modulus)
+{
+    n.data.sign = 0;
+    k = n.data.length();
+    assert(k > 0 && (n.cdatabuffer()[0] & 1) != 0);
+
+    // -1/n mod 2^32
+    ninv = uint32_t(0) - inverse_digit(n.cdatabuffer()[0]);
+
+    // One allocation holds all the constants plus the mul scratch
+    r1 = num_alloc_digits(4 * k + 2);
+    rm1 = r1 + k;
+    r2 = rm1 + k;
+    t = r2 + k;
+
+    // R^2 mod n, computed once with a real divide. Everything else is derived from it.
+    Num R2;
+    uint32_t* p = R2.resize(2 * k + 1);
+    memset(p, 0, 2 * k * sizeof(uint32_t));
+    p[2 * k] = 1;
+    R2 %= n;
+    load_digits(r2, R2, k);
+
+    // R mod n is the Montgomery form of 1 (1*R^2/R)
+    uint32_t* unit = num_alloc_digits(k);
+    memset(unit, 0, k * sizeof(uint32_t));
+    unit[0] = 1;
+    mul(r1, unit, r2);
+    num_free_digits(unit);
+
+    neg(rm1, r1);
+}
+
+Montgomery::~Montgomery() noexcept
+{
+    num_free_digits(r1);
+}
+
+// ======================================================================================
+// Conversion
+// ======================================================================================
+
+void Montgomery::to_mont(uint32_t* r, const Num& a) const
+{
+    Num reduced{a};
+    reduced.data.sign = 0;
+    if (reduced.magcmp(n) >= 0)
+        reduced %= n;
+    load_digits(r, reduced, k);
+    mul(r, r, r2);
+}
+
+void Montgomery::to_mont(uint32_t* r, uint32_t a) const
+{
+    to_mont(r, Num{a});
+}
+
+Num Montgomery::from_mont(const uint32_t* a) const
+{
+    // a*1/R mod n
+    Num result;
+    uint32_t* rbuf = result.resize(k);
+    uint32_t* unit = num_alloc_digits(k);
+    memset(unit, 0, k * sizeof(uint32_t));
+    unit[0] = 1;
+    mul(rbuf, a, unit);
+    num_free_digits(unit);
+    result.trim();
+    return result;
+}
+
+// ======================================================================================
+// Arithmetic
+// ======================================================================================
+
+// r = a*b/R mod n (CIOS)
+void Montgomery::mul(uint32_t* r, const uint32_t* a, const uint32_t* b) const
+{
+    const uint32_t* nd = n.cdatabuffer();
+    memset(t, 0, (k + 2) * sizeof(uint32_t));
+
+    for (int i = 0; i < k; i++)
+    {
+        // t += a * b[i]
+        uint64_t carry = 0;
+        uint64_t bi = b[i];
+        for (int j = 0; j < k; j++)
+        {
+            carry = carry + t[j] + a[j] * bi;
+            t[j] = uint32_t(carry);
+            carry >>= 32;
+        }
+        carry = carry + t[k];
+        t[k] = uint32_t(carry);
+        t[k + 1] = uint32_t(carry >> 32);
+
+        // t = (t + m*n) / 2^32, where m is picked to make the low digit zero
+        uint64_t m = uint32_t(t[0] * ninv);
+        carry = (t[0] + m * nd[0]) >> 32;
+        for (int j = 1; j < k; j++)
+        {
+            carry = carry + t[j] + m * nd[j];
+            t[j - 1] = uint32_t(carry);
+            carry >>= 32;
+        }
+        carry = carry + t[k];
+        t[k - 1] = uint32_t(carry);
+        t[k] = t[k + 1] + uint32_t(carry >> 32);
+    }
+
+    // The result is less than 2n, so at most one subtraction reduces it
+    if (t[k] != 0 || cmp_digits(t, nd, k) >= 0)
+        sub_digits(t, t, nd, k);
+    copy(r, t);
+}
+
+void Montgomery::add(uint32_t* r, const uint32_t* a, const uint32_t* b) const
+{
+    const uint32_t* nd = n.cdatabuffer();
+    uint32_t carry = add_digits(r, a, b, k);
+    if (carry != 0 || cmp_digits(r, nd, k) >= 0)
+        sub_digits(r, r, nd, k);
+}
+
+void Montgomery::sub(uint32_t* r, const uint32_t* a, const uint32_t* b) const
+{
+    if (sub_digits(r, a, b, k) != 0)
+        add_digits(r, r, n.cdatabuffer(), k);
+}
+
+void Montgomery::neg(uint32_t* r, const uint32_t* a) const
+{
+    if (is_zero(a))
+        copy(r, a);
+    else
+        sub_digits(r, n.cdatabuffer(), a, k);
+}
+
+// Halving works directly on the Montgomery form, since (x/2)*R == (x*R)/2 mod n.
+// An odd value is made even by adding the (odd) modulus first.
+void Montgomery::half(uint32_t* r, const uint32_t* a) const
+{
+    uint32_t carry = 0;
+    if (a[0] & 1)
+        carry = add_digits(r, a, n.cdatabuffer(), k);
+    else
+        copy(r, a);
+
+    for (int i = 0; i < k - 1; i++)
+        r[i] = (r[i] >> 1) | (r[i + 1] << 31);
+    r[k - 1] = (r[k - 1] >> 1) | (carry << 31);
+}
+
+bool Montgomery::is_zero(const uint32_t* a) const
+{
+    for (int i = 0; i < k; i++)
+        if (a[i] != 0)
+            return false;
+    return true;
+}
+
+// Left-to-right fixed-window exponentiation with 4-bit windows. A table of a^0..a^15
+// costs 14 multiplies and saves most of the multiplies a binary ladder would do.
+void Montgomery::pow(uint32_t* r, const uint32_t* a, const Num& e) const
+{
+    static constexpr int window = 4;
+    const int tsize = 1 << window;
+
+    const uint32_t* ebuf = e.cdatabuffer();
+    int elen = e.data.length();
+    if (elen == 0)
+    {
+        one(r);
+        return;
+    }
+
+    uint32_t* table = num_alloc_digits(tsize * k);
+    one(table);
+    copy(table + k, a);
+    for (int i = 2; i < tsize; i++)
+        mul(table + i * k, table + (i - 1) * k, a);
+
+    // Walk the exponent a nibble at a time from the top (a digit is 8 nibbles,
+    // so windows never straddle digits)
+    uint32_t* acc = num_alloc_digits(k);
+    bool started = false;
+    for (int i = elen - 1; i >= 0; --i)
+    {
+        for (int shift = 32 - window; shift >= 0; shift -= window)
+        {
+            int w = (ebuf[i] >> shift) & (tsize - 1);
+            if (started)
+            {
+                for (int s = 0; s < window; s++)
+                    sqr(acc, acc);
+                if (w != 0)
+                    mul(acc, acc, table + w * k);
+            }
+            else if (w != 0)
+            {
+                copy(acc, table + w * k);
+                started = true;
+            }
+        }
+    }
+
+    copy(r, acc);
+    num_free_digits(acc);
+    num_free_digits(table);
+}
@@ -0,0 +1,75 @@
+// ======================================================================================
+// Montgomery.h
+// - modular arithmetic in Montgomery form for a fixed odd modulus
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+
+// ======================================================================================
+// Montgomery
+// - a context object for arithmetic modulo an odd Num n. Values are kept as arrays of
+//   exactly size() digits holding x*R mod n, where R = 2^(32*size()). This turns every
+//   modular reduction into multiplies and shifts instead of a MultiwordDivide.
+//
+// The caller owns the storage for values; the context only owns the modulus and the
+// precomputed constants. Every operation allows its output to alias its inputs.
+//
+// The context has a scratch buffer, so a single Montgomery object must not be used
+// from more than one thread at a time.
+
+class Montgomery
+{
+public:
+    // The modulus must be odd and greater than 1
+    explicit Montgomery(const Num& modulus);
+    ~Montgomery() noexcept;
+
+    Montgomery(const Montgomery&) = delete;
+    Montgomery& operator=(const Montgomery&) = delete;
+
+    // Number of digits in each value
+    int size() const { return k; }
+
+    // Convert in and out of Montgomery form. to_mont accepts any non-negative Num
+    // and reduces it modulo n first.
+    void to_mont(uint32_t* r, const Num& a) const;
+    void to_mont(uint32_t* r, uint32_t a) const;
+    Num from_mont(const uint32_t* a) const;
+
+    // Constants: r = 1, r = n - 1 (i.e. -1), both in Montgomery form
+    void one(uint32_t* r) const { copy(r, r1); }
+    void minus_one(uint32_t* r) const { copy(r, rm1); }
+
+    // r = a*b/R mod n
+    void mul(uint32_t* r, const uint32_t* a, const uint32_t* b) const;
+    void sqr(uint32_t* r, const uint32_t* a) const { mul(r, a, a); }
+
+    // r = a + b, r = a - b, r = -a, r = a/2 (all mod n)
+    void add(uint32_t* r, const uint32_t* a, const uint32_t* b) const;
+    void sub(uint32_t* r, const uint32_t* a, const uint32_t* b) const;
+    void neg(uint32_t* r, const uint32_t* a) const;
+    void half(uint32_t* r, const uint32_t* a) const;
+
+    // r = a^e mod n for a non-negative exponent
+    void pow(uint32_t* r, const uint32_t* a, const Num& e) const;
+
+    // r = prod bases[i]^exps[i] mod n for count values in Montgomery form and
+    // non-negative exponents, sharing one chain of squarings (Num_multipow.cpp)
+    void multi_pow(uint32_t* r, const uint32_t* const* bases, const Num* exps, int count) const;
+
+    // Comparisons of values in Montgomery form
+    bool equal(const uint32_t* a, const uint32_t* b) const { return 0 == memcmp(a, b, k * sizeof(uint32_t)); }
+    bool is_zero(const uint32_t* a) const;
+
+    void copy(uint32_t* r, const uint32_t* a) const { memmove(r, a, k * sizeof(uint32_t)); }
+
+    Num n;          // the modulus
+    int k;          // digits in the modulus
+    uint32_t ninv;  // -1/n mod 2^32
+    uint32_t* r1;   // R mod n (1 in Montgomery form)
+    uint32_t* rm1;  // n - (R mod n) (-1 in Montgomery form)
+    uint32_t* r2;   // R^2 mod n, used to convert into Montgomery form
+    uint32_t* t;    // k+2 digits of scratch for mul
+};
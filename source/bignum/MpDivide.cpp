@@ -9,51 +9,32 @@
 
 // --------------------------------------------------------------------------------------
 
-// Count leading zeros primitive. On Intel, this is the lzcnt or lzcnt32 instruction.
-// At worst, we use a handwritten loop.
+// Count leading zeros primitive. This uses bsr (or the compiler's builtin for it)
+// rather than lzcnt: lzcnt needs a compiler flag, and on a CPU without it the same
+// encoding runs as bsr and silently returns the wrong count. At worst, we use a
+// handwritten loop.
 
 #if defined(_MSC_VER)
 #include <intrin.h>
-// this gives us __lzcnt16 and __lzcnt
 
-#elif defined(__clang__) && __has_include(<x86intrin.h>)
-#include <x86intrin.h>
-#define __lzcnt(X) __lzcnt32(X)
-
-#elif defined(__clang__)
-static __inline__ unsigned short
-__lzcnt16(unsigned short __X)
+static inline unsigned int
+LeadingZeros32(unsigned int x)
 {
-    return __X ? __builtin_clzs(__X) : 16;
+    unsigned long index;
+    return _BitScanReverse(&index, x) ? 31 - index : 32;
 }
-static __inline__ unsigned int
-__lzcnt(unsigned int __X)
+
+#elif defined(__clang__) || defined(__GNUC__)
+static inline unsigned int
+LeadingZeros32(unsigned int x)
 {
-    return __X ? __builtin_clz(__X) : 32;
+    return x ? __builtin_clz(x) : 32;
 }
 
 #else
 // straight C implementation - leading zeros through binary search
-static unsigned short
-__lzcnt16(unsigned short x)
-{
-    unsigned short y;
-    unsigned short n = 16;
-    for (unsigned short c = 8; c != 0; c >>= 1)
-    {
-        y = x >> c;
-        if (y != 0)
-        {
-            n = n - c;
-            x = y;
-        }
-        c = c >> 1;
-    }
-    return n - x;
-}
-
 static unsigned int
-__lzcnt(unsigned int x)
+LeadingZeros32(unsigned int x)
 {
     unsigned int y;
     unsigned int n = 32;
@@ -65,12 +46,17 @@ __lzcnt(unsigned int x)
             n = n - c;
             x = y;
         }
-        c = c >> 1;
     }
     return n - x;
 }
 #endif
 
+static inline unsigned int
+LeadingZeros16(unsigned short x)
+{
+    return LeadingZeros32(x) - 16;
+}
+
 // --------------------------------------------------------------------------------------
 
 template <typename WORD>
@@ -84,7 +70,7 @@ struct ContainsType<uint16_t>
     static constexpr type base = 1 << 16;
     static constexpr type mask = base - 1;
 
-    static int LeadingZeros(uint16_t v) { return __lzcnt16(v); }
+    static int LeadingZeros(uint16_t v) { return LeadingZeros16(v); }
 };
 
 template<>
@@ -95,7 +81,7 @@ struct ContainsType<uint32_t>
     static constexpr type base = 1LL << 32;
     static constexpr type mask = base - 1;
 
-    static int LeadingZeros(uint32_t v) { return __lzcnt(v); }
+    static int LeadingZeros(uint32_t v) { return LeadingZeros32(v); }
 };
 
 // --------------------------------------------------------------------------------------
@@ -241,7 +227,7 @@ bool MultiwordDivide(
             k = 0;
             for (int i = 0; i < n; i++)
             {
-                t = un[i+j] + vn[i] + k;
+                t = int64_t(un[i+j]) + vn[i] + k; // widen before the add so it can carry
                 un[i+j] = WORD(t);
                 k = t >> shift;
             }
@@ -252,8 +238,12 @@ bool MultiwordDivide(
     // If the caller wants the remainder, unnormalize it first
     if (remainder != nullptr)
     {
-        for (int i = 0; i < n; i++)
-            remainder[i] = (un[i] >> s) | (un[i+1] << (shift-s));
+        // (a shift by the full word width is undefined, so s == 0 is a plain copy)
+        if (s == 0)
+            for (int i = 0; i < n; i++) remainder[i] = un[i];
+        else
+            for (int i = 0; i < n; i++)
+                remainder[i] = (un[i] >> s) | (un[i+1] << (shift-s));
     }
 
     return true;
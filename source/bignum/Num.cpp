@@ -6,11 +6,18 @@
 // ======================================================================================
 
 #include "Num.h"
+#include "Digits.h"
+#include "Reciprocal.h"
 
 #include <cassert>
 #include <cstring>
 #include <cstdint>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NUM_SSE2 1
+#endif
+
 // ======================================================================================
 // Copy constructors that convert other types to Num
 // ======================================================================================
@@ -52,19 +59,16 @@ void Num::from_int64(long long v)
 // Convert a uint64_t to a Num
 void Num::from_uint64(unsigned long long uv)
 {
-    data.reserve(2); // make sure we have enough space for a uint64
-    data.len = 0;
-    data.sign = 0;
-
-    uint32_t* digits = data.digits();
+    set_small(uv, 0, 0);
+}
 
-    int i = 0;
-    for (; uv != 0; i++)
-    {
-        data.len += 1;
-        digits[i] = (uv & 0xFFFFFFFFL);
-        uv >>= 32;
-    }
+// Copy the digits a NumView refers to
+Num::Num(const NumView& v)
+{
+    uint32_t* d = resize(v.len);
+    if (v.len != 0)
+        memcpy(d, v.digits, v.len * sizeof(uint32_t));
+    data.sign = v.sign;
 }
 
 #if 0
@@ -171,31 +175,43 @@ int64_t Num::to_int64() const
 // Return size of buffer required
 int Num::to_cstring(char* p, int buflen, int base)
 {
+    assert(base >= 2 && base <= 36);
     int i = 0;
     #define PUT(c) { if (i < buflen) p[i] = c; i++; }
 
-    // Now convert the number by repeatedly dividing it by the base
-    Num t{*this};
-    int sign = data.sign;
-    if (sign)
+    if (data.sign)
         PUT('-')
-    data.sign = 0;
 
-    Num B{base};
-    Num quotient;
-    Num remainder;
+    // Divide by the largest power of the base that fits in a limb, and split each
+    // remainder into that many digits. Both divisors have a reciprocal, so there
+    // are no hardware divides.
+    NativeLimb chunk = NativeLimb(base);
+    int chunk_digits = 1;
+    while (chunk <= NativeLimb(~NativeLimb(0) / NativeLimb(base)))
+    {
+        chunk *= NativeLimb(base);
+        chunk_digits += 1;
+    }
+    Reciprocal<NativeLimb> by_chunk{chunk};
+    Reciprocal<NativeLimb> by_base{NativeLimb(base)};
 
+    Num t{*this};
+    t.data.sign = 0;
     do
     {
-        //uint32_t r = t.divmod(base, quotient);
-        t.divmod(base, quotient, remainder);
-        auto r = remainder.to_int64();
-        char ch = '0' + (char) r;
-        if (r > 9) ch += ('A' - '9' - 1); // turn 10+ into 'A'+
-
-        PUT(ch);
-        t = quotient; // replace with pointer swap
-        t.trim();
+        NativeLimb r = divmod_1(t, by_chunk, &t);
+        for (int k = 0; k < chunk_digits; k++)
+        {
+            // Emit digits least significant first; the top chunk stops at its
+            // leading zeros
+            NativeLimb digit = 0;
+            r = by_base.divrem(digit, r);
+            char ch = '0' + (char) digit;
+            if (digit > 9) ch += ('A' - '9' - 1); // turn 10+ into 'A'+
+            PUT(ch);
+            if (r == 0 && t.data.len == 0)
+                break;
+        }
     } while (t.data.len != 0);
 
     PUT(0)
@@ -206,7 +222,7 @@ int Num::to_cstring(char* p, int buflen, int base)
         p[0] = 0;
     else
     {
-        int j = sign ? 1 : 0; // skip any leading '-' sign
+        int j = data.sign ? 1 : 0; // skip any leading '-' sign
         int k = i - 2; // leave zero-terminator in place
         while (j < k)
         {
@@ -294,22 +310,63 @@ void Num::trim()
 //   +1: Num > Num
 int Num::magcmp(const Num& rhs) const
 {
+    return ::magcmp(*this, rhs);
+}
+
+// |NumView| <=> |NumView|
+int magcmp(const NumView& lhs, const NumView& rhs)
+{
+    NUM_COUNT_OP(NumOp::Compare, lhs.len + rhs.len);
+
     // Trivially, if the numbers are different lengths, the longer number is
     // greater than the shorter number
-    if (data.len != rhs.data.len)
-        return data.len > rhs.data.len ? 1 : -1;
-
-    // Compare magnitude digits from greater to lesser
-    auto ld = cdatabuffer();
-    auto rd = rhs.cdatabuffer();
-    for (int i = data.len - 1; i >= 0; --i)
+    if (lhs.len != rhs.len)
+        return lhs.len > rhs.len ? 1 : -1;
+
+    // Compare magnitude digits from greater to lesser. Equal-length numbers often share
+    // a long prefix (neighbouring keys in a sorted index, say), which we skip four
+    // digits at a time, and then find the first difference digit by digit.
+    int n = lhs.len;
+    if (lhs.digits == rhs.digits)
+        return 0;
+
+    #if defined(NUM_SSE2)
+    while (n >= 4)
     {
-        if (ld[i] != rd[i])
-            return ld[i] > rd[i] ? 1 : -1;
+        __m128i a = _mm_loadu_si128((const __m128i*) (lhs.digits + n - 4));
+        __m128i b = _mm_loadu_si128((const __m128i*) (rhs.digits + n - 4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, b)) != 0xFFFF)
+            break;
+        n -= 4;
     }
+    #endif
+
+    return cmp_digits(lhs.digits, rhs.digits, n);
+}
+
+// NumView <=> NumView
+// Zero is always positive, so differing signs decide it.
+int compare(const NumView& lhs, const NumView& rhs)
+{
+    if (lhs.sign != rhs.sign)
+        return lhs.sign ? -1 : 1;
+    int c = magcmp(lhs, rhs);
+    return lhs.sign ? -c : c;
+}
 
-    // Numbers have the same magnitude
-    return 0;
+// Num <=> integer
+int compare_int(const Num& a, IntOperand v)
+{
+    NUM_COUNT_OP(NumOp::Compare, a.data.len + 2);
+    if (a.data.sign != v.sign)
+        return a.data.sign ? -1 : 1;
+    int c = 1;
+    if (a.is_small())
+    {
+        uint64_t m = a.small_magnitude();
+        c = m < v.magnitude ? -1 : m > v.magnitude ? 1 : 0;
+    }
+    return a.data.sign ? -c : c;
 }
 
 // Num <=> digit
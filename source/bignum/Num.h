@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include "NumCounters.h"
+
 #include <cstdint>
 #include <cstring>
 
@@ -67,6 +69,9 @@ public:
     // At the moment, we have sizeof(NumBuffer) == 32
     static constexpr int smallbufsize = 7;
 
+    // The largest length a NumBuffer can hold (len is a 30-bit signed field)
+    static constexpr int maxlen = (1 << 29) - 1;
+
     // Question - does a NumBuffer still start on an 8-byte boundary? It would
     // be bad if it didn't
     #pragma pack(push, 4)
@@ -91,15 +96,62 @@ public:
     #pragma pack(pop)
 };
 
+#include <cassert>
 #include <cstddef>
+#include <cstdio>
 
 static_assert(sizeof(NumBuffer) == 32, "NumBuffer unexpected size");
 static_assert(sizeof(NumBuffer::buf) >= sizeof(NumBuffer::big), "NumBuffer::small data too small!");
 
+#include <functional>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <vector>
+
+// ======================================================================================
+
+class Num;
+class NumView;
 
 // ======================================================================================
+// Integer operands
+// - the operators between a Num and an integer of any width take the integer as a
+//   64-bit magnitude and a sign, and go straight to single-limb code instead of
+//   making a Num of it
+
+struct IntOperand
+{
+    uint64_t magnitude;
+    int32_t sign; // 0 or -1, as in a Num
+};
+
+template <typename T>
+using if_integer = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int>;
+
+template <typename T, if_integer<T> = 0>
+constexpr IntOperand int_operand(T v)
+{
+    if constexpr (std::is_signed_v<T>)
+        return { v < 0 ? 0 - uint64_t(v) : uint64_t(v), v < 0 ? -1 : 0 };
+    else
+        return { uint64_t(v), 0 };
+}
+
+constexpr IntOperand negated(IntOperand v)
+{
+    return { v.magnitude, v.magnitude != 0 ? ~v.sign : 0 };
+}
+
+// r = a + v (Num_addsub.cpp) and r = a * v (Num_muldiv.cpp). r may be a.
+void add_int(Num& r, const Num& a, IntOperand v);
+void mul_int(Num& r, const Num& a, IntOperand v);
+
+// |a| / m into q if q isn't null (q may be a), and returns |a| mod m (Num_muldiv.cpp)
+uint64_t div_int(Num* q, const Num& a, uint64_t m);
+
+// a <=> v: -1, 0 or 1 (Num.cpp)
+int compare_int(const Num& a, IntOperand v);
 
 class Num
 {
@@ -143,6 +195,9 @@ public:
     // Construct from a string
     Num(const std::string& s, int base=10);
 
+    // Copy the number a NumView refers to
+    explicit Num(const NumView& v);
+
     // Conversion operators (will return mod 2^32 or 2^64)
     #if 0
     explicit operator int() const;
@@ -153,15 +208,10 @@ public:
 
     // Each operator has several variants
     // - Num op Num
-    // - Num op uint32_t
-    // - uint32_t op Num
-    // TBD integral variants with friend operator (instead of conversion to Num which takes time)
+    // - Num op integer and integer op Num, for integers of any width (below)
     #define ARITH_OP(OP) \
-        Num operator OP (const Num& rhs); \
-        Num& operator OP##= (const Num& rhs); \
-        /*Num operator OP (const uint32_t& rhs);*/ \
-        /*Num& operator OP##= (const uint32_t& rhs)*/ \
-        ;
+        Num operator OP (const Num& rhs) const; \
+        Num& operator OP##= (const Num& rhs);
 
     ARITH_OP(+)
     ARITH_OP(-)
@@ -172,13 +222,104 @@ public:
 
     #undef ARITH_OP
 
-    // shifts - these always operate on the absolute value of the number
-    Num& operator>>(const int rhs);
+    // Arithmetic with a NumView operand, which reads the digits in place
+    Num& operator+=(const NumView& rhs);
+    Num& operator-=(const NumView& rhs);
+    Num& operator*=(const NumView& rhs);
+
+    // Arithmetic and comparisons with an integer operand. These never make a Num of
+    // the integer, and only allocate when the result outgrows its buffer. As with Num
+    // operands, the quotient is of the magnitudes, and the remainder has the sign of
+    // the dividend.
+    template <typename T, if_integer<T> = 0>
+    Num& operator+=(T v) { add_int(*this, *this, int_operand(v)); return *this; }
+    template <typename T, if_integer<T> = 0>
+    Num& operator-=(T v) { add_int(*this, *this, negated(int_operand(v))); return *this; }
+    template <typename T, if_integer<T> = 0>
+    Num& operator*=(T v) { mul_int(*this, *this, int_operand(v)); return *this; }
+    template <typename T, if_integer<T> = 0>
+    Num& operator/=(T v) { div_int(this, *this, int_operand(v).magnitude); return *this; }
+    template <typename T, if_integer<T> = 0>
+    Num& operator%=(T v) { set_small(div_int(nullptr, *this, int_operand(v).magnitude), 0, data.sign); return *this; }
+
+    template <typename T, if_integer<T> = 0>
+    friend Num operator+(const Num& a, T b) { Num r; add_int(r, a, int_operand(b)); return r; }
+    template <typename T, if_integer<T> = 0>
+    friend Num operator-(const Num& a, T b) { Num r; add_int(r, a, negated(int_operand(b))); return r; }
+    template <typename T, if_integer<T> = 0>
+    friend Num operator*(const Num& a, T b) { Num r; mul_int(r, a, int_operand(b)); return r; }
+    template <typename T, if_integer<T> = 0>
+    friend Num operator/(const Num& a, T b) { Num q; div_int(&q, a, int_operand(b).magnitude); return q; }
+    template <typename T, if_integer<T> = 0>
+    friend Num operator%(const Num& a, T b) { Num r; r.set_small(div_int(nullptr, a, int_operand(b).magnitude), 0, a.data.sign); return r; }
+
+    template <typename T, if_integer<T> = 0>
+    friend Num operator+(T a, const Num& b) { return b + a; }
+    template <typename T, if_integer<T> = 0>
+    friend Num operator-(T a, const Num& b) { Num r; add_int(r, b, negated(int_operand(a))); r.data.sign = r.data.len != 0 ? ~r.data.sign : 0; return r; }
+    template <typename T, if_integer<T> = 0>
+    friend Num operator*(T a, const Num& b) { return b * a; }
+
+    // An integer divided by a Num that doesn't fit 64 bits is 0, remainder the integer
+    template <typename T, if_integer<T> = 0>
+    friend Num operator/(T a, const Num& b)
+    {
+        assert(b.data.len != 0);
+        Num q;
+        if (b.is_small())
+            q.set_small(int_operand(a).magnitude / b.small_magnitude(), 0, 0);
+        return q;
+    }
+    template <typename T, if_integer<T> = 0>
+    friend Num operator%(T a, const Num& b)
+    {
+        assert(b.data.len != 0);
+        IntOperand v = int_operand(a);
+        Num r;
+        r.set_small(b.is_small() ? v.magnitude % b.small_magnitude() : v.magnitude, 0, v.sign);
+        return r;
+    }
+
+    #define INT_COMPARE(OP) \
+        template <typename T, if_integer<T> = 0> \
+        friend bool operator OP (const Num& a, T b) { return compare_int(a, int_operand(b)) OP 0; } \
+        template <typename T, if_integer<T> = 0> \
+        friend bool operator OP (T a, const Num& b) { return 0 OP compare_int(b, int_operand(a)); }
+
+    INT_COMPARE(==)
+    INT_COMPARE(!=)
+    INT_COMPARE(<)
+    INT_COMPARE(<=)
+    INT_COMPARE(>)
+    INT_COMPARE(>=)
+
+    #undef INT_COMPARE
+
+    // shifts - these behave like shifts of two's complement numbers, so >> rounds
+    // towards negative infinity. A negative shift count shifts the other way.
+    Num operator<<(const int rhs) const;
+    Num& operator<<=(const int rhs);
+    Num operator>>(const int rhs) const;
     Num& operator>>=(const int rhs);
 
+    // bitwise operators - these treat Num as an infinitely sign-extended two's
+    // complement number. There is no xor operator, because ^ is exponentiation.
+    Num operator&(const Num& rhs) const;
+    Num& operator&=(const Num& rhs);
+    Num operator|(const Num& rhs) const;
+    Num& operator|=(const Num& rhs);
+    Num& bit_xor(const Num& rhs);
+    Num operator~() const; // -x - 1
+
+    // bit queries
+    int bit_length() const; // number of bits in the magnitude (0 for zero)
+    int popcount() const;   // number of one bits in the magnitude
+    int ctz() const;        // trailing zero bits (-1 for zero)
+    bool test_bit(int i) const; // bit i of the two's complement form
+
     // divmod instruction that returns both remainder and quotient
     void divmod(const Num& rhs, Num& quotient, Num& remainder);
-    //uint32_t divmod(uint32_t rhs, Num& quotient);
+    uint32_t divmod(uint32_t rhs, Num& quotient); // of the magnitude, returns the remainder
 
     #if 0
     // Math by a single "digit"
@@ -215,18 +356,34 @@ public:
     uint64_t to_uint64() const; // modulo 2^64
     int64_t to_int64() const;  // modulo 2^63
 
+    // Convert Num to floating point, correctly rounded (to nearest, ties to even).
+    // Values beyond the range of the type give infinity. A long double with more
+    // than 64 mantissa bits gets a value rounded to 64 bits.
+    double to_double() const;
+    long double to_long_double() const;
+
+    // Like frexp: the Num is m * 2^exp with |m| in [0.5, 1), where m is rounded to
+    // double precision. This works for any Num, however big.
+    double to_double_with_exponent(int64_t* exp) const;
+
     // Convert string to Num
     bool from_cstring(char const* p, int base=10);
     const Num& from_string(const std::string_view& s, int base=10);
     const Num& from_string(const std::string& s, int base=10);
 
-    // Convert Num to string
+    // Convert Num to string. For very long numbers, write_num (below) sends the
+    // digits to a file as they are produced instead.
     int to_cstring(char* p, int len, int base=10);
     std::string to_string(int base=10);
 
     void from_int64(long long v);
     void from_uint64(unsigned long long uv);
 
+    // Convert floating point to Num, truncating toward zero like a cast to an integer
+    // type. NaN and infinity give zero and return false.
+    bool from_double(double v);
+    bool from_long_double(long double v);
+
 //private:
 
     // Grow a Num by the indicated number of digits. This is an internal function
@@ -247,6 +404,47 @@ public:
     // is non-zero, or the Num is zero length.
     void trim();
 
+    // Flip the sign in place, leaving zero non-negative
+    void negate()
+    {
+        if (data.len != 0)
+            data.sign = ~data.sign;
+    }
+
+    // Small-value fast paths. A Num of at most two digits has a uint64_t magnitude,
+    // and operators on two such Nums use native arithmetic instead of digit loops.
+    bool is_small() const { return data.len <= 2; }
+
+    uint64_t small_magnitude() const
+    {
+        const uint32_t* d = cdatabuffer();
+        uint64_t lo = data.len > 0 ? d[0] : 0;
+        uint64_t hi = data.len > 1 ? d[1] : 0;
+        return (hi << 32) | lo;
+    }
+
+    // Set a Num to a magnitude of up to 128 bits (hi:lo) and a sign, in canonical
+    // form. Every NumBuffer has room for at least four digits, so this never
+    // allocates.
+    void set_small(uint64_t lo, uint64_t hi, int32_t sign)
+    {
+        static_assert(NumBuffer::smallbufsize >= 4, "set_small needs four digits");
+        uint32_t* d = databuffer();
+        d[0] = uint32_t(lo);
+        d[1] = uint32_t(lo >> 32);
+        if (hi != 0)
+        {
+            d[2] = uint32_t(hi);
+            d[3] = uint32_t(hi >> 32);
+        }
+        int len = hi != 0 ? ((hi >> 32) != 0 ? 4 : 3) : (lo >> 32) != 0 ? 2 : lo != 0 ? 1 : 0;
+
+        // Set the sign before the length: the sign is a byte-sized store, and a later
+        // read of the whole header word can't be forwarded from it.
+        data.sign = len != 0 ? sign : 0;
+        data.len = len;
+    }
+
     // Return the capacity of the Num. This is an internal function used by operators
     // and buffer management.
     int capacity() { return data.capacity(); }
@@ -261,10 +459,10 @@ public:
     const uint32_t* cdatabuffer() const { return data.cdigits(); }
 
     // Add lhs + rhs ignoring sign
-    Num& addto(const Num& rhs);
+    Num& addto(const NumView& rhs);
 
     // Subtract lhs - rhs ignoring sign and assuming lhs >= rhs
-    Num& subfrom(const Num& rhs);
+    Num& subfrom(const NumView& rhs);
 
     // Clear out part of a Num
     // TBD get rid of the need for this
@@ -277,12 +475,178 @@ public:
     NumBuffer data;
 };
 
-inline bool operator==(const Num& lhs, const Num& rhs) noexcept { return lhs.magcmp(rhs) == 0; }
-inline bool operator!=(const Num& lhs, const Num& rhs) noexcept { return lhs.magcmp(rhs) != 0; }
-inline bool operator<(const Num& lhs, const Num& rhs) noexcept { return lhs.magcmp(rhs) < 0; }
-inline bool operator<=(const Num& lhs, const Num& rhs) noexcept { return lhs.magcmp(rhs) <= 0; }
-inline bool operator>(const Num& lhs, const Num& rhs) noexcept { return lhs.magcmp(rhs) > 0; }
-inline bool operator>=(const Num& lhs, const Num& rhs) noexcept { return lhs.magcmp(rhs) >= 0; }
+// ======================================================================================
+// NumView
+// - a read-only, non-owning view of a number whose digits live somewhere else: in a
+//   Num, or in a buffer such as a memory-mapped file of serialized values. Num
+//   arithmetic and the comparisons below read a NumView's digits in place, so there
+//   is no copy into a NumBuffer.
+//
+// A NumView is only valid while the digits it points at are. A view of a Num is
+// invalidated by anything that resizes that Num.
+
+class NumView
+{
+public:
+    NumView() {}
+
+    // View len digits (least significant first). Leading zero digits are trimmed,
+    // so the view is in canonical form even if the source isn't.
+    NumView(const uint32_t* digits, int len, bool negative = false) : digits(digits), len(len)
+    {
+        while (this->len > 0 && digits[this->len - 1] == 0)
+            this->len -= 1;
+        sign = (negative && this->len != 0) ? -1 : 0;
+    }
+
+    // View a Num
+    NumView(const Num& n) : digits(n.cdatabuffer()), len(n.data.length()), sign(n.data.sign) {}
+
+    const uint32_t* digits = nullptr;
+    int len = 0;
+    int32_t sign = 0; // 0 for positive, -1 for negative
+};
+
+// Compare magnitudes: -1, 0 or 1
+int magcmp(const NumView& lhs, const NumView& rhs);
+
+// Compare signed values: -1, 0 or 1
+int compare(const NumView& lhs, const NumView& rhs);
+
+// Product of two views
+Num multiply(const NumView& lhs, const NumView& rhs);
+
+// floor(sqrt(n)), for n >= 0
+Num isqrt(const NumView& n);
+
+// prod bases[i]^exps[i] for non-negative exponents, and the same modulo a positive
+// modulus (Num_multipow.cpp). The powers share their squarings, so this is much
+// faster than multiplying separate powers.
+Num multi_pow(const Num* bases, const Num* exps, int count);
+Num multi_pow_mod(const Num* bases, const Num* exps, int count, const Num& modulus);
+
+// a / b when b is known to divide a exactly. This is much cheaper than a general
+// divide, but the result is meaningless if there is a remainder.
+Num divexact(const NumView& a, const NumView& b);
+
+// Does d divide a? This needs no division instructions.
+bool divisible_by(const NumView& a, uint32_t d);
+
+// Greatest common divisor of |a| and |b|, and gcd(0, 0) is 0 (Num_gcd.cpp)
+Num gcd(const NumView& a, const NumView& b);
+
+// The same, with cofactors: a s + b t == gcd(a, b), and |s| <= |b| / (2 gcd) when b
+// is not zero
+Num gcdext(const NumView& a, const NumView& b, Num& s, Num& t);
+
+// Operands of at least this many digits use the half-GCD, and smaller ones Lehmer's
+// algorithm. The best value depends on how fast multiply() is at those sizes.
+extern int gcd_hgcd_threshold;
+
+// Division by a single limb, with a divisor from Reciprocal.h. These divide the
+// magnitude of a, store the quotient if asked (quotient may be the Num that a
+// views), and return the remainder. The 64-bit versions take the digits in pairs,
+// and are the faster ones wherever there is a 64-bit multiply (see NativeLimb).
+template<typename Limb> struct Reciprocal;
+uint32_t divmod_1(const NumView& a, const Reciprocal<uint32_t>& d, Num* quotient = nullptr);
+uint64_t divmod_1(const NumView& a, const Reciprocal<uint64_t>& d, Num* quotient = nullptr);
+
+// |a| mod each of count divisors, in a single pass over the digits of a
+void mod_1(uint32_t* rems, const NumView& a, const Reciprocal<uint32_t>* divisors, int count);
+void mod_1(uint64_t* rems, const NumView& a, const Reciprocal<uint64_t>* divisors, int count);
+
+// ======================================================================================
+
+// Comparisons are of signed values. Use magcmp to compare magnitudes.
+inline bool operator==(const Num& lhs, const Num& rhs) noexcept { return compare(lhs, rhs) == 0; }
+inline bool operator!=(const Num& lhs, const Num& rhs) noexcept { return compare(lhs, rhs) != 0; }
+inline bool operator<(const Num& lhs, const Num& rhs) noexcept { return compare(lhs, rhs) < 0; }
+inline bool operator<=(const Num& lhs, const Num& rhs) noexcept { return compare(lhs, rhs) <= 0; }
+inline bool operator>(const Num& lhs, const Num& rhs) noexcept { return compare(lhs, rhs) > 0; }
+inline bool operator>=(const Num& lhs, const Num& rhs) noexcept { return compare(lhs, rhs) >= 0; }
+
+#if defined(__cpp_impl_three_way_comparison) && __has_include(<compare>)
+#include <compare>
+inline std::strong_ordering operator<=>(const Num& lhs, const Num& rhs) noexcept { return compare(lhs, rhs) <=> 0; }
+#endif
+
+// --------------------------------------------------------------------------------------
+// Hashing (Num_hash.cpp)
+
+// A 64-bit hash of the value, the same whatever buffer holds the digits
+uint64_t hash_value(const NumView& n, uint64_t seed = 0);
+
+namespace std
+{
+    template<>
+    struct hash<Num>
+    {
+        size_t operator()(const Num& n) const noexcept { return size_t(hash_value(n)); }
+    };
+}
+
+// --------------------------------------------------------------------------------------
+// Primes (Num_prime.cpp)
+
+// Baillie-PSW probable prime test, optionally followed by extra_rounds more
+// Miller-Rabin tests with the small odd primes as bases. Negative numbers are not prime.
+bool is_probable_prime(const Num& n, int extra_rounds = 0);
+
+// Smallest probable prime strictly greater than n
+Num next_prime(const Num& n);
+
+// --------------------------------------------------------------------------------------
+// Product and remainder trees (Num_tree.cpp)
+//
+// tree[0] is the list of moduli, each level above holds the products of neighbouring
+// pairs from the level below (an odd one out is carried up as is), and the last level
+// is the single product of all of them.
+
+using ProductTree = std::vector<std::vector<Num>>;
+
+ProductTree product_tree(const std::vector<Num>& moduli);
+
+// |x| mod each modulus in tree[0]
+std::vector<Num> remainder_tree(const Num& x, const ProductTree& tree);
+
+// --------------------------------------------------------------------------------------
+// Streaming output (Num_write.cpp)
+//
+// Write n in the given base (2 to 36, with upper case letters), most significant
+// digit first, in pieces of up to 64 KB. The first pieces reach the sink long before
+// the conversion is done, and the working memory is a small multiple of the size of
+// n, however long the text is. The sink returns false to stop the output, and the
+// write returns false if it was stopped or a write failed.
+
+using DigitSink = std::function<bool(const char* p, size_t len)>;
+
+bool write_num(const NumView& n, const DigitSink& sink, int base = 10);
+bool write_num(const NumView& n, FILE* f, int base = 10);
+bool write_num_fd(const NumView& n, int fd, int base = 10);
+
+// --------------------------------------------------------------------------------------
+// Binary serialization (Num_serialize.cpp)
+//
+// The fixed format is a 32-bit header holding (digit count << 1) | sign, followed by
+// the digits, all little-endian. Every record is a multiple of four bytes, so a file
+// of them stays aligned, and view_serialized can point a NumView straight at the
+// digits (of a memory-mapped file, say) without copying.
+//
+// The compact format is for storing many mostly-small values: a varint (LEB128)
+// header holding (byte count << 1) | sign, followed by the minimal number of
+// little-endian magnitude bytes. Zero takes one byte, and values below 2^8 two.
+//
+// The read functions return the number of bytes consumed, or 0 if the input is
+// truncated or malformed.
+
+size_t serialized_size(const NumView& n);
+size_t serialize(const NumView& n, uint8_t* out);
+size_t deserialize(Num& n, const uint8_t* in, size_t avail);
+size_t view_serialized(NumView& view, const uint8_t* in, size_t avail); // in must be 4-byte aligned
+
+size_t compact_size(const NumView& n);
+size_t serialize_compact(const NumView& n, uint8_t* out);
+size_t deserialize_compact(Num& n, const uint8_t* in, size_t avail);
 
 // --------------------------------------------------------------------------------------
 // Internal Num definition
@@ -303,6 +667,12 @@ bool MultiwordDivide(
     int dividendSize, int divisorSize,
     WORD* scratch = nullptr);
 
+// r = a * b (r has an+bn digits and does not overlap a or b)
+void MultiwordMultiply(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn);
+
+// r = a * a (r has 2*an digits and does not overlap a)
+void MultiwordSquare(uint32_t* r, const uint32_t* a, int an);
+
 //
 // Math terms
 // addition: augend + addend
@@ -0,0 +1,465 @@
+// ======================================================================================
+// NumBatch.cpp
+//
+// Batched element-wise arithmetic
+//
+// Every kernel walks the rows (digits) in the inner loop and the elements in the
+// outer loop, a vector of elements at a time. Each lane is an independent number, so
+// a carry or borrow is a vector of 0/1 lanes that moves up to the next row. Vector
+// ISAs have no carry flag per lane, so the carry out of an add is recovered from the
+// top bits of the inputs and the sum:
+//
+//   s = x + y + c         carry = ((x & y) | ((x | y) & ~s)) >> 31
+//   d = x - y - b         borrow = ((~x & y) | (~(x ^ y) & d)) >> 31
+//
+// Multiplies widen each digit to a 64-bit lane and run the schoolbook product per
+// lane, with the same row-at-a-time carry as Num's multiply. The whole partial
+// product stays in registers for the sizes a NumBatch is meant for.
+//
+// Each kernel comes in AVX-512, AVX2 and plain loop versions, and the one for the
+// running CPU is picked at run time (see CpuFeatures.h).
+// ======================================================================================
+
+#include "NumBatch.h"
+#include "../compat/CpuFeatures.h"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+// ======================================================================================
+// Construction, gather and scatter
+// ======================================================================================
+
+NumBatch::NumBatch(int limbs, int count) : nlimbs(limbs), count(count)
+{
+    assert(limbs > 0 && limbs <= kMaxLimbs);
+    assert(count >= 0);
+    stride = (count + kBatchLanes - 1) / kBatchLanes * kBatchLanes;
+    data.assign(size_t(limbs) * stride, 0);
+}
+
+void NumBatch::set(int j, const Num& n)
+{
+    assert(j >= 0 && j < count);
+    const uint32_t* d = n.cdatabuffer();
+    int len = n.data.length();
+
+    // Two's complement of a negative value is ~(|n| - 1), which we get digit by
+    // digit by propagating a borrow
+    uint32_t borrow = n.data.sign ? 1 : 0;
+    uint32_t invert = n.data.sign ? 0xFFFF'FFFF : 0;
+    for (int i = 0; i < nlimbs; i++)
+    {
+        uint32_t digit = i < len ? d[i] : 0;
+        uint32_t v = digit - borrow;
+        borrow = digit < borrow ? 1 : 0;
+        row(i)[j] = v ^ invert;
+    }
+}
+
+Num NumBatch::get(int j) const
+{
+    assert(j >= 0 && j < count);
+    Num n;
+    uint32_t* d = n.resize(nlimbs);
+    for (int i = 0; i < nlimbs; i++)
+        d[i] = row(i)[j];
+    n.trim();
+    return n;
+}
+
+void NumBatch::gather(const Num* nums)
+{
+    for (int j = 0; j < count; j++)
+        set(j, nums[j]);
+}
+
+void NumBatch::scatter(Num* nums) const
+{
+    for (int j = 0; j < count; j++)
+        nums[j] = get(j);
+}
+
+// ======================================================================================
+// Add and subtract
+// ======================================================================================
+
+// Without vector intrinsics, a block of lanes at a time still lets the compiler
+// vectorize the inner loop
+static void add_scalar(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    int limbs = r.nlimbs;
+    for (int j = 0; j < r.stride; j += NumBatch::kBatchLanes)
+    {
+        uint32_t carry[NumBatch::kBatchLanes] = {};
+        for (int i = 0; i < limbs; i++)
+        {
+            const uint32_t* x = a.row(i) + j;
+            const uint32_t* y = b.row(i) + j;
+            uint32_t* s = r.row(i) + j;
+            for (int k = 0; k < NumBatch::kBatchLanes; k++)
+            {
+                uint64_t t = uint64_t(x[k]) + y[k] + carry[k];
+                s[k] = uint32_t(t);
+                carry[k] = uint32_t(t >> 32);
+            }
+        }
+    }
+}
+
+static void sub_scalar(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    int limbs = r.nlimbs;
+    for (int j = 0; j < r.stride; j += NumBatch::kBatchLanes)
+    {
+        uint32_t borrow[NumBatch::kBatchLanes] = {};
+        for (int i = 0; i < limbs; i++)
+        {
+            const uint32_t* x = a.row(i) + j;
+            const uint32_t* y = b.row(i) + j;
+            uint32_t* d = r.row(i) + j;
+            for (int k = 0; k < NumBatch::kBatchLanes; k++)
+            {
+                uint64_t t = uint64_t(x[k]) - y[k] - borrow[k];
+                d[k] = uint32_t(t);
+                borrow[k] = uint32_t(t >> 63);
+            }
+        }
+    }
+}
+
+#if defined(CPU_X86)
+
+// The rows are padded to kBatchLanes, a whole number of vectors, so there is no tail
+
+CPU_TARGET("avx2")
+static void add_avx2(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    int limbs = r.nlimbs;
+    for (int j = 0; j < r.stride; j += 8)
+    {
+        __m256i carry = _mm256_setzero_si256();
+        for (int i = 0; i < limbs; i++)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i*) (a.row(i) + j));
+            __m256i y = _mm256_loadu_si256((const __m256i*) (b.row(i) + j));
+            __m256i s = _mm256_add_epi32(_mm256_add_epi32(x, y), carry);
+            __m256i c = _mm256_or_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(s, _mm256_or_si256(x, y)));
+            carry = _mm256_srli_epi32(c, 31);
+            _mm256_storeu_si256((__m256i*) (r.row(i) + j), s);
+        }
+    }
+}
+
+CPU_TARGET("avx2")
+static void sub_avx2(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    int limbs = r.nlimbs;
+    for (int j = 0; j < r.stride; j += 8)
+    {
+        __m256i borrow = _mm256_setzero_si256();
+        for (int i = 0; i < limbs; i++)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i*) (a.row(i) + j));
+            __m256i y = _mm256_loadu_si256((const __m256i*) (b.row(i) + j));
+            __m256i d = _mm256_sub_epi32(_mm256_sub_epi32(x, y), borrow);
+            __m256i c = _mm256_or_si256(_mm256_andnot_si256(x, y), _mm256_andnot_si256(_mm256_xor_si256(x, y), d));
+            borrow = _mm256_srli_epi32(c, 31);
+            _mm256_storeu_si256((__m256i*) (r.row(i) + j), d);
+        }
+    }
+}
+
+CPU_AVX512_BEGIN
+
+CPU_TARGET("avx512f")
+static void add_avx512(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    int limbs = r.nlimbs;
+    for (int j = 0; j < r.stride; j += 16)
+    {
+        __m512i carry = _mm512_setzero_si512();
+        for (int i = 0; i < limbs; i++)
+        {
+            __m512i x = _mm512_loadu_si512(a.row(i) + j);
+            __m512i y = _mm512_loadu_si512(b.row(i) + j);
+            __m512i s = _mm512_add_epi32(_mm512_add_epi32(x, y), carry);
+            __m512i c = _mm512_or_si512(_mm512_and_si512(x, y), _mm512_andnot_si512(s, _mm512_or_si512(x, y)));
+            carry = _mm512_srli_epi32(c, 31);
+            _mm512_storeu_si512(r.row(i) + j, s);
+        }
+    }
+}
+
+CPU_TARGET("avx512f")
+static void sub_avx512(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    int limbs = r.nlimbs;
+    for (int j = 0; j < r.stride; j += 16)
+    {
+        __m512i borrow = _mm512_setzero_si512();
+        for (int i = 0; i < limbs; i++)
+        {
+            __m512i x = _mm512_loadu_si512(a.row(i) + j);
+            __m512i y = _mm512_loadu_si512(b.row(i) + j);
+            __m512i d = _mm512_sub_epi32(_mm512_sub_epi32(x, y), borrow);
+            __m512i c = _mm512_or_si512(_mm512_andnot_si512(x, y), _mm512_andnot_si512(_mm512_xor_si512(x, y), d));
+            borrow = _mm512_srli_epi32(c, 31);
+            _mm512_storeu_si512(r.row(i) + j, d);
+        }
+    }
+}
+
+CPU_AVX512_END
+
+#endif
+
+// ======================================================================================
+// Multiply
+// ======================================================================================
+
+// The digits of a, b and r each kernel works on
+struct MulShape
+{
+    int rl, al, bl;
+    MulShape(const NumBatch& r, const NumBatch& a, const NumBatch& b)
+        : rl(r.nlimbs), al(a.nlimbs < rl ? a.nlimbs : rl), bl(b.nlimbs < rl ? b.nlimbs : rl) {}
+};
+
+static void mul_scalar(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    MulShape s(r, a, b);
+    for (int j = 0; j < r.count; j++)
+    {
+        uint32_t acc[NumBatch::kMaxLimbs] = {};
+        for (int jb = 0; jb < s.bl; jb++)
+        {
+            uint64_t y = b.row(jb)[j];
+            uint64_t carry = 0;
+            int n = s.al < s.rl - jb ? s.al : s.rl - jb;
+            for (int i = 0; i < n; i++)
+            {
+                carry = carry + acc[i + jb] + a.row(i)[j] * y;
+                acc[i + jb] = uint32_t(carry);
+                carry >>= 32;
+            }
+            if (jb + n < s.rl)
+                acc[jb + n] = uint32_t(carry);
+        }
+        for (int k = 0; k < s.rl; k++)
+            r.row(k)[j] = acc[k];
+    }
+}
+
+#if defined(CPU_X86)
+
+CPU_TARGET("avx2")
+static void mul_avx2(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    MulShape s(r, a, b);
+    const __m256i mask = _mm256_set1_epi64x(0xFFFF'FFFF);
+    const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    for (int j = 0; j < r.stride; j += 4)
+    {
+        __m256i av[NumBatch::kMaxLimbs];
+        __m256i acc[NumBatch::kMaxLimbs];
+        for (int i = 0; i < s.al; i++)
+            av[i] = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*) (a.row(i) + j)));
+        for (int k = 0; k < s.rl; k++)
+            acc[k] = _mm256_setzero_si256();
+
+        for (int jb = 0; jb < s.bl; jb++)
+        {
+            __m256i y = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*) (b.row(jb) + j)));
+            __m256i carry = _mm256_setzero_si256();
+            int n = s.al < s.rl - jb ? s.al : s.rl - jb;
+            for (int i = 0; i < n; i++)
+            {
+                __m256i t = _mm256_add_epi64(_mm256_add_epi64(acc[i + jb], carry), _mm256_mul_epu32(av[i], y));
+                acc[i + jb] = _mm256_and_si256(t, mask);
+                carry = _mm256_srli_epi64(t, 32);
+            }
+            if (jb + n < s.rl)
+                acc[jb + n] = carry;
+        }
+
+        // Each 64-bit lane holds a digit in its low half; pack them down to four digits
+        for (int k = 0; k < s.rl; k++)
+        {
+            __m256i packed = _mm256_permutevar8x32_epi32(acc[k], evens);
+            _mm_storeu_si128((__m128i*) (r.row(k) + j), _mm256_castsi256_si128(packed));
+        }
+    }
+}
+
+CPU_AVX512_BEGIN
+
+CPU_TARGET("avx512f")
+static void mul_avx512(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    MulShape s(r, a, b);
+    const __m512i mask = _mm512_set1_epi64(0xFFFF'FFFF);
+    for (int j = 0; j < r.stride; j += 8)
+    {
+        __m512i av[NumBatch::kMaxLimbs];
+        __m512i acc[NumBatch::kMaxLimbs];
+        for (int i = 0; i < s.al; i++)
+            av[i] = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*) (a.row(i) + j)));
+        for (int k = 0; k < s.rl; k++)
+            acc[k] = _mm512_setzero_si512();
+
+        for (int jb = 0; jb < s.bl; jb++)
+        {
+            __m512i y = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*) (b.row(jb) + j)));
+            __m512i carry = _mm512_setzero_si512();
+            int n = s.al < s.rl - jb ? s.al : s.rl - jb;
+            for (int i = 0; i < n; i++)
+            {
+                __m512i t = _mm512_add_epi64(_mm512_add_epi64(acc[i + jb], carry), _mm512_mul_epu32(av[i], y));
+                acc[i + jb] = _mm512_and_si512(t, mask);
+                carry = _mm512_srli_epi64(t, 32);
+            }
+            if (jb + n < s.rl)
+                acc[jb + n] = carry;
+        }
+
+        for (int k = 0; k < s.rl; k++)
+            _mm256_storeu_si256((__m256i*) (r.row(k) + j), _mm512_cvtepi64_epi32(acc[k]));
+    }
+}
+
+CPU_AVX512_END
+
+#endif
+
+// ======================================================================================
+// Compare
+// ======================================================================================
+
+// Work down from the top digit; the first digit that differs decides each lane.
+static void compare_from(int8_t* out, const NumBatch& a, const NumBatch& b, int j)
+{
+    for (; j < a.count; j++)
+    {
+        int c = 0;
+        for (int i = a.nlimbs - 1; i >= 0 && c == 0; i--)
+            if (a.row(i)[j] != b.row(i)[j])
+                c = a.row(i)[j] < b.row(i)[j] ? -1 : 1;
+        out[j] = int8_t(c);
+    }
+}
+
+static void compare_scalar(int8_t* out, const NumBatch& a, const NumBatch& b)
+{
+    compare_from(out, a, b, 0);
+}
+
+#if defined(CPU_X86)
+
+// There are no unsigned compares before AVX-512, so AVX2 flips the top bits and
+// compares signed
+CPU_TARGET("avx2")
+static void compare_avx2(int8_t* out, const NumBatch& a, const NumBatch& b)
+{
+    const __m256i flip = _mm256_set1_epi32(int(0x8000'0000));
+    int j = 0;
+    for (; j + 8 <= a.count; j += 8)
+    {
+        __m256i result = _mm256_setzero_si256();
+        for (int i = a.nlimbs - 1; i >= 0; i--)
+        {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (a.row(i) + j)), flip);
+            __m256i y = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (b.row(i) + j)), flip);
+            __m256i gt = _mm256_cmpgt_epi32(x, y);
+            __m256i lt = _mm256_cmpgt_epi32(y, x);
+            __m256i diff = _mm256_or_si256(_mm256_srli_epi32(gt, 31), lt); // 1, -1 or 0
+            __m256i open = _mm256_cmpeq_epi32(result, _mm256_setzero_si256());
+            result = _mm256_or_si256(result, _mm256_and_si256(open, diff));
+        }
+        alignas(32) int32_t lanes[8];
+        _mm256_store_si256((__m256i*) lanes, result);
+        for (int k = 0; k < 8; k++)
+            out[j + k] = int8_t(lanes[k]);
+    }
+    compare_from(out, a, b, j);
+}
+
+CPU_TARGET("avx512f")
+static void compare_avx512(int8_t* out, const NumBatch& a, const NumBatch& b)
+{
+    int j = 0;
+    for (; j + 16 <= a.count; j += 16)
+    {
+        __mmask16 gt = 0, lt = 0;
+        for (int i = a.nlimbs - 1; i >= 0; i--)
+        {
+            __m512i x = _mm512_loadu_si512(a.row(i) + j);
+            __m512i y = _mm512_loadu_si512(b.row(i) + j);
+            __mmask16 open = __mmask16(~(gt | lt));
+            gt |= _mm512_mask_cmpgt_epu32_mask(open, x, y);
+            lt |= _mm512_mask_cmplt_epu32_mask(open, x, y);
+        }
+        for (int k = 0; k < 16; k++)
+            out[j + k] = int8_t(((gt >> k) & 1) - ((lt >> k) & 1));
+    }
+    compare_from(out, a, b, j);
+}
+
+#endif
+
+// ======================================================================================
+// Dispatch
+// ======================================================================================
+
+struct BatchKernels
+{
+    void (*add)(NumBatch& r, const NumBatch& a, const NumBatch& b);
+    void (*sub)(NumBatch& r, const NumBatch& a, const NumBatch& b);
+    void (*mul)(NumBatch& r, const NumBatch& a, const NumBatch& b);
+    void (*compare)(int8_t* out, const NumBatch& a, const NumBatch& b);
+};
+
+// Indexed by CpuLevel
+static const BatchKernels batch_kernels[] = {
+    { add_scalar, sub_scalar, mul_scalar, compare_scalar },
+    #if defined(CPU_X86)
+    { add_avx2, sub_avx2, mul_avx2, compare_avx2 },
+    { add_avx512, sub_avx512, mul_avx512, compare_avx512 },
+    #endif
+};
+
+static const BatchKernels& kernels()
+{
+    return batch_kernels[int(cpu_level())];
+}
+
+void add(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    assert(r.nlimbs == a.nlimbs && r.nlimbs == b.nlimbs);
+    assert(r.count == a.count && r.count == b.count);
+    kernels().add(r, a, b);
+}
+
+void sub(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    assert(r.nlimbs == a.nlimbs && r.nlimbs == b.nlimbs);
+    assert(r.count == a.count && r.count == b.count);
+    kernels().sub(r, a, b);
+}
+
+void mul(NumBatch& r, const NumBatch& a, const NumBatch& b)
+{
+    assert(r.count == a.count && r.count == b.count);
+    assert(&r != &a && &r != &b);
+    kernels().mul(r, a, b);
+}
+
+void compare(int8_t* out, const NumBatch& a, const NumBatch& b)
+{
+    assert(a.nlimbs == b.nlimbs && a.count == b.count);
+    kernels().compare(out, a, b);
+}
@@ -0,0 +1,67 @@
+// ======================================================================================
+// NumBatch.h
+// - many small fixed-width numbers in structure-of-arrays form
+//
+// A NumBatch holds count unsigned numbers of limbs digits each, for code that does
+// the same arithmetic on thousands of independent small values. Digit i of every
+// element is stored contiguously (row i), so the batch operations run down the rows
+// a vector register of elements at a time, with each lane carrying its own carry.
+//
+// Like FixedNum, values wrap modulo 2^(32 * limbs), and negative Nums are stored in
+// two's complement. Rows are padded to a multiple of kBatchLanes elements so that
+// the vector loops never need a scalar tail.
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+
+#include <cstdint>
+#include <vector>
+
+class NumBatch
+{
+public:
+    // Elements per vector step (sixteen 32-bit lanes is one AVX-512 register)
+    static constexpr int kBatchLanes = 16;
+
+    // The largest number of digits per element
+    static constexpr int kMaxLimbs = 32;
+
+    // A batch of count zeros
+    NumBatch(int limbs, int count);
+
+    int limbs() const { return nlimbs; }
+    int size() const { return count; }
+
+    // Row i: digit i of every element
+    uint32_t* row(int i) { return data.data() + size_t(i) * stride; }
+    const uint32_t* row(int i) const { return data.data() + size_t(i) * stride; }
+
+    // Move single elements in and out
+    void set(int j, const Num& n);
+    Num get(int j) const;
+
+    // Move size() elements in from nums, or out to nums
+    void gather(const Num* nums);
+    void scatter(Num* nums) const;
+
+    int nlimbs;
+    int count;
+    int stride; // count rounded up to kBatchLanes
+    std::vector<uint32_t> data;
+};
+
+// Element-wise r = a + b and r = a - b. All three batches have the same shape, and r
+// may be a or b.
+void add(NumBatch& r, const NumBatch& a, const NumBatch& b);
+void sub(NumBatch& r, const NumBatch& a, const NumBatch& b);
+
+// Element-wise r = a * b, keeping the low r.limbs() digits of each product (so r with
+// a.limbs() + b.limbs() digits gets the full product). The batches have the same
+// size, and r must not be a or b.
+void mul(NumBatch& r, const NumBatch& a, const NumBatch& b);
+
+// Element-wise comparison: out[j] is -1, 0 or 1 as a[j] is less than, equal to or
+// greater than b[j]. a and b have the same shape.
+void compare(int8_t* out, const NumBatch& a, const NumBatch& b);
@@ -29,7 +29,7 @@ NumBuffer::~NumBuffer() noexcept
     // If there was allocated data, free it and zero out pointer (will force crash
     // if object referenced after destruction)
     if (nonlocal)
-        delete[] big.digits;
+        num_free_digits(big.digits);
 
     nonlocal = 1;
     big.digits = nullptr;
@@ -40,6 +40,8 @@ NumBuffer::~NumBuffer() noexcept
 //   to hold the rhs.
 NumBuffer::NumBuffer(const NumBuffer& rhs) noexcept
 {
+    NUM_COUNT(copies, 1);
+
     // Copy the prefix: local + size + len
     nonlocal = rhs.nonlocal;
     sign = rhs.sign;
@@ -64,7 +66,7 @@ NumBuffer::NumBuffer(const NumBuffer& rhs) noexcept
     else
     {
         big.bufsize = len;
-        big.digits = new uint32_t[big.bufsize];
+        big.digits = num_alloc_digits(big.bufsize);
         copy_digits(big.digits, rhs.big.digits, len);
     }
 }
@@ -75,6 +77,8 @@ NumBuffer::NumBuffer(const NumBuffer& rhs) noexcept
 //   invalid one.
 NumBuffer::NumBuffer(NumBuffer&& rhs) noexcept
 {
+    NUM_COUNT(moves, 1);
+
     // move data
     move_(rhs);
 }
@@ -91,6 +95,8 @@ NumBuffer& NumBuffer::operator=(const NumBuffer& rhs) noexcept
     if (this == &rhs)
         return *this; // do we REALLY need to be paranoid like this? I mean, really...
 
+    NUM_COUNT(copies, 1);
+
     // This differs from construction in that we will keep an overlarge buffer;
     // this is one of the two cases where an allocated buffer can hold data less
     // than smallbufsize in length (the other is from math operators that produce
@@ -104,7 +110,7 @@ NumBuffer& NumBuffer::operator=(const NumBuffer& rhs) noexcept
         // allocate more.
         if (nonlocal)
         {
-            delete[] big.digits;
+            num_free_digits(big.digits);
             nonlocal = 0; // temporarily a small Num
         }
 
@@ -113,7 +119,7 @@ NumBuffer& NumBuffer::operator=(const NumBuffer& rhs) noexcept
         {
             nonlocal = 1;
             big.bufsize = rhs.len;
-            big.digits = new uint32_t[big.bufsize];
+            big.digits = num_alloc_digits(big.bufsize);
         }
     }
 
@@ -136,9 +142,11 @@ NumBuffer& NumBuffer::operator=(NumBuffer&& rhs) noexcept
     if (this == &rhs)
         return *this; // do we REALLY need to be paranoid like this? I mean, really...
 
+    NUM_COUNT(moves, 1);
+
     // Destroy any existing buffer
     if (nonlocal)
-        delete[] big.digits;
+        num_free_digits(big.digits);
 
     // move data
     move_(rhs);
@@ -187,14 +195,14 @@ uint32_t* NumBuffer::reserve(int size)
         return digits();
 
     // Allocate new buffer
-    uint32_t* newdigits = new uint32_t[size];
+    uint32_t* newdigits = num_alloc_digits(size);
 
     // Copy existing data into it
     copy_digits(newdigits, digits(), len);
 
     // If there is an existing buffer, release it
     if (nonlocal)
-        delete[] big.digits;
+        num_free_digits(big.digits);
 
     nonlocal = 1;
     big.bufsize = size;
@@ -228,11 +236,11 @@ uint32_t* NumBuffer::resize(int size)
                 newsize = newsize * 3 / 2;
 
             // Copy existing information and replace with our upsized buffer
-            uint32_t* newdigits = new uint32_t[newsize];
+            uint32_t* newdigits = num_alloc_digits(newsize);
             copy_digits(newdigits, digits(), len);
 
             if (nonlocal)
-                delete[] big.digits;
+                num_free_digits(big.digits);
 
             big.digits = newdigits;
             big.bufsize = newsize;
@@ -0,0 +1,55 @@
+// ======================================================================================
+// NumCounters.cpp
+// ======================================================================================
+
+#include "NumCounters.h"
+
+#include <cassert>
+
+#if NUM_COUNTERS
+thread_local NumCounters num_thread_counters;
+#endif
+
+const char* num_op_name(NumOp op)
+{
+    static const char* const names[] = { "add", "sub", "mul", "div", "shift", "bitwise", "compare" };
+    static_assert(sizeof(names) / sizeof(names[0]) == int(NumOp::Count), "a NumOp without a name");
+    return names[int(op)];
+}
+
+NumCounters operator-(const NumCounters& after, const NumCounters& before)
+{
+    NumCounters d;
+    d.allocations = after.allocations - before.allocations;
+    d.frees = after.frees - before.frees;
+    d.bytes_allocated = after.bytes_allocated - before.bytes_allocated;
+    d.copies = after.copies - before.copies;
+    d.moves = after.moves - before.moves;
+    for (int i = 0; i < int(NumOp::Count); i++)
+    {
+        d.calls[i] = after.calls[i] - before.calls[i];
+        d.limbs[i] = after.limbs[i] - before.limbs[i];
+    }
+    return d;
+}
+
+NumCounters num_counters()
+{
+    #if NUM_COUNTERS
+    return num_thread_counters;
+    #else
+    return NumCounters();
+    #endif
+}
+
+void reset_num_counters()
+{
+    #if NUM_COUNTERS
+    num_thread_counters = NumCounters();
+    #endif
+}
+
+NumAllocationGuard::~NumAllocationGuard()
+{
+    assert((!expect_zero || allocations() == 0) && "allocation in a scope that expects none");
+}
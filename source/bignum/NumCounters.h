@@ -0,0 +1,99 @@
+// ======================================================================================
+// NumCounters.h
+// - optional counters of allocations, copies and work done by Num
+//
+// Built with NUM_COUNTERS defined to 1, NumBuffer counts its allocations, frees and
+// bytes allocated, its copies and its moves, and the Num operators count their calls
+// and the limbs of their operands, by kind of operation. Every digit array the
+// library allocates goes through num_alloc_digits, so a scope that is expected not to
+// allocate can check that it didn't.
+//
+// Without NUM_COUNTERS the counting compiles to nothing, and the counters read zero.
+//
+// The counters are per thread, so a scope counts its own work even while other
+// threads do arithmetic.
+// ======================================================================================
+
+#pragma once
+
+#include <cstdint>
+
+#if !defined(NUM_COUNTERS)
+#define NUM_COUNTERS 0
+#endif
+
+enum class NumOp
+{
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Shift,
+    Bitwise,
+    Compare,
+    Count
+};
+
+const char* num_op_name(NumOp op);
+
+struct NumCounters
+{
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes_allocated = 0;
+    uint64_t copies = 0; // copy construction and copy assignment of a NumBuffer
+    uint64_t moves = 0;  // move construction and move assignment of a NumBuffer
+
+    uint64_t calls[int(NumOp::Count)] = {};
+    uint64_t limbs[int(NumOp::Count)] = {}; // digits in the operands of those calls
+};
+
+// The difference between two readings
+NumCounters operator-(const NumCounters& after, const NumCounters& before);
+
+// This thread's counters
+NumCounters num_counters();
+void reset_num_counters();
+
+#if NUM_COUNTERS
+extern thread_local NumCounters num_thread_counters;
+#define NUM_COUNT(field, n) (void) (num_thread_counters.field += uint64_t(n))
+#define NUM_COUNT_OP(op, n) (void) (num_thread_counters.calls[int(op)] += 1, num_thread_counters.limbs[int(op)] += uint64_t(n))
+#else
+#define NUM_COUNT(field, n) ((void) 0)
+#define NUM_COUNT_OP(op, n) ((void) 0)
+#endif
+
+// Digit arrays, counted
+inline uint32_t* num_alloc_digits(int n)
+{
+    NUM_COUNT(allocations, 1);
+    NUM_COUNT(bytes_allocated, uint64_t(n) * sizeof(uint32_t));
+    return new uint32_t[n];
+}
+
+inline void num_free_digits(uint32_t* p)
+{
+    if (p)
+        NUM_COUNT(frees, 1);
+    delete[] p;
+}
+
+// Counts what this thread does while it is alive. If it is made with expect_zero, the
+// destructor asserts that nothing was allocated.
+class NumAllocationGuard
+{
+public:
+    explicit NumAllocationGuard(bool expect_zero = true) : expect_zero(expect_zero), start(num_counters()) {}
+    ~NumAllocationGuard();
+
+    NumAllocationGuard(const NumAllocationGuard&) = delete;
+    NumAllocationGuard& operator=(const NumAllocationGuard&) = delete;
+
+    uint64_t allocations() const { return counted().allocations; }
+    NumCounters counted() const { return num_counters() - start; }
+
+private:
+    bool expect_zero;
+    NumCounters start;
+};
@@ -0,0 +1,258 @@
+// ======================================================================================
+// NumPoly.cpp
+//
+// For a product of polynomials with n and m coefficients, coefficient k of the product
+// is a sum of at most min(n, m) products a_i * b_j, so if |a_i| < 2^A and |b_j| < 2^B
+// its magnitude is below 2^(A + B + L), where 2^L >= min(n, m). A slot of w =
+// A + B + L + 1 bits holds it with room for the sign.
+//
+// A polynomial is packed by ORing the magnitude of each coefficient into its slot,
+// with the positive and negative coefficients in separate buffers, so that the packed
+// value is one subtraction of the two. Unpacking reads slot k as a w-bit field f, plus
+// the borrow c from slot k-1. If the top bit of f is clear, the coefficient is f + c;
+// if it is set, the coefficient is f + c - 2^w, and slot k+1 gets a borrow. Since every
+// coefficient is below 2^(w-1) in magnitude, the top bit of f tells which case it is.
+// ======================================================================================
+
+#include "NumPoly.h"
+#include "Intrinsics.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// A packed slot is about twice as wide as the coefficients, so with the schoolbook
+// multiply() the packed product does four times the digit products of the
+// coefficient loop, and only wins while the loop's per-call overhead costs more than
+// that. Measured, that holds up to about 192-bit coefficients on both sides.
+int poly_kronecker_bits = 384;
+
+// dst |= src << bitpos, where the bits land on zeros
+static void deposit(uint32_t* dst, int64_t bitpos, const uint32_t* src, int len)
+{
+    uint32_t* d = dst + bitpos / 32;
+    int s = int(bitpos % 32);
+    if (s == 0)
+    {
+        for (int i = 0; i < len; i++)
+            d[i] |= src[i];
+        return;
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        d[i] |= src[i] << s;
+        d[i + 1] |= src[i] >> (32 - s);
+    }
+}
+
+// dst[0, n) = bits [bitpos, bitpos + 32n) of src[0, len), with zeros past the end
+static void extract(uint32_t* dst, int n, const uint32_t* src, int len, int64_t bitpos)
+{
+    int64_t q = bitpos / 32;
+    int s = int(bitpos % 32);
+    for (int j = 0; j < n; j++)
+    {
+        int64_t i = q + j;
+        uint32_t lo = i < len ? src[i] : 0;
+        uint32_t hi = i + 1 < len ? src[i + 1] : 0;
+        dst[j] = s == 0 ? lo : (lo >> s) | (hi << (32 - s));
+    }
+}
+
+static void increment(uint32_t* d, int n)
+{
+    for (int i = 0; i < n && ++d[i] == 0; i++)
+        ;
+}
+
+// ======================================================================================
+// Kronecker substitution
+// ======================================================================================
+
+Num kronecker_pack(const NumPoly& p, int slot_bits)
+{
+    assert(slot_bits > 0);
+    Num r;
+    int n = int(p.coeffs.size());
+    if (n == 0)
+        return r;
+
+    // One digit more than the slots need, for the spill of the last deposit
+    int len = int((int64_t(n) * slot_bits + 31) / 32) + 1;
+    uint32_t* pos = r.resize(len);
+    memset(pos, 0, size_t(len) * sizeof(uint32_t));
+
+    // The negative coefficients, made only if there are any
+    Num neg;
+    uint32_t* negbuf = nullptr;
+
+    for (int i = 0; i < n; i++)
+    {
+        const Num& c = p.coeffs[i];
+        if (c.data.len == 0)
+            continue;
+        assert(c.bit_length() < slot_bits && "coefficient too big for its slot");
+
+        uint32_t* dst = pos;
+        if (c.data.sign != 0)
+        {
+            if (negbuf == nullptr)
+            {
+                negbuf = neg.resize(len);
+                memset(negbuf, 0, size_t(len) * sizeof(uint32_t));
+            }
+            dst = negbuf;
+        }
+        deposit(dst, int64_t(i) * slot_bits, c.cdatabuffer(), c.data.len);
+    }
+
+    r.trim();
+    if (negbuf != nullptr)
+    {
+        neg.trim();
+        r -= neg;
+    }
+    return r;
+}
+
+NumPoly kronecker_unpack(const NumView& v, int slot_bits, int count)
+{
+    assert(slot_bits > 0 && count >= 0);
+    int slot_digits = (slot_bits + 31) / 32;
+    uint32_t mask = slot_bits % 32 == 0 ? ~uint32_t(0) : (uint32_t(1) << (slot_bits % 32)) - 1;
+    uint32_t top_bit = uint32_t(1) << ((slot_bits - 1) % 32);
+
+    // Slots are read from the magnitude, and the signs flipped at the end if v < 0
+    NumPoly p;
+    p.coeffs.resize(size_t(count));
+    uint32_t borrow = 0;
+    for (int k = 0; k < count; k++)
+    {
+        Num& c = p.coeffs[k];
+        uint32_t* d = c.resize(slot_digits);
+        extract(d, slot_digits, v.digits, v.len, int64_t(k) * slot_bits);
+        d[slot_digits - 1] &= mask;
+
+        bool negative = (d[slot_digits - 1] & top_bit) != 0;
+        if (negative)
+        {
+            // |f + borrow - 2^w| = (2^w - 1 - f) + (1 - borrow), and f != 0
+            for (int j = 0; j < slot_digits; j++)
+                d[j] = ~d[j];
+            d[slot_digits - 1] &= mask;
+            if (borrow == 0)
+                increment(d, slot_digits);
+            borrow = 1;
+        }
+        else
+        {
+            // f < 2^(w-1), so this stays inside the slot
+            if (borrow != 0)
+                increment(d, slot_digits);
+            borrow = 0;
+        }
+
+        c.trim();
+        if (negative != (v.sign != 0))
+            c.negate();
+    }
+    assert(borrow == 0 && "value doesn't fit count slots");
+
+    p.trim();
+    return p;
+}
+
+// ======================================================================================
+// NumPoly
+// ======================================================================================
+
+int NumPoly::coefficient_bits() const
+{
+    int bits = 0;
+    for (const Num& c : coeffs)
+        bits = std::max(bits, c.bit_length());
+    return bits;
+}
+
+Num NumPoly::evaluate(const NumView& x) const
+{
+    Num r;
+    for (int i = degree(); i >= 0; i--)
+    {
+        r *= x;
+        r += coeffs[i];
+    }
+    return r;
+}
+
+void NumPoly::trim()
+{
+    while (!coeffs.empty() && coeffs.back().data.len == 0)
+        coeffs.pop_back();
+}
+
+NumPoly& NumPoly::operator+=(const NumPoly& rhs)
+{
+    if (coeffs.size() < rhs.coeffs.size())
+        coeffs.resize(rhs.coeffs.size());
+    for (size_t i = 0; i < rhs.coeffs.size(); i++)
+        coeffs[i] += rhs.coeffs[i];
+    trim();
+    return *this;
+}
+
+NumPoly& NumPoly::operator-=(const NumPoly& rhs)
+{
+    if (coeffs.size() < rhs.coeffs.size())
+        coeffs.resize(rhs.coeffs.size());
+    for (size_t i = 0; i < rhs.coeffs.size(); i++)
+        coeffs[i] -= rhs.coeffs[i];
+    trim();
+    return *this;
+}
+
+NumPoly& NumPoly::operator*=(const NumPoly& rhs)
+{
+    *this = *this * rhs;
+    return *this;
+}
+
+// Both packed at the slot width the product needs, one multiply, and the product's
+// coefficients unpacked. A polynomial times itself packs once and squares.
+NumPoly operator*(const NumPoly& lhs, const NumPoly& rhs)
+{
+    int n = int(lhs.coeffs.size());
+    int m = int(rhs.coeffs.size());
+    if (n == 0 || m == 0)
+        return NumPoly();
+
+    int lhs_bits = lhs.coefficient_bits();
+    int rhs_bits = rhs.coefficient_bits();
+    if (lhs_bits + rhs_bits > poly_kronecker_bits)
+        return multiply_schoolbook(lhs, rhs);
+
+    int w = lhs_bits + rhs_bits + 32 - clz32(uint32_t(std::min(n, m) - 1)) + 1;
+    Num a = kronecker_pack(lhs, w);
+    if (&lhs == &rhs)
+        return kronecker_unpack(multiply(a, a), w, n + m - 1);
+
+    Num b = kronecker_pack(rhs, w);
+    return kronecker_unpack(multiply(a, b), w, n + m - 1);
+}
+
+NumPoly multiply_schoolbook(const NumPoly& lhs, const NumPoly& rhs)
+{
+    int n = int(lhs.coeffs.size());
+    int m = int(rhs.coeffs.size());
+    if (n == 0 || m == 0)
+        return NumPoly();
+
+    NumPoly r;
+    r.coeffs.resize(size_t(n + m - 1));
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            r.coeffs[i + j] += lhs.coeffs[i] * rhs.coeffs[j];
+    r.trim();
+    return r;
+}
@@ -0,0 +1,80 @@
+// ======================================================================================
+// NumPoly.h
+// - polynomials with Num coefficients
+//
+// Multiplication is by Kronecker substitution: each polynomial is evaluated at x = 2^w
+// by laying its coefficients out in w-bit slots of one integer, the two integers are
+// multiplied, and the coefficients of the product are read back out of the w-bit slots
+// of the result. w is chosen so that every coefficient of the product fits its slot,
+// so no slot spills into the next and the product is exact.
+//
+// That turns n*m coefficient multiplies, each with its own allocation and call
+// overhead, into one multiply of numbers of about n*w and m*w bits, so the speed is
+// that of the integer multiplier (see poly_kronecker_bits for where that stops paying
+// with the schoolbook multiply). Packing and unpacking are shifts of the digits
+// straight into and out of the Num buffers, with no Num arithmetic per coefficient.
+//
+// Negative coefficients are handled with balanced digits: a slot holds c mod 2^w, and
+// a slot value with its top bit set stands for a negative coefficient that borrowed
+// one from the slot above.
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+
+#include <vector>
+
+class NumPoly
+{
+public:
+    // The zero polynomial
+    NumPoly() {}
+
+    // c[i] is the coefficient of x^i
+    explicit NumPoly(std::vector<Num> c) : coeffs(std::move(c)) { trim(); }
+
+    // -1 for the zero polynomial
+    int degree() const { return int(coeffs.size()) - 1; }
+
+    // The coefficient of x^i, which is zero past the degree
+    Num coefficient(int i) const { return i < int(coeffs.size()) ? coeffs[i] : Num(); }
+
+    // The largest bit length of a coefficient's magnitude
+    int coefficient_bits() const;
+
+    // Horner's rule
+    Num evaluate(const NumView& x) const;
+
+    // Drop zero leading coefficients
+    void trim();
+
+    NumPoly& operator+=(const NumPoly& rhs);
+    NumPoly& operator-=(const NumPoly& rhs);
+    NumPoly& operator*=(const NumPoly& rhs);
+
+    std::vector<Num> coeffs; // lowest degree first, with a non-zero last element
+};
+
+NumPoly operator*(const NumPoly& lhs, const NumPoly& rhs);
+
+// Products whose two largest coefficients have more bits than this between them are
+// done one coefficient pair at a time instead. The best value depends on how fast
+// multiply() is at the packed sizes.
+extern int poly_kronecker_bits;
+
+inline NumPoly operator+(NumPoly lhs, const NumPoly& rhs) { return lhs += rhs; }
+inline NumPoly operator-(NumPoly lhs, const NumPoly& rhs) { return lhs -= rhs; }
+
+inline bool operator==(const NumPoly& lhs, const NumPoly& rhs) { return lhs.coeffs == rhs.coeffs; }
+inline bool operator!=(const NumPoly& lhs, const NumPoly& rhs) { return lhs.coeffs != rhs.coeffs; }
+
+// The product one coefficient pair at a time, for checking and for comparison
+NumPoly multiply_schoolbook(const NumPoly& lhs, const NumPoly& rhs);
+
+// p(2^slot_bits), for coefficients of magnitude below 2^(slot_bits-1)
+Num kronecker_pack(const NumPoly& p, int slot_bits);
+
+// The polynomial of count coefficients with v = p(2^slot_bits), read back as balanced
+// slot_bits-bit digits. The coefficients must have magnitude below 2^(slot_bits-1).
+NumPoly kronecker_unpack(const NumView& v, int slot_bits, int count);
@@ -0,0 +1,304 @@
+// ======================================================================================
+// NumRandom.cpp
+//
+// Philox4x32-10 is ten rounds of
+//
+//   (c0, c1, c2, c3) = (hi(M1 * c2) ^ c1 ^ k0, lo(M1 * c2), hi(M0 * c0) ^ c3 ^ k1, lo(M0 * c0))
+//
+// over a 128-bit counter, with the key bumped by the Weyl constants W0, W1 between
+// rounds. The counter is (block index, stream), 64 bits each.
+//
+// Blocks are independent, so the vector kernels make one per 64-bit lane: each
+// counter word sits in the low half of a lane, where a 32x32->64 multiply (pmuludq)
+// gives hi and lo directly. The words of a block are spread over four registers, and
+// are packed and interleaved back into memory order at the end.
+//
+// Each kernel comes in AVX-512, AVX2 and plain loop versions, and the one for the
+// running CPU is picked at run time (see CpuFeatures.h). They give the same output.
+// ======================================================================================
+
+#include "NumRandom.h"
+#include "../compat/CpuFeatures.h"
+
+#include <cstring>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+// ======================================================================================
+// Xoshiro256
+// ======================================================================================
+
+static uint64_t splitmix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E37'79B9'7F4A'7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58'476D'1CE4'E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D0'49BB'1331'11EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+Xoshiro256::Xoshiro256(uint64_t seed)
+{
+    for (uint64_t& w : s)
+        w = splitmix64(seed);
+}
+
+uint64_t Xoshiro256::next()
+{
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+void Xoshiro256::fill(uint32_t* out, size_t n)
+{
+    if (n != 0 && has_pending)
+    {
+        *out++ = pending;
+        n--;
+        has_pending = false;
+    }
+
+    for (; n >= 2; n -= 2, out += 2)
+    {
+        uint64_t v = next();
+        out[0] = uint32_t(v);
+        out[1] = uint32_t(v >> 32);
+    }
+
+    if (n != 0)
+    {
+        uint64_t v = next();
+        out[0] = uint32_t(v);
+        pending = uint32_t(v >> 32);
+        has_pending = true;
+    }
+}
+
+void Xoshiro256::jump()
+{
+    static const uint64_t polynomial[] = {
+        0x180E'C6D3'3CFD'0ABAULL, 0xD5A6'1266'F0C9'392CULL, 0xA958'2618'E03F'C9AAULL, 0x39AB'DC45'29B1'661CULL
+    };
+
+    uint64_t t[4] = {};
+    for (uint64_t p : polynomial)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            if (p & (uint64_t(1) << b))
+                for (int i = 0; i < 4; i++)
+                    t[i] ^= s[i];
+            next();
+        }
+    }
+    memcpy(s, t, sizeof(s));
+    has_pending = false;
+}
+
+// ======================================================================================
+// Philox4x32 kernels
+// - blocks [index, index + count) of a stream, written to out in order
+// ======================================================================================
+
+static const uint32_t kPhiloxM0 = 0xD251'1F53;
+static const uint32_t kPhiloxM1 = 0xCD9E'8D57;
+static const uint32_t kPhiloxW0 = 0x9E37'79B9;
+static const uint32_t kPhiloxW1 = 0xBB67'AE85;
+static const int kPhiloxRounds = 10;
+
+static void philox_scalar(const uint32_t key[2], uint64_t index, uint64_t stream, uint32_t* out, size_t count)
+{
+    for (size_t j = 0; j < count; j++, out += 4)
+    {
+        uint64_t block = index + j;
+        uint32_t c0 = uint32_t(block), c1 = uint32_t(block >> 32);
+        uint32_t c2 = uint32_t(stream), c3 = uint32_t(stream >> 32);
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int r = 0; r < kPhiloxRounds; r++)
+        {
+            uint64_t p0 = uint64_t(kPhiloxM0) * c0;
+            uint64_t p1 = uint64_t(kPhiloxM1) * c2;
+            c0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+            c1 = uint32_t(p1);
+            c2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+            c3 = uint32_t(p0);
+            k0 += kPhiloxW0;
+            k1 += kPhiloxW1;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+}
+
+#if defined(CPU_X86)
+
+// Four blocks per step, one per 64-bit lane
+CPU_TARGET("avx2")
+static void philox_avx2(const uint32_t key[2], uint64_t index, uint64_t stream, uint32_t* out, size_t count)
+{
+    const __m256i low = _mm256_set1_epi64x(0xFFFF'FFFF);
+    const __m256i m0 = _mm256_set1_epi64x(kPhiloxM0);
+    const __m256i m1 = _mm256_set1_epi64x(kPhiloxM1);
+    const __m256i c2_start = _mm256_set1_epi64x(uint32_t(stream));
+    const __m256i c3_start = _mm256_set1_epi64x(uint32_t(stream >> 32));
+    __m256i blocks = _mm256_add_epi64(_mm256_set1_epi64x(int64_t(index)), _mm256_setr_epi64x(0, 1, 2, 3));
+
+    size_t j = 0;
+    for (; j + 4 <= count; j += 4, out += 16)
+    {
+        __m256i c0 = _mm256_and_si256(blocks, low);
+        __m256i c1 = _mm256_srli_epi64(blocks, 32);
+        __m256i c2 = c2_start;
+        __m256i c3 = c3_start;
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int r = 0; r < kPhiloxRounds; r++)
+        {
+            __m256i p0 = _mm256_mul_epu32(c0, m0);
+            __m256i p1 = _mm256_mul_epu32(c2, m1);
+            c0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p1, 32), c1), _mm256_set1_epi64x(k0));
+            c1 = _mm256_and_si256(p1, low);
+            c2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p0, 32), c3), _mm256_set1_epi64x(k1));
+            c3 = _mm256_and_si256(p0, low);
+            k0 += kPhiloxW0;
+            k1 += kPhiloxW1;
+        }
+
+        // Lane j of a is words 0-1 of block j, lane j of b is words 2-3
+        __m256i a = _mm256_or_si256(c0, _mm256_slli_epi64(c1, 32));
+        __m256i b = _mm256_or_si256(c2, _mm256_slli_epi64(c3, 32));
+        __m256i lo = _mm256_unpacklo_epi64(a, b); // blocks 0, 2
+        __m256i hi = _mm256_unpackhi_epi64(a, b); // blocks 1, 3
+        _mm256_storeu_si256((__m256i*) out, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*) (out + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+
+        blocks = _mm256_add_epi64(blocks, _mm256_set1_epi64x(4));
+    }
+    philox_scalar(key, index + j, stream, out, count - j);
+}
+
+CPU_AVX512_BEGIN
+
+// Eight blocks per step
+CPU_TARGET("avx512f")
+static void philox_avx512(const uint32_t key[2], uint64_t index, uint64_t stream, uint32_t* out, size_t count)
+{
+    const __m512i low = _mm512_set1_epi64(0xFFFF'FFFF);
+    const __m512i m0 = _mm512_set1_epi64(kPhiloxM0);
+    const __m512i m1 = _mm512_set1_epi64(kPhiloxM1);
+    const __m512i c2_start = _mm512_set1_epi64(uint32_t(stream));
+    const __m512i c3_start = _mm512_set1_epi64(uint32_t(stream >> 32));
+    const __m512i first = _mm512_setr_epi64(0, 8, 1, 9, 2, 10, 3, 11);
+    const __m512i second = _mm512_setr_epi64(4, 12, 5, 13, 6, 14, 7, 15);
+    __m512i blocks = _mm512_add_epi64(_mm512_set1_epi64(int64_t(index)), _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7));
+
+    size_t j = 0;
+    for (; j + 8 <= count; j += 8, out += 32)
+    {
+        __m512i c0 = _mm512_and_si512(blocks, low);
+        __m512i c1 = _mm512_srli_epi64(blocks, 32);
+        __m512i c2 = c2_start;
+        __m512i c3 = c3_start;
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int r = 0; r < kPhiloxRounds; r++)
+        {
+            __m512i p0 = _mm512_mul_epu32(c0, m0);
+            __m512i p1 = _mm512_mul_epu32(c2, m1);
+            c0 = _mm512_ternarylogic_epi64(_mm512_srli_epi64(p1, 32), c1, _mm512_set1_epi64(k0), 0x96);
+            c1 = _mm512_and_si512(p1, low);
+            c2 = _mm512_ternarylogic_epi64(_mm512_srli_epi64(p0, 32), c3, _mm512_set1_epi64(k1), 0x96);
+            c3 = _mm512_and_si512(p0, low);
+            k0 += kPhiloxW0;
+            k1 += kPhiloxW1;
+        }
+
+        __m512i a = _mm512_or_si512(c0, _mm512_slli_epi64(c1, 32));
+        __m512i b = _mm512_or_si512(c2, _mm512_slli_epi64(c3, 32));
+        _mm512_storeu_si512(out, _mm512_permutex2var_epi64(a, first, b));
+        _mm512_storeu_si512(out + 16, _mm512_permutex2var_epi64(a, second, b));
+
+        blocks = _mm512_add_epi64(blocks, _mm512_set1_epi64(8));
+    }
+    philox_avx2(key, index + j, stream, out, count - j);
+}
+
+CPU_AVX512_END
+
+#endif
+
+// Indexed by CpuLevel
+static void (*const philox_kernels[])(const uint32_t key[2], uint64_t index, uint64_t stream, uint32_t* out, size_t count) = {
+    philox_scalar,
+    #if defined(CPU_X86)
+    philox_avx2,
+    philox_avx512,
+    #endif
+};
+
+// ======================================================================================
+// Philox4x32
+// ======================================================================================
+
+Philox4x32::Philox4x32(uint64_t seed, uint64_t stream) : stream(stream)
+{
+    key[0] = uint32_t(seed);
+    key[1] = uint32_t(seed >> 32);
+}
+
+void Philox4x32::block(const uint32_t key[2], uint64_t index, uint64_t stream, uint32_t out[4])
+{
+    philox_scalar(key, index, stream, out, 1);
+}
+
+void Philox4x32::fill(uint32_t* out, size_t n)
+{
+    // What's left of the last block
+    while (n != 0 && used < 4)
+    {
+        *out++ = buf[used++];
+        n--;
+    }
+
+    // Whole blocks go straight to out
+    size_t count = n / 4;
+    if (count != 0)
+    {
+        philox_kernels[int(cpu_level())](key, next_block, stream, out, count);
+        next_block += count;
+        out += 4 * count;
+        n -= 4 * count;
+    }
+
+    // And the start of one more
+    if (n != 0)
+    {
+        block(key, next_block++, stream, buf);
+        memcpy(out, buf, n * sizeof(uint32_t));
+        used = int(n);
+    }
+}
+
+void Philox4x32::seek(uint64_t position)
+{
+    next_block = position / 4;
+    used = 4;
+    if (position % 4 != 0)
+    {
+        block(key, next_block++, stream, buf);
+        used = int(position % 4);
+    }
+}
@@ -0,0 +1,141 @@
+// ======================================================================================
+// NumRandom.h
+// - uniform random Nums, filled straight from a fast generator
+//
+// random_bits and random_below write the generator's output directly into the digits
+// of the result, so making a random number costs about as much as writing it.
+//
+// Two generators are provided, both reproducible from a 64-bit seed:
+//
+//   Xoshiro256   xoshiro256** (Blackman and Vigna). A small sequential generator;
+//                jump() advances it 2^128 steps, which splits it into streams.
+//   Philox4x32   Philox4x32-10 (Salmon et al, "Parallel random numbers: as easy as
+//                1, 2, 3"). Counter-based: block i of stream s is a function of
+//                (seed, s, i) alone, so threads can each take a stream, or a range
+//                of one stream, and the result doesn't depend on how the work was
+//                split. Blocks are made several at a time in vector registers.
+//
+// Any class with a fill(uint32_t* out, size_t n) member can be passed as the rng.
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+#include "Digits.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+// ======================================================================================
+// Xoshiro256
+
+class Xoshiro256
+{
+public:
+    // The state is seeded from splitmix64, as the authors recommend
+    explicit Xoshiro256(uint64_t seed);
+    Xoshiro256(uint64_t s0, uint64_t s1, uint64_t s2, uint64_t s3) : s{ s0, s1, s2, s3 } {}
+
+    uint64_t next();
+
+    // n words, the low half of each 64-bit output first
+    void fill(uint32_t* out, size_t n);
+
+    // Advance by 2^128 outputs; calling this k times gives the start of stream k
+    void jump();
+
+private:
+    uint64_t s[4];
+    uint32_t pending = 0; // high half of the last output, when has_pending
+    bool has_pending = false;
+};
+
+// ======================================================================================
+// Philox4x32
+
+class Philox4x32
+{
+public:
+    explicit Philox4x32(uint64_t seed, uint64_t stream = 0);
+
+    // The next n words of the stream
+    void fill(uint32_t* out, size_t n);
+
+    // Move to word position of the stream (4 words per block)
+    void seek(uint64_t position);
+
+    // Block index of the stream, written as 4 words to out. This is the whole
+    // generator; everything else is bookkeeping.
+    static void block(const uint32_t key[2], uint64_t index, uint64_t stream, uint32_t out[4]);
+
+private:
+    uint32_t key[2];
+    uint64_t stream;
+    uint64_t next_block = 0; // the block after the one in buf
+    uint32_t buf[4];
+    int used = 4; // words of buf already handed out
+};
+
+// ======================================================================================
+// Random Nums
+
+// A uniform random number in [0, 2^bits)
+template <typename Rng>
+Num random_bits(int bits, Rng& rng)
+{
+    assert(bits >= 0);
+    Num r;
+    if (bits == 0)
+        return r;
+
+    int n = (bits + 31) / 32;
+    uint32_t* d = r.resize(n);
+    rng.fill(d, size_t(n));
+    if (bits % 32 != 0)
+        d[n - 1] &= (uint32_t(1) << (bits % 32)) - 1;
+    r.trim();
+    return r;
+}
+
+// A uniform random number in [0, bound), for bound > 0
+//
+// Candidates are drawn with as many bits as bound has and rejected when they are
+// too big, which happens less than half of the time. The top digit is drawn first,
+// and compared with the top digit of bound before the rest are drawn, so nearly every
+// rejection costs one word of generator output.
+template <typename Rng>
+Num random_below(const Num& bound, Rng& rng)
+{
+    assert(bound.data.sign == 0 && bound.data.len > 0);
+
+    int n = bound.data.len;
+    const uint32_t* b = bound.cdatabuffer();
+    uint32_t top = b[n - 1];
+
+    // All ones at and below the top bit of top
+    uint32_t mask = top;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+
+    Num r;
+    uint32_t* d = r.resize(n);
+    while (true)
+    {
+        uint32_t t;
+        rng.fill(&t, 1);
+        t &= mask;
+        if (t > top)
+            continue;
+
+        d[n - 1] = t;
+        rng.fill(d, size_t(n - 1));
+        if (t < top || cmp_digits(d, b, n - 1) < 0)
+            break;
+    }
+    r.trim();
+    return r;
+}
@@ -0,0 +1,194 @@
+// ======================================================================================
+// NumRns.cpp
+//
+// Residue number system
+//
+// Conversion into residues is a remainder tree over the basis. Conversion back uses
+// the Chinese remainder theorem in the form
+//
+//   x = sum (r_i * c_i mod p_i) * M/p_i  (mod M),   c_i = (M/p_i)^-1 mod p_i
+//
+// and sums it up the product tree instead of forming each M/p_i: a node's value is
+// left * (product of the right subtree) + right * (product of the left subtree).
+// That is a handful of multiplies of each size instead of n full-size ones.
+//
+// The c_i come from a remainder tree too. M mod p_i^2 is p_i * (M/p_i mod p_i), so a
+// remainder tree over the squares of the primes gives every M/p_i mod p_i at once.
+//
+// Each residue is independent of the others, so the arithmetic loops could be split
+// across threads by prime; a caller with many values can equally split by value.
+// ======================================================================================
+
+#include "NumRns.h"
+
+#include <cassert>
+
+// Inverse of a mod p, for a prime p that doesn't divide a (extended Euclid)
+static uint32_t inverse_mod(uint32_t a, uint32_t p)
+{
+    int64_t t = 0, newt = 1;
+    int64_t r = p, newr = a % p;
+    while (newr != 0)
+    {
+        int64_t q = r / newr;
+        int64_t tmp = t - q * newt; t = newt; newt = tmp;
+        tmp = r - q * newr; r = newr; newr = tmp;
+    }
+    assert(r == 1);
+    return uint32_t(t < 0 ? t + p : t);
+}
+
+// ======================================================================================
+// RnsBasis
+// ======================================================================================
+
+RnsBasis::RnsBasis(int count)
+{
+    assert(count > 0);
+    primes.reserve(count);
+    for (uint32_t c = 0xFFFF'FFFB; int(primes.size()) < count; c -= 2)
+    {
+        assert(c > 2);
+        if (is_probable_prime(Num(c)))
+            primes.push_back(c);
+    }
+    init();
+}
+
+RnsBasis::RnsBasis(const std::vector<uint32_t>& primes) : primes(primes)
+{
+    init();
+}
+
+void RnsBasis::init()
+{
+    assert(!primes.empty());
+
+    std::vector<Num> leaves;
+    leaves.reserve(primes.size());
+    for (uint32_t p : primes)
+    {
+        assert(p > 1);
+        leaves.push_back(Num(p));
+    }
+    tree = product_tree(leaves);
+
+    // (M / p) mod p = (M mod p^2) / p
+    std::vector<Num> squares;
+    squares.reserve(primes.size());
+    for (uint32_t p : primes)
+        squares.push_back(Num((unsigned long long) p * p));
+    std::vector<Num> rems = remainder_tree(modulus(), product_tree(squares));
+
+    inverses.resize(primes.size());
+    for (size_t i = 0; i < primes.size(); i++)
+    {
+        uint32_t cofactor = uint32_t(rems[i].to_uint64() / primes[i]);
+        inverses[i] = inverse_mod(cofactor, primes[i]);
+    }
+
+    half = modulus();
+    half >>= 1;
+}
+
+// ======================================================================================
+// RnsNum
+// ======================================================================================
+
+RnsNum::RnsNum(const RnsBasis& basis) : basis(&basis), residues(basis.primes.size(), 0)
+{
+}
+
+RnsNum::RnsNum(const RnsBasis& basis, const Num& n) : basis(&basis)
+{
+    std::vector<Num> rems = remainder_tree(n, basis.tree);
+
+    residues.resize(rems.size());
+    for (size_t i = 0; i < rems.size(); i++)
+    {
+        uint32_t r = uint32_t(rems[i].to_uint64());
+        residues[i] = (n.data.sign && r != 0) ? basis.primes[i] - r : r;
+    }
+}
+
+Num RnsNum::to_unsigned_num() const
+{
+    const RnsBasis& b = *basis;
+    const std::vector<uint32_t>& p = b.primes;
+
+    std::vector<Num> sums(p.size());
+    for (size_t i = 0; i < p.size(); i++)
+        sums[i] = Num((unsigned long long) (uint64_t(residues[i]) * b.inverses[i] % p[i]));
+
+    // Combine pairs up the tree, mirroring product_tree
+    for (size_t level = 0; level + 1 < b.tree.size(); level++)
+    {
+        const std::vector<Num>& products = b.tree[level];
+        std::vector<Num> next;
+        next.reserve((sums.size() + 1) / 2);
+        for (size_t i = 0; i + 1 < sums.size(); i += 2)
+        {
+            Num s = multiply(sums[i], products[i + 1]);
+            s += multiply(sums[i + 1], products[i]);
+            next.push_back(std::move(s));
+        }
+        if (sums.size() & 1)
+            next.push_back(std::move(sums.back()));
+        sums = std::move(next);
+    }
+
+    // The sum is less than size() * M
+    Num x = std::move(sums[0]);
+    if (x.magcmp(b.modulus()) >= 0)
+        x %= b.modulus();
+    return x;
+}
+
+Num RnsNum::to_num() const
+{
+    Num x = to_unsigned_num();
+    if (x.magcmp(basis->half) > 0)
+        x -= basis->modulus();
+    return x;
+}
+
+RnsNum& RnsNum::operator+=(const RnsNum& rhs)
+{
+    assert(basis == rhs.basis);
+    const uint32_t* p = basis->primes.data();
+    for (size_t i = 0; i < residues.size(); i++)
+    {
+        uint64_t s = uint64_t(residues[i]) + rhs.residues[i];
+        residues[i] = uint32_t(s >= p[i] ? s - p[i] : s);
+    }
+    return *this;
+}
+
+RnsNum& RnsNum::operator-=(const RnsNum& rhs)
+{
+    assert(basis == rhs.basis);
+    const uint32_t* p = basis->primes.data();
+    for (size_t i = 0; i < residues.size(); i++)
+    {
+        uint32_t a = residues[i], b = rhs.residues[i];
+        residues[i] = a >= b ? a - b : a + (p[i] - b);
+    }
+    return *this;
+}
+
+RnsNum& RnsNum::operator*=(const RnsNum& rhs)
+{
+    assert(basis == rhs.basis);
+    const uint32_t* p = basis->primes.data();
+    for (size_t i = 0; i < residues.size(); i++)
+        residues[i] = uint32_t(uint64_t(residues[i]) * rhs.residues[i] % p[i]);
+    return *this;
+}
+
+RnsNum& RnsNum::negate()
+{
+    const uint32_t* p = basis->primes.data();
+    for (size_t i = 0; i < residues.size(); i++)
+        residues[i] = residues[i] != 0 ? p[i] - residues[i] : 0;
+    return *this;
+}
@@ -0,0 +1,81 @@
+// ======================================================================================
+// NumRns.h
+// - residue number system (multi-modular) representation of Num
+//
+// An RnsNum holds a number as its residues modulo each prime of an RnsBasis. Add,
+// subtract and multiply work on each residue on its own, with single-word arithmetic
+// and no carries between them, so a long chain of operations on huge numbers costs a
+// loop over words per operation. Converting in and out is the expensive part, and is
+// done once at each end with the product and remainder trees from Num.h.
+//
+// Results are exact as long as every value in the computation fits the basis: a
+// signed value must lie in (-M/2, M/2], where M is the product of the primes. There
+// is no overflow detection - a value outside the range comes back reduced mod M.
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+
+#include <cstdint>
+#include <vector>
+
+// ======================================================================================
+// RnsBasis
+// - a set of distinct primes below 2^32, with what's needed to convert to and from
+//   residues. A basis is immutable after construction, so it can be shared by any
+//   number of RnsNums and threads.
+
+class RnsBasis
+{
+public:
+    // The count largest primes below 2^32, which covers about 32*count bits
+    explicit RnsBasis(int count);
+
+    // A basis of the given primes, which must be distinct
+    explicit RnsBasis(const std::vector<uint32_t>& primes);
+
+    int size() const { return int(primes.size()); }
+
+    // The product of the primes
+    const Num& modulus() const { return tree.back()[0]; }
+
+    std::vector<uint32_t> primes;
+    ProductTree tree;               // product tree over the primes
+    std::vector<uint32_t> inverses; // (M / p) ^ -1 mod p, for each prime p
+    Num half;                       // M / 2, the largest signed value
+
+private:
+    void init();
+};
+
+// ======================================================================================
+// RnsNum
+
+class RnsNum
+{
+public:
+    // Zero
+    explicit RnsNum(const RnsBasis& basis);
+
+    // n mod each prime of the basis
+    RnsNum(const RnsBasis& basis, const Num& n);
+
+    // Rebuild the number with the Chinese remainder theorem. The signed result is in
+    // (-M/2, M/2], the unsigned one in [0, M).
+    Num to_num() const;
+    Num to_unsigned_num() const;
+
+    // Both operands must use the same basis
+    RnsNum& operator+=(const RnsNum& rhs);
+    RnsNum& operator-=(const RnsNum& rhs);
+    RnsNum& operator*=(const RnsNum& rhs);
+    RnsNum& negate();
+
+    const RnsBasis* basis;
+    std::vector<uint32_t> residues; // one per prime, in basis order
+};
+
+inline RnsNum operator+(RnsNum lhs, const RnsNum& rhs) { return lhs += rhs; }
+inline RnsNum operator-(RnsNum lhs, const RnsNum& rhs) { return lhs -= rhs; }
+inline RnsNum operator*(RnsNum lhs, const RnsNum& rhs) { return lhs *= rhs; }
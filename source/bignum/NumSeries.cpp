@@ -0,0 +1,230 @@
+// ======================================================================================
+// NumSeries.cpp
+//
+// Binary splitting
+//
+// The tree of ranges is split across threads from the top: the left half is forked as
+// a task on the shared TaskPool and the right half stays, until each thread has a
+// range of its own. The combines near the top are the biggest multiplies in the whole
+// computation and have only two halves to work with, so the products of a combine are
+// forked as tasks of their own too.
+//
+// The constants divide T by Q (or the other way round) once at the end. The sums are
+// exact, and much longer than the precision asked for, so both are cut down to the
+// precision first.
+// ======================================================================================
+
+#include "NumSeries.h"
+#include "../tasks/TaskPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Ranges with fewer terms than this are summed on one thread
+static constexpr int64_t kParallelTerms = 256;
+
+// Extra digits carried through the constants, and dropped at the end
+static constexpr int64_t kGuardDigits = 16;
+
+static bool is_one(const Num& n)
+{
+    return n.data.len == 1 && !n.data.sign && n.cdatabuffer()[0] == 1;
+}
+
+// a * b, where either one is often 1 (a B of a series without denominators)
+static Num times(const Num& a, const Num& b)
+{
+    if (is_one(a))
+        return b;
+    if (is_one(b))
+        return a;
+    return multiply(a, b);
+}
+
+static SeriesSum split(const SeriesTerm& term, int64_t n1, int64_t n2, bool need_p, int threads)
+{
+    SeriesSum s;
+    if (n2 - n1 == 1)
+    {
+        Num a;
+        s.B = 1;
+        term(n1, s.P, s.Q, a, s.B);
+        s.T = times(a, s.P);
+        return s;
+    }
+
+    int64_t m = n1 + (n2 - n1) / 2;
+    SeriesSum l, r;
+    if (threads > 1 && n2 - n1 >= kParallelTerms)
+    {
+        TaskGroup g;
+        g.run([&]() { l = split(term, n1, m, true, threads / 2); });
+        r = split(term, m, n2, need_p, threads - threads / 2);
+        g.wait();
+    }
+    else
+    {
+        l = split(term, n1, m, true, 1);
+        r = split(term, m, n2, need_p, 1);
+    }
+
+    // T = Br * Qr * Tl + Bl * Pl * Tr
+    auto left_t = [&l, &r]() { return times(r.B, times(r.Q, l.T)); };
+    auto right_t = [&l, &r]() { return times(l.B, times(l.P, r.T)); };
+    auto product_q = [&l, &r]() { return multiply(l.Q, r.Q); };
+    if (threads > 1)
+    {
+        Num t2;
+        TaskGroup g;
+        g.run([&]() { s.T = left_t(); });
+        g.run([&]() { t2 = right_t(); });
+        g.run([&]() { s.Q = product_q(); });
+        if (need_p)
+            s.P = multiply(l.P, r.P);
+        s.B = times(l.B, r.B);
+        g.wait();
+        s.T += t2;
+    }
+    else
+    {
+        s.T = left_t();
+        s.T += right_t();
+        s.Q = product_q();
+        s.B = times(l.B, r.B);
+        if (need_p)
+            s.P = multiply(l.P, r.P);
+    }
+    return s;
+}
+
+SeriesSum binary_split(const SeriesTerm& term, int64_t n1, int64_t n2, bool need_p, int threads)
+{
+    assert(n1 < n2);
+    if (threads <= 0)
+        threads = TaskPool::shared().size();
+    return split(term, n1, n2, need_p, threads);
+}
+
+// ======================================================================================
+
+// Shift a and b right by the same amount, so that the smaller keeps bits bits. The
+// ratio a / b only changes in the bits after that.
+static void truncate_ratio(Num& a, Num& b, int64_t bits)
+{
+    int64_t shift = std::min(a.bit_length(), b.bit_length()) - bits;
+    if (shift > 0)
+    {
+        a >>= int(shift);
+        b >>= int(shift);
+    }
+}
+
+// Bits for precision decimal digits, and some to spare
+static int64_t precision_bits(int64_t precision)
+{
+    return int64_t(double(precision) * 3.3219280948873623) + 64;
+}
+
+static Num power_of_ten(int64_t n)
+{
+    Num ten = 10;
+    return ten ^ Num((long long) n);
+}
+
+// Chudnovsky: pi = 426880 sqrt(10005) Q / T for the sum with
+//   a(k) = 13591409 + 545140134 k
+//   p(k) = -(6k - 5)(2k - 1)(6k - 1),  q(k) = k^3 * 640320^3 / 24
+// and p(0) = q(0) = 1. Each term adds about 14.18 digits.
+Num pi_digits(int64_t digits, int threads)
+{
+    assert(digits >= 0);
+    int64_t precision = digits + kGuardDigits;
+    int64_t terms = int64_t(double(precision) / 14.181647462725477) + 2;
+
+    // The square root doesn't depend on the sum, so it runs alongside it. On one thread
+    // it goes to a pool of one, which runs it as it is forked, so the shared pool isn't
+    // started.
+    Num root;
+    TaskPool serial(1);
+    TaskGroup g(threads == 1 ? serial : TaskPool::shared());
+    g.run([&root, precision]() {
+        Num scale = power_of_ten(precision);
+        root = isqrt(multiply(multiply(scale, scale), Num(10005)));
+    });
+
+    SeriesSum s = binary_split(
+        [](int64_t k, Num& p, Num& q, Num& a, Num&) {
+            a = Num(13591409LL) + Num(545140134LL) * Num((long long) k);
+            if (k == 0)
+            {
+                p = 1;
+                q = 1;
+                return;
+            }
+            p = Num((long long) (5 - 6 * k)) * Num((long long) (2 * k - 1));
+            p *= Num((long long) (6 * k - 1));
+            Num kk = (long long) k;
+            q = kk * kk;
+            q *= kk;
+            q *= Num(10939058860032000ULL);
+        },
+        0, terms, false, threads);
+
+    truncate_ratio(s.Q, s.T, precision_bits(precision));
+    g.wait();
+    Num x = multiply(multiply(root, s.Q), Num(426880));
+    x /= s.T;
+    x /= power_of_ten(kGuardDigits);
+    return x;
+}
+
+// e = sum 1/k!, so p(k) = 1 and q(k) = k, and e = T / Q
+Num e_digits(int64_t digits, int threads)
+{
+    assert(digits >= 0);
+    int64_t precision = digits + kGuardDigits;
+
+    // Enough terms that the first one left out is below 10^-precision
+    int64_t terms = 1;
+    for (double log_factorial = 0; log_factorial < double(precision) + 1; terms++)
+        log_factorial += std::log10(double(terms));
+
+    SeriesSum s = binary_split(
+        [](int64_t k, Num& p, Num& q, Num& a, Num&) {
+            p = 1;
+            q = k == 0 ? Num(1) : Num((long long) k);
+            a = 1;
+        },
+        0, terms, false, threads);
+
+    truncate_ratio(s.T, s.Q, precision_bits(precision));
+    Num x = multiply(s.T, power_of_ten(precision));
+    x /= s.Q;
+    x /= power_of_ten(kGuardDigits);
+    return x;
+}
+
+// log 2 = 3/4 sum (-1)^k (k!)^2 / (2^k (2k+1)!), so p(k) = -k and q(k) = 4(2k + 1),
+// and each term adds log10(8) digits
+Num log2_digits(int64_t digits, int threads)
+{
+    assert(digits >= 0);
+    int64_t precision = digits + kGuardDigits;
+    int64_t terms = int64_t(double(precision) / 0.9030899869919435) + 2;
+
+    SeriesSum s = binary_split(
+        [](int64_t k, Num& p, Num& q, Num& a, Num&) {
+            p = k == 0 ? Num(1) : Num((long long) -k);
+            q = k == 0 ? Num(1) : Num((long long) (8 * k + 4));
+            a = 1;
+        },
+        0, terms, false, threads);
+
+    truncate_ratio(s.T, s.Q, precision_bits(precision));
+    Num x = multiply(multiply(s.T, power_of_ten(precision)), Num(3));
+    s.Q <<= 2;
+    x /= s.Q;
+    x /= power_of_ten(kGuardDigits);
+    return x;
+}
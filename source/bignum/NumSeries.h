@@ -0,0 +1,51 @@
+// ======================================================================================
+// NumSeries.h
+// - summing series by binary splitting, and constants computed that way
+//
+// Binary splitting sums a series whose terms are ratios of small integers,
+//
+//   S = sum_{k=n1}^{n2-1} a(k)/b(k) * prod_{j=n1}^{k} p(j)/q(j)
+//
+// exactly, as S = T / (B * Q) with
+//
+//   P = prod p(j),  Q = prod q(j),  B = prod b(j)
+//
+// The range is split in half, and the halves are combined with
+//
+//   P = Pl * Pr,  Q = Ql * Qr,  B = Bl * Br,  T = Br * Qr * Tl + Bl * Pl * Tr
+//
+// so the work is a tree of multiplies of numbers of about equal size, instead of a
+// long chain of big-by-small ones. The hypergeometric series for pi (Chudnovsky), e
+// and log 2 all have this form.
+//
+// The halves and the products of each combine are independent of each other, and
+// are spread over the threads of the shared TaskPool.
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+
+#include <cstdint>
+#include <functional>
+
+// Fills in the numbers of term k. b comes in as 1, and only needs setting if the
+// series has denominators.
+using SeriesTerm = std::function<void(int64_t k, Num& p, Num& q, Num& a, Num& b)>;
+
+struct SeriesSum
+{
+    Num P, Q, B, T;
+};
+
+// The sum of terms n1 to n2-1 (n1 < n2), split for up to threads threads of the
+// shared TaskPool (0 for all of them). P is left at zero unless need_p, which saves
+// the largest multiply at the top.
+SeriesSum binary_split(const SeriesTerm& term, int64_t n1, int64_t n2, bool need_p = false, int threads = 0);
+
+// floor(x * 10^digits) for the constant x, so for instance pi_digits(3) is 3141. The
+// sums are carried with guard digits, which leaves the last digit wrong only if the
+// digits after it are a long run of nines or zeros.
+Num pi_digits(int64_t digits, int threads = 0);
+Num e_digits(int64_t digits, int threads = 0);
+Num log2_digits(int64_t digits, int threads = 0);
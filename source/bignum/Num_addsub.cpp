@@ -5,6 +5,7 @@
 // ======================================================================================
 
 #include "Num.h"
+#include "Digits.h"
 
 #include <cassert>
 
@@ -47,29 +48,87 @@
 
 // Num + Num
 // Create a temp and then just call operator+=()
-Num Num::operator+(const Num& rhs)
+Num Num::operator+(const Num& rhs) const
 {
     Num temp{*this};
     return temp.operator+=(rhs);
 }
 
+// Fast path for lhs + rhs when both have at most two digits: add or subtract the
+// 64-bit magnitudes directly. The result has at most three digits, so this always
+// succeeds. rsign is the effective sign of rhs (flipped for subtraction).
+static void add_small(Num& lhs, uint64_t b, int32_t rsign)
+{
+    uint64_t a = lhs.small_magnitude();
+    int32_t lsign = lhs.data.sign;
+    if (lsign == rsign)
+    {
+        uint64_t sum = a + b;
+        lhs.set_small(sum, sum < a ? 1 : 0, lsign);
+    }
+    else if (a >= b)
+        lhs.set_small(a - b, 0, lsign);
+    else
+        lhs.set_small(b - a, 0, rsign);
+}
+
+// Num + integer
+// A Num of more than two digits is bigger than any integer, so the sign of the result
+// is the sign of a, and the integer is added to or taken from the magnitude.
+void add_int(Num& r, const Num& a, IntOperand v)
+{
+    NUM_COUNT_OP(NumOp::Add, a.data.len + 2);
+    if (&r != &a)
+    {
+        r.reserve(a.data.len + 1);
+        r = a;
+    }
+
+    if (r.is_small())
+    {
+        add_small(r, v.magnitude, v.sign);
+        return;
+    }
+
+    uint32_t digits[2] = { uint32_t(v.magnitude), uint32_t(v.magnitude >> 32) };
+    if (r.data.sign == v.sign)
+        r.addto(NumView(digits, 2));
+    else
+        r.subfrom(NumView(digits, 2));
+}
+
 // Num += Num
 // Grow/shrink the lhs Num as needed.
 Num& Num::operator+=(const Num& rhs)
 {
+    if (is_small() && rhs.is_small())
+    {
+        NUM_COUNT_OP(NumOp::Add, data.len + rhs.data.len);
+        add_small(*this, rhs.small_magnitude(), rhs.data.sign);
+        return *this;
+    }
+
+    return operator+=(NumView(rhs));
+}
+
+// Num += NumView
+Num& Num::operator+=(const NumView& rhs)
+{
+    NUM_COUNT_OP(NumOp::Add, data.len + rhs.len);
+
     // If the signs are the same, we add and preserve the sign
-    if (data.sign == rhs.data.sign)
+    if (data.sign == rhs.sign)
         return addto(rhs);
 
     // If the signs are different, we are actually subtracting. If the lhs has the larger
     // magnitude, we can just subtract rhs from lhs while preserving sign of lhs.
-    if (magcmp(rhs) >= 0)
+    if (::magcmp(*this, rhs) >= 0)
         return subfrom(rhs);
 
     // The signs are different, and the rhs is the large value. We need a temp to operate
     // on. Copy lhs to a temp, copy rhs to lhs, and then subtract magnitudes.
     Num temp{*this};
-    *this = rhs;
+    *this = Num(rhs);
     return subfrom(temp);
 }
 
@@ -114,59 +173,40 @@ Num& Num::operator+=(const uint32_t& digit)
 
 // --------------------------------------------------------------------------------------
 
-Num& Num::addto(const Num& rhs)
+Num& Num::addto(const NumView& rhs)
 {
     auto lbuf = databuffer();
-    auto rbuf = rhs.cdatabuffer();
+    auto rbuf = rhs.digits;
 
     // Two Num values can have different lengths. Add the prefix together, where
     // the prefix is the largest shared length between the two Nums. Note that by
     // definition one Num is all prefix and the other Num has an optional
     // suffix, and that the prefix may be zero length.
-    int i = 0;
-    int P = (data.len < rhs.data.len) ? data.len : rhs.data.len;
-    long long carry = 0;
-
-    for (; i < P; i++)
-    {
-        carry = carry + lbuf[i] + rbuf[i];
-        lbuf[i] = (uint32_t) carry;
-        carry >>= 32; // this is either +1 or 0
-    }
+    int P = (data.len < rhs.len) ? data.len : rhs.len;
+    uint32_t carry = add_digits(lbuf, lbuf, rbuf, P);
 
     // If the lhs has remaining data, then we just finish adding the carry into
     // the lhs until we have no more carry. This may result in increasing lhs by
     // 1 digit.
-    if (data.len > i)
-    {
-        for (; carry != 0 && i < data.len; i++)
-        {
-            carry = carry + lbuf[i];
-            lbuf[i] = (uint32_t) carry;
-            carry >>= 32;
-        }
-    }
+    if (data.len > P)
+        carry = add_digit(lbuf + P, lbuf + P, data.len - P, carry);
 
     // Otherwise, if the rhs has remaining data, then we add the carry and the rhs
     // together. This will grow the lhs to at least the size of the rhs, and it could
     // grow by 1 more if the carry+rhs spills over into a new digit. We won't know that
     // until we get to the end of the rhs+carry.
-    else if (rhs.data.len > i)
+    else if (rhs.len > P)
     {
-        grow(rhs.data.len - data.len);
-        for (; i < rhs.data.len; i++)
-        {
-            carry = carry + rbuf[i];
-            lbuf[i] = (uint32_t) carry;
-            carry >>= 32;
-        }
+        lbuf = grow(rhs.len - data.len);
+        carry = add_digit(lbuf + P, rbuf + P, rhs.len - P, carry);
     }
 
     // If we still have a carry, create a new digit and place it there
     if (carry != 0)
     {
+        int i = data.len;
         lbuf = grow(1);
-        lbuf[i] = (uint32_t) carry;
+        lbuf[i] = carry;
     }
 
     return *this;
@@ -177,32 +217,16 @@ Num& Num::addto(const Num& rhs)
 // compute magnitude-only Num - Num, where lhs is guaranteed to be
 // bigger than rhs, so that we don't have underflow. This simplifies the logic
 // for subtract.
-Num& Num::subfrom(const Num& rhs)
+Num& Num::subfrom(const NumView& rhs)
 {
     auto lbuf = databuffer();
-    auto rbuf = rhs.cdatabuffer();
-
-    // Subtract the prefix - we already know that |lhs| > |rhs|
-    int i = 0;
-    long long borrow = 0;
-
-    for (; i < rhs.data.len; i++)
-    {
-        borrow = borrow + lbuf[i] - rbuf[i];
-        if (borrow < 0)
-            lbuf[i] = (uint32_t)((1LL<<32) + borrow);
-        else
-            lbuf[i] = (uint32_t) borrow;
-        borrow >>= 32; // this is either -1 or 0
-    }
+    auto rbuf = rhs.digits;
 
-    // If we have a borrow left, ripple through the remaining number
-    for (; i < data.len && borrow != 0; i++)
-    {
-        borrow = borrow + lbuf[i];
-        lbuf[i] = (borrow < 0) ? (uint32_t)((1LL<<32) + borrow) : (uint32_t) borrow;
-        borrow >>= 32; // this is either -1 or 0
-    }
+    // Subtract the prefix - we already know that |lhs| > |rhs|, and then ripple
+    // any borrow through the rest of the lhs
+    int P = rhs.len;
+    uint32_t borrow = sub_digits(lbuf, lbuf, rbuf, P);
+    sub_digit(lbuf + P, lbuf + P, data.len - P, borrow);
 
     // Trim so MSB is non-zero
     trim();
@@ -241,7 +265,7 @@ Num& Num::subfrom(const Num& rhs)
 
 // Num - Num
 // Create a temp and then just call operator-=()
-Num Num::operator-(const Num& rhs)
+Num Num::operator-(const Num& rhs) const
 {
     Num temp{*this};
     return temp.operator-=(rhs);
@@ -251,17 +275,32 @@ Num Num::operator-(const Num& rhs)
 // Grow/shrink the lhs Num as needed.
 Num& Num::operator-=(const Num& rhs)
 {
+    if (is_small() && rhs.is_small())
+    {
+        NUM_COUNT_OP(NumOp::Sub, data.len + rhs.data.len);
+        add_small(*this, rhs.small_magnitude(), rhs.data.sign ? 0 : -1);
+        return *this;
+    }
+
+    return operator-=(NumView(rhs));
+}
+
+// Num -= NumView
+Num& Num::operator-=(const NumView& rhs)
+{
+    NUM_COUNT_OP(NumOp::Sub, data.len + rhs.len);
+
     // If the signs are different, we add and preserve the LHS sign
     //    +a - -b == +a + +b == +(a+b)
     //    -a - +b == -a + -b == -(a+b)
-    if (data.sign != rhs.data.sign)
+    if (data.sign != rhs.sign)
         return addto(rhs);
 
     // If the signs are the same, we are actually subtracting. If the lhs has the larger
     // magnitude, we can just subtract rhs from lhs while preserving sign of lhs.
     //   +a - +b == +(a-b)
     //   -a - -b == -(a-b)
-    if (magcmp(rhs) >= 0)
+    if (::magcmp(*this, rhs) >= 0)
         return subfrom(rhs);
 
     // The signs are the same, and the rhs is the large value. We need a temp to operate
@@ -269,7 +308,7 @@ Num& Num::operator-=(const Num& rhs)
     //  +a - +b == -(b-a)
     //  -a - -b == +(b-a)
     Num temp{*this};
-    *this = rhs;
+    *this = Num(rhs);
     this->data.sign = this->data.sign == 0 ? -1 : 0;
     return subfrom(temp);
 }
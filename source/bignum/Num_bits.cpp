@@ -0,0 +1,404 @@
+// ======================================================================================
+// Num_bits.cpp
+//
+// Shifts, bitwise operators and bit queries
+//
+// A Num is stored as sign and magnitude, but the bitwise operators behave as if
+// numbers were in two's complement with an infinite string of sign bits to the left,
+// the same as the primitive integer types (and Python). So -1 & x == x, -1 >> n == -1,
+// and ~x == -x - 1.
+//
+// Non-negative operands are by far the common case, and for those the operators
+// run straight over the digits; the loops are written so that they work a whole
+// vector register at a time on long operands. Negative operands are converted to two's
+// complement on the fly, one digit at a time, while the operation runs.
+// ======================================================================================
+
+#include "Num.h"
+#include "Intrinsics.h"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NUM_SSE2 1
+#endif
+
+// ======================================================================================
+// Digit kernels
+// ======================================================================================
+
+// Operands shorter than this don't gain anything from vector loads
+static constexpr int kVectorDigits = 16;
+
+enum class BitOp { And, Or, Xor };
+
+// r[i] = a[i] op b[i] for i in [0, n). r may be the same as a or b.
+static void bitop_digits(BitOp op, uint32_t* r, const uint32_t* a, const uint32_t* b, int n)
+{
+    int i = 0;
+
+    #if defined(NUM_SSE2)
+    if (n >= kVectorDigits)
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+            __m128i vr = op == BitOp::And ? _mm_and_si128(va, vb)
+                       : op == BitOp::Or ? _mm_or_si128(va, vb)
+                       : _mm_xor_si128(va, vb);
+            _mm_storeu_si128((__m128i*) (r + i), vr);
+        }
+    }
+    #endif
+
+    for (; i < n; i++)
+        r[i] = op == BitOp::And ? (a[i] & b[i]) : op == BitOp::Or ? (a[i] | b[i]) : (a[i] ^ b[i]);
+}
+
+// r[i] = (a[i] >> s) | (a[i+1] << (32-s)) for i in [0, n), with 0 < s < 32.
+// a has n+1 valid digits. r may be at or below a (ascending in-place shifts).
+static void shr_digits(uint32_t* r, const uint32_t* a, int n, int s)
+{
+    int i = 0;
+
+    #if defined(NUM_SSE2)
+    if (n >= kVectorDigits)
+    {
+        __m128i sr = _mm_cvtsi32_si128(s);
+        __m128i sl = _mm_cvtsi32_si128(32 - s);
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i lo = _mm_loadu_si128((const __m128i*) (a + i));
+            __m128i hi = _mm_loadu_si128((const __m128i*) (a + i + 1));
+            _mm_storeu_si128((__m128i*) (r + i), _mm_or_si128(_mm_srl_epi32(lo, sr), _mm_sll_epi32(hi, sl)));
+        }
+    }
+    #endif
+
+    for (; i < n; i++)
+        r[i] = (a[i] >> s) | (a[i+1] << (32 - s));
+}
+
+// r[i] = (a[i] << s) | (a[i-1] >> (32-s)) for i in [1, n], with 0 < s < 32.
+// Works from the top down so that r may be at or above a (descending in-place shifts).
+static void shl_digits(uint32_t* r, const uint32_t* a, int n, int s)
+{
+    int i = n;
+
+    #if defined(NUM_SSE2)
+    if (n >= kVectorDigits)
+    {
+        __m128i sl = _mm_cvtsi32_si128(s);
+        __m128i sr = _mm_cvtsi32_si128(32 - s);
+        for (; i - 4 >= 0; i -= 4)
+        {
+            __m128i hi = _mm_loadu_si128((const __m128i*) (a + i - 3));
+            __m128i lo = _mm_loadu_si128((const __m128i*) (a + i - 4));
+            _mm_storeu_si128((__m128i*) (r + i - 3), _mm_or_si128(_mm_sll_epi32(hi, sl), _mm_srl_epi32(lo, sr)));
+        }
+    }
+    #endif
+
+    for (; i >= 1; i--)
+        r[i] = (a[i] << s) | (a[i-1] >> (32 - s));
+}
+
+// Add 1 to a magnitude of n digits, returns the carry out
+static uint32_t increment_digits(uint32_t* a, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (++a[i] != 0)
+            return 0;
+    return 1;
+}
+
+// ======================================================================================
+// Shifts
+// ======================================================================================
+
+Num Num::operator<<(const int rhs) const
+{
+    Num temp{*this};
+    return temp.operator<<=(rhs);
+}
+
+// Shift left - multiply by 2^rhs (the sign is unchanged)
+Num& Num::operator<<=(const int rhs)
+{
+    if (rhs < 0)
+        return operator>>=(-rhs);
+    NUM_COUNT_OP(NumOp::Shift, data.len);
+    if (rhs == 0 || data.len == 0)
+        return *this;
+
+    int dig = rhs >> 5;
+    int shift = rhs & 0x1F;
+    int len = data.len;
+
+    // Grow by the whole digits plus one for bits shifted out of the top digit,
+    // then move everything up in place, highest digit first
+    uint32_t* buf = resize(len + dig + 1);
+    if (shift == 0)
+    {
+        buf[len + dig] = 0;
+        memmove(buf + dig, buf, len * sizeof(uint32_t));
+    }
+    else
+    {
+        uint32_t top = buf[len - 1] >> (32 - shift);
+        shl_digits(buf + dig, buf, len - 1, shift);
+        buf[dig] = buf[0] << shift;
+        buf[len + dig] = top;
+    }
+    memset(buf, 0, dig * sizeof(uint32_t));
+
+    trim();
+    return *this;
+}
+
+Num Num::operator>>(const int rhs) const
+{
+    Num temp{*this};
+    return temp.operator>>=(rhs);
+}
+
+// Shift right - divide by 2^rhs, rounding towards negative infinity like an
+// arithmetic shift of a two's complement number
+Num& Num::operator>>=(const int rhs)
+{
+    if (rhs < 0)
+        return operator<<=(-rhs);
+    NUM_COUNT_OP(NumOp::Shift, data.len);
+
+    // If we have a trivial shift by zero, just return
+    if (rhs == 0 || data.len == 0)
+        return *this;
+
+    uint32_t* buf = databuffer();
+    int dig = rhs >> 5;
+    int shift = rhs & 0x1F;
+    bool negative = data.sign != 0;
+
+    // A negative number that loses any one bits rounds down (away from zero)
+    bool round = negative && ctz() < rhs;
+
+    // If we shift past all the data, we just have zero (or -1) remaining
+    if (dig >= data.len)
+    {
+        *this = negative ? -1 : 0;
+        return *this;
+    }
+
+    // Shift whole digits and bits together in one pass
+    int len = data.len - dig;
+    if (shift == 0)
+        memmove(buf, buf + dig, len * sizeof(uint32_t));
+    else
+    {
+        shr_digits(buf, buf + dig, len - 1, shift);
+        buf[len - 1] = buf[len - 1 + dig] >> shift;
+    }
+    data.len = len;
+
+    // Remove extraneous leading zeros
+    trim();
+
+    if (round)
+    {
+        // The magnitude is at least 1 smaller than before, so this can't overflow
+        // past the current length by more than the one digit we add
+        buf = grow(1);
+        buf[data.len - 1] = 0;
+        increment_digits(buf, data.len);
+        trim();
+        data.sign = -1;
+    }
+
+    return *this;
+}
+
+// ======================================================================================
+// Bitwise operators
+// ======================================================================================
+
+// lhs = lhs op rhs for operands where either is negative. Each operand is turned into
+// two's complement (invert and add 1) a digit at a time, with the carry of the +1
+// carried along in the loop. One more digit than the longer operand is enough to hold
+// the sign. If the result is negative, it is turned back into a magnitude the same way.
+static void bitop_signed(BitOp op, Num& lhs, const Num& rhs)
+{
+    int alen = lhs.data.len;
+    int blen = rhs.data.len;
+    int n = std::max(alen, blen) + 1;
+
+    uint32_t asign = lhs.data.sign ? 0xFFFF'FFFF : 0;
+    uint32_t bsign = rhs.data.sign ? 0xFFFF'FFFF : 0;
+    uint32_t rsign = op == BitOp::And ? (asign & bsign) : op == BitOp::Or ? (asign | bsign) : (asign ^ bsign);
+
+    uint32_t* a = lhs.resize(n);
+    const uint32_t* b = rhs.cdatabuffer();
+
+    uint64_t acarry = 1;
+    uint64_t bcarry = 1;
+    uint64_t rcarry = 1;
+    for (int i = 0; i < n; i++)
+    {
+        // Digit i of each operand in two's complement. Past the end of the
+        // magnitude the digit is zero, which sign-extends correctly.
+        uint32_t ad = i < alen ? a[i] : 0;
+        if (asign)
+        {
+            acarry = acarry + uint32_t(~ad);
+            ad = uint32_t(acarry);
+            acarry >>= 32;
+        }
+
+        uint32_t bd = i < blen ? b[i] : 0;
+        if (bsign)
+        {
+            bcarry = bcarry + uint32_t(~bd);
+            bd = uint32_t(bcarry);
+            bcarry >>= 32;
+        }
+
+        uint32_t rd = op == BitOp::And ? (ad & bd) : op == BitOp::Or ? (ad | bd) : (ad ^ bd);
+        if (rsign)
+        {
+            rcarry = rcarry + uint32_t(~rd);
+            rd = uint32_t(rcarry);
+            rcarry >>= 32;
+        }
+        a[i] = rd;
+    }
+
+    lhs.data.sign = rsign ? -1 : 0;
+    lhs.trim();
+}
+
+// lhs = lhs op rhs
+static Num& bitop(BitOp op, Num& lhs, const Num& rhs)
+{
+    NUM_COUNT_OP(NumOp::Bitwise, lhs.data.len + rhs.data.len);
+
+    // x & x == x | x == x, x ^ x == 0
+    if (&lhs == &rhs)
+    {
+        if (op == BitOp::Xor)
+            lhs = 0;
+        return lhs;
+    }
+
+    if (lhs.data.sign != 0 || rhs.data.sign != 0)
+    {
+        bitop_signed(op, lhs, rhs);
+        return lhs;
+    }
+
+    int alen = lhs.data.len;
+    int blen = rhs.data.len;
+    int common = std::min(alen, blen);
+
+    // and - only the common digits can be non-zero
+    if (op == BitOp::And)
+    {
+        bitop_digits(op, lhs.databuffer(), lhs.cdatabuffer(), rhs.cdatabuffer(), common);
+        lhs.resize(common);
+        lhs.trim();
+        return lhs;
+    }
+
+    // or, xor - a longer rhs has its extra digits copied
+    uint32_t* a = lhs.resize(std::max(alen, blen));
+    bitop_digits(op, a, a, rhs.cdatabuffer(), common);
+    if (blen > alen)
+        lhs.data.copy_digits(a + alen, rhs.cdatabuffer() + alen, blen - alen);
+    if (op == BitOp::Xor)
+        lhs.trim();
+    return lhs;
+}
+
+Num Num::operator&(const Num& rhs) const
+{
+    Num temp{*this};
+    return temp.operator&=(rhs);
+}
+
+Num& Num::operator&=(const Num& rhs)
+{
+    return bitop(BitOp::And, *this, rhs);
+}
+
+Num Num::operator|(const Num& rhs) const
+{
+    Num temp{*this};
+    return temp.operator|=(rhs);
+}
+
+Num& Num::operator|=(const Num& rhs)
+{
+    return bitop(BitOp::Or, *this, rhs);
+}
+
+Num& Num::bit_xor(const Num& rhs)
+{
+    return bitop(BitOp::Xor, *this, rhs);
+}
+
+// ~x == -x - 1
+Num Num::operator~() const
+{
+    Num temp{*this};
+    temp.data.sign = temp.data.sign ? 0 : -1;
+    temp -= Num(1);
+    return temp;
+}
+
+// ======================================================================================
+// Bit queries
+// ======================================================================================
+
+int Num::bit_length() const
+{
+    if (data.len == 0)
+        return 0;
+    return data.len * 32 - clz32(cdatabuffer()[data.len - 1]);
+}
+
+int Num::popcount() const
+{
+    const uint32_t* buf = cdatabuffer();
+    int count = 0;
+    int i = 0;
+    for (; i + 2 <= data.len; i += 2)
+        count += popcount64(buf[i] | (uint64_t(buf[i+1]) << 32));
+    if (i < data.len)
+        count += popcount32(buf[i]);
+    return count;
+}
+
+int Num::ctz() const
+{
+    const uint32_t* buf = cdatabuffer();
+    for (int i = 0; i < data.len; i++)
+        if (buf[i] != 0)
+            return i * 32 + ctz32(buf[i]);
+    return -1;
+}
+
+// Bit i of the two's complement form. For a negative number, the bits below the
+// lowest one bit of the magnitude are zero, that bit is one, and the bits above
+// it are the inverse of the magnitude.
+bool Num::test_bit(int i) const
+{
+    assert(i >= 0);
+    int dig = i >> 5;
+    bool bit = dig < data.len && ((cdatabuffer()[dig] >> (i & 31)) & 1) != 0;
+    if (data.sign == 0)
+        return bit;
+
+    int low = ctz();
+    return i < low ? false : i == low ? true : !bit;
+}
@@ -0,0 +1,195 @@
+// ======================================================================================
+// Num_float.cpp
+//
+// Conversion between Num and floating point
+//
+// A Num converts to floating point from its top bits alone. We round the magnitude to
+// the mantissa width with round-to-nearest, ties-to-even: the bit just below the
+// mantissa decides, unless it is exactly a tie, and then the rest of the number (the
+// sticky bits) or the low mantissa bit does. Checking the sticky bits needs a scan up
+// from the bottom digit, but only in the tie case, and it stops at the first non-zero
+// digit. The rounded mantissa and the exponent are then exact in the floating point
+// type, so putting them together involves no further rounding.
+// ======================================================================================
+
+#include "Num.h"
+#include "Intrinsics.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// 64 bits of |n| starting at bit pos, with zeros past the top
+static uint64_t bits_at(const NumView& n, int64_t pos)
+{
+    int64_t k = pos / 32;
+    int s = int(pos % 32);
+    auto digit = [&n](int64_t i) -> uint64_t { return i < n.len ? n.digits[i] : 0; };
+
+    uint64_t lo = digit(k) | (digit(k + 1) << 32);
+    if (s == 0)
+        return lo;
+    return (lo >> s) | (digit(k + 2) << (64 - s));
+}
+
+// Number of bits in |n|
+static int64_t bit_length(const NumView& n)
+{
+    if (n.len == 0)
+        return 0;
+    return int64_t(n.len) * 32 - clz32(n.digits[n.len - 1]);
+}
+
+// Is any bit of |n| below pos set?
+static bool any_bits_below(const NumView& n, int64_t pos)
+{
+    int64_t k = pos / 32;
+    for (int64_t i = 0; i < k && i < n.len; i++)
+        if (n.digits[i] != 0)
+            return true;
+    int s = int(pos % 32);
+    return s != 0 && k < n.len && (n.digits[k] & ((uint32_t(1) << s) - 1)) != 0;
+}
+
+// Round |n| to a mantissa of at most bits bits (bits <= 64), so that |n| is about
+// m * 2^exp. Small values are exact, with exp 0.
+static uint64_t round_mantissa(const NumView& n, int bits, int64_t* exp)
+{
+    int64_t length = bit_length(n);
+    if (length <= bits)
+    {
+        *exp = 0;
+        return bits_at(n, 0);
+    }
+
+    int64_t shift = length - bits;
+    uint64_t m = bits_at(n, shift);
+    if (bits < 64)
+        m &= (uint64_t(1) << bits) - 1;
+
+    bool half = (bits_at(n, shift - 1) & 1) != 0;
+    if (half && ((m & 1) != 0 || any_bits_below(n, shift - 1)))
+    {
+        // Rounding up can carry out into a new top bit, which leaves a power of two
+        m += 1;
+        if (bits == 64 ? m == 0 : (m >> bits) != 0)
+        {
+            m = uint64_t(1) << (bits - 1);
+            shift += 1;
+        }
+    }
+
+    *exp = shift;
+    return m;
+}
+
+double Num::to_double() const
+{
+    constexpr int bits = std::numeric_limits<double>::digits;
+    constexpr int max_exp = std::numeric_limits<double>::max_exponent;
+
+    int64_t e;
+    uint64_t m = round_mantissa(*this, bits, &e);
+
+    // m has all 53 bits whenever e > 0, so the value reaches 2^1024 when e does
+    double d;
+    if (e > max_exp - bits)
+        d = std::numeric_limits<double>::infinity();
+    else
+    {
+        // Multiply by 2^e, built directly from its bits, which is exact
+        uint64_t pow2_bits = uint64_t(e + 1023) << 52;
+        double pow2;
+        memcpy(&pow2, &pow2_bits, sizeof(pow2));
+        d = double(m) * pow2;
+    }
+    return data.sign ? -d : d;
+}
+
+long double Num::to_long_double() const
+{
+    constexpr int bits = std::numeric_limits<long double>::digits < 64 ? std::numeric_limits<long double>::digits : 64;
+    constexpr int max_exp = std::numeric_limits<long double>::max_exponent;
+
+    int64_t e;
+    uint64_t m = round_mantissa(*this, bits, &e);
+
+    long double d;
+    if (e > max_exp - bits)
+        d = std::numeric_limits<long double>::infinity();
+    else
+        d = std::ldexp((long double) m, int(e));
+    return data.sign ? -d : d;
+}
+
+double Num::to_double_with_exponent(int64_t* exp) const
+{
+    int64_t e;
+    uint64_t m = round_mantissa(*this, std::numeric_limits<double>::digits, &e);
+    if (m == 0)
+    {
+        *exp = 0;
+        return 0.0;
+    }
+
+    // Scale m into [0.5, 1), which is exact since it only changes the exponent
+    int mbits = 64 - clz64(m);
+    *exp = e + mbits;
+    double d = double(m) / double(uint64_t(1) << mbits);
+    return data.sign ? -d : d;
+}
+
+// ======================================================================================
+
+// Floating point to Num, truncating toward zero
+template<typename Float>
+static bool from_float(Num& n, Float v)
+{
+    if (!std::isfinite(v))
+    {
+        n.set_small(0, 0, 0);
+        return false;
+    }
+
+    Float a = std::trunc(std::fabs(v));
+    int e;
+    Float m = std::frexp(a, &e); // a = m * 2^e, m in [0.5, 1)
+
+    if (e <= 64)
+        n.from_uint64((unsigned long long) a);
+    else
+    {
+        // Peel off the mantissa 32 bits at a time from the top into a 128-bit integer
+        // (no floating point type has more mantissa bits than that); every step is
+        // exact. Then shift it into place - right, if more bits were taken than there
+        // are above the binary point, which are all zero since a is an integer.
+        static_assert(std::numeric_limits<Float>::digits <= 128, "mantissa too wide");
+        uint64_t lo = 0, hi = 0;
+        int taken = 0;
+        while (m != 0)
+        {
+            m = std::ldexp(m, 32);
+            uint32_t chunk = uint32_t(m);
+            m -= chunk;
+            hi = (hi << 32) | (lo >> 32);
+            lo = (lo << 32) | chunk;
+            taken += 32;
+        }
+        n.set_small(lo, hi, 0);
+        n <<= e - taken;
+    }
+
+    if (v < 0 && n.data.len != 0)
+        n.data.sign = -1;
+    return true;
+}
+
+bool Num::from_double(double v)
+{
+    return from_float(*this, v);
+}
+
+bool Num::from_long_double(long double v)
+{
+    return from_float(*this, v);
+}
@@ -0,0 +1,455 @@
+// ======================================================================================
+// Num_gcd.cpp
+//
+// Greatest common divisor
+//
+// Every method here reduces the pair (x, y), x >= y >= 0, by transforms with integer
+// entries and determinant +-1. Such a transform keeps gcd(x, y), and the product of
+// all of them gives the cofactors of the extended GCD.
+//
+// Lehmer's algorithm runs Euclid on the leading 64 bits of x and y, with the
+// cofactors in native integers, for as long as Jebelean's condition says that the
+// quotients are the ones the whole numbers would give. The 2x2 matrix that comes out
+// is then applied to x and y in one pass, which replaces about 30 bits worth of
+// Num divisions. A quotient too big for that (y much shorter than x) is a divmod.
+//
+// From gcd_hgcd_threshold digits up, the half-GCD (Schönhage, in the form of Möller,
+// "On Schönhage's algorithm and subquadratic integer gcd computation") finds the
+// matrix that takes x and y down to half their length from the leading half of
+// their digits, recursively: a half-GCD of the top half of those digits, applied,
+// and then another of what's left. Matrices are applied and combined with
+// multiply(), so the cost is O(M(n) log n) for a multiply that costs M(n).
+//
+// Small numbers finish with Stein's binary GCD on native integers.
+// ======================================================================================
+
+#include "Num.h"
+#include "Digits.h"
+#include "Intrinsics.h"
+#include "Reciprocal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <utility>
+
+// With the schoolbook multiply() the half-GCD spends nearly all its time in
+// multiplies, and is about six times slower than Lehmer at every size (measured up to
+// 50000 digits), so it starts out off. It is the one to use once multiply() has a
+// subquadratic tier, from a few hundred digits up.
+int gcd_hgcd_threshold = INT_MAX;
+
+// Binary GCD (Stein): strip the common factors of two, then subtract the smaller
+// from the larger, which leaves an even number to strip again
+static uint64_t gcd_64(uint64_t u, uint64_t v)
+{
+    if (u == 0)
+        return v;
+    if (v == 0)
+        return u;
+    int shift = ctz64(u | v);
+    u >>= ctz64(u);
+    do
+    {
+        v >>= ctz64(v);
+        if (u > v)
+            std::swap(u, v);
+        v -= u;
+    } while (v != 0);
+    return u << shift;
+}
+
+// ======================================================================================
+// Transforms
+// ======================================================================================
+
+// (x, y) <- (m[0][0] x + m[0][1] y, m[1][0] x + m[1][1] y)
+struct GcdMatrix
+{
+    Num m[2][2] = { { 1, 0 }, { 0, 1 } };
+
+    bool is_identity() const { return m[0][1].data.len == 0 && m[1][0].data.len == 0; }
+};
+
+// a u + b v, for |a|, |b| < 2^30, in one pass over the digits
+static Num combine(const Num& u, int64_t a, const Num& v, int64_t b)
+{
+    if (u.data.sign)
+        a = -a;
+    if (v.data.sign)
+        b = -b;
+
+    int len = std::max(u.data.len, v.data.len);
+    const uint32_t* ud = u.cdatabuffer();
+    const uint32_t* vd = v.cdatabuffer();
+    Num r;
+    uint32_t* rd = r.resize(len + 2);
+    int64_t carry = 0;
+    for (int i = 0; i < len; i++)
+    {
+        int64_t ui = i < u.data.len ? ud[i] : 0;
+        int64_t vi = i < v.data.len ? vd[i] : 0;
+        int64_t t = a * ui + b * vi + carry;
+        rd[i] = uint32_t(t);
+        carry = t >> 32;
+    }
+    rd[len] = uint32_t(carry);
+    rd[len + 1] = uint32_t(carry >> 32);
+
+    // A negative result is in two's complement
+    if (carry < 0)
+    {
+        for (int i = 0; i < len + 2; i++)
+            rd[i] = ~rd[i];
+        add_digit(rd, rd, len + 2, 1);
+        r.data.sign = -1;
+    }
+    r.trim();
+    return r;
+}
+
+// Row 0 of t <- a row 0 + b row 1, and row 1 <- c row 0 + d row 1
+static void combine_rows(GcdMatrix& t, int64_t a, int64_t b, int64_t c, int64_t d)
+{
+    for (int j = 0; j < 2; j++)
+    {
+        Num r0 = combine(t.m[0][j], a, t.m[1][j], b);
+        t.m[1][j] = combine(t.m[0][j], c, t.m[1][j], d);
+        t.m[0][j] = std::move(r0);
+    }
+}
+
+// t <- a t
+static void compose(GcdMatrix& t, const GcdMatrix& a)
+{
+    GcdMatrix r;
+    for (int i = 0; i < 2; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            r.m[i][j] = multiply(a.m[i][0], t.m[0][j]);
+            r.m[i][j] += multiply(a.m[i][1], t.m[1][j]);
+        }
+    }
+    t = std::move(r);
+}
+
+// Put x and y back in order, x >= y >= 0, after a transform that may not have been
+// exact (one found from the leading digits only), with the same changes to t
+static void normalize(Num& x, Num& y, GcdMatrix* t)
+{
+    if (x.data.sign)
+    {
+        x.negate();
+        if (t)
+            t->m[0][0].negate(), t->m[0][1].negate();
+    }
+    if (y.data.sign)
+    {
+        y.negate();
+        if (t)
+            t->m[1][0].negate(), t->m[1][1].negate();
+    }
+    if (magcmp(x, y) < 0)
+    {
+        std::swap(x, y);
+        if (t)
+            std::swap(t->m[0], t->m[1]);
+    }
+}
+
+// (x, y) <- a (x, y)
+static void apply(const GcdMatrix& a, Num& x, Num& y, GcdMatrix* t)
+{
+    Num nx = multiply(a.m[0][0], x);
+    nx += multiply(a.m[0][1], y);
+    Num ny = multiply(a.m[1][0], x);
+    ny += multiply(a.m[1][1], y);
+    x = std::move(nx);
+    y = std::move(ny);
+    if (t)
+        compose(*t, a);
+    normalize(x, y, t);
+}
+
+// One step of Euclid: (x, y) <- (y, x mod y)
+static void division_step(Num& x, Num& y, GcdMatrix* t)
+{
+    Num q, r;
+    x.divmod(y, q, r);
+    x = std::move(y);
+    y = std::move(r);
+    if (t)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            Num row1 = t->m[0][j];
+            row1 -= multiply(q, t->m[1][j]);
+            t->m[0][j] = std::move(t->m[1][j]);
+            t->m[1][j] = std::move(row1);
+        }
+    }
+}
+
+// ======================================================================================
+// Lehmer
+// ======================================================================================
+
+// Bits [shift, shift + 64) of n
+static uint64_t bits_at(const Num& n, int shift)
+{
+    const uint32_t* d = n.cdatabuffer();
+    int len = n.data.len;
+    int i = shift / 32;
+    int b = shift % 32;
+    auto digit = [d, len](int k) -> uint64_t { return k < len ? d[k] : 0; };
+    uint64_t lo = digit(i) | (digit(i + 1) << 32);
+    if (b == 0)
+        return lo;
+    return (lo >> b) | (digit(i + 2) << (64 - b));
+}
+
+// Cofactors stay below this, so that a x + b y fits an int64 digit by digit
+static const int64_t kCofactorLimit = int64_t(1) << 30;
+
+// Euclid on the leading 64 bits of x and y. Returns false if not even the first
+// quotient is known to be right.
+static bool lehmer_matrix(const Num& x, const Num& y, int64_t& a, int64_t& b, int64_t& c, int64_t& d)
+{
+    int shift = x.bit_length() > 64 ? x.bit_length() - 64 : 0;
+    uint64_t r0 = bits_at(x, shift);
+    uint64_t r1 = bits_at(y, shift);
+    a = 1, b = 0, c = 0, d = 1;
+
+    // r0 = a x' + b y' and r1 = c x' + d y' for the leading parts x' and y'
+    while (r1 != 0)
+    {
+        uint64_t q = r0 / r1;
+        if (q >= uint64_t(kCofactorLimit))
+            break;
+        uint64_t r2 = r0 - q * r1;
+        int64_t e = a - int64_t(q) * c;
+        int64_t f = b - int64_t(q) * d;
+        if (std::llabs(e) >= kCofactorLimit || std::llabs(f) >= kCofactorLimit)
+            break;
+
+        // Jebelean's condition, for both cofactors: the quotient is the one the whole
+        // numbers give if r2 >= |e|, |f| and r1 - r2 >= |e - c|, |f - d|
+        uint64_t m = uint64_t(std::max(std::llabs(e), std::llabs(f)));
+        uint64_t dm = uint64_t(std::max(std::llabs(e - c), std::llabs(f - d)));
+        if (r2 < m || r1 - r2 < dm)
+            break;
+
+        a = c, b = d, c = e, d = f;
+        r0 = r1;
+        r1 = r2;
+    }
+    return c != 0;
+}
+
+// (x, y) <- (a x + b y, c x + d y) in one pass over the digits
+static void lehmer_apply(Num& x, Num& y, int64_t a, int64_t b, int64_t c, int64_t d)
+{
+    int len = x.data.len;
+    int ylen = y.data.len;
+    uint32_t* xd = x.databuffer();
+    uint32_t* yd = y.resize(len); // y may be shorter; zero its top
+    for (int i = ylen; i < len; i++)
+        yd[i] = 0;
+
+    int64_t cx = 0, cy = 0;
+    for (int i = 0; i < len; i++)
+    {
+        int64_t xi = xd[i], yi = yd[i];
+        int64_t tx = a * xi + b * yi + cx;
+        int64_t ty = c * xi + d * yi + cy;
+        xd[i] = uint32_t(tx);
+        yd[i] = uint32_t(ty);
+        cx = tx >> 32;
+        cy = ty >> 32;
+    }
+
+    // The results are below x, so with an exact matrix there is no carry out
+    assert(cx == 0 && cy == 0);
+    x.trim();
+    y.trim();
+}
+
+// Reduce until y has at most s digits
+static void lehmer_reduce(Num& x, Num& y, GcdMatrix* t, int s)
+{
+    while (y.data.len > s)
+    {
+        int64_t a, b, c, d;
+        if (!lehmer_matrix(x, y, a, b, c, d))
+        {
+            division_step(x, y, t);
+            continue;
+        }
+        lehmer_apply(x, y, a, b, c, d);
+        if (t)
+            combine_rows(*t, a, b, c, d);
+    }
+}
+
+// ======================================================================================
+// Half-GCD
+// ======================================================================================
+
+// The digits of n from digit p up
+static Num high_digits(const Num& n, int p)
+{
+    return Num(NumView(n.cdatabuffer() + p, n.data.len - p));
+}
+
+// Reduce x and y, x >= y, until y has at most n/2 + 1 digits, where n is the length
+// of x, and accumulate the transform in t
+static void hgcd(Num& x, Num& y, GcdMatrix& t)
+{
+    int n = x.data.len;
+    int s = n / 2 + 1;
+    if (y.data.len <= s)
+        return;
+    if (n < gcd_hgcd_threshold)
+    {
+        lehmer_reduce(x, y, &t, s);
+        return;
+    }
+
+    // The top n - p digits decide the first quarter of the reduction
+    int p = n / 2;
+    {
+        Num xt = high_digits(x, p), yt = high_digits(y, p);
+        GcdMatrix m;
+        hgcd(xt, yt, m);
+        if (!m.is_identity())
+            apply(m, x, y, &t);
+    }
+    if (y.data.len <= s)
+        return;
+
+    // A division makes progress when the quotient was too big for the matrix
+    division_step(x, y, &t);
+    if (y.data.len <= s)
+        return;
+
+    // Then the top 2 (len - s) digits decide the rest
+    int p2 = 2 * s - x.data.len;
+    if (p2 > 0 && x.data.len - p2 > 2)
+    {
+        Num xt = high_digits(x, p2), yt = high_digits(y, p2);
+        GcdMatrix m;
+        hgcd(xt, yt, m);
+        if (!m.is_identity())
+            apply(m, x, y, &t);
+    }
+
+    // The leading digits can leave the last few steps undone
+    lehmer_reduce(x, y, &t, s);
+}
+
+// Reduce until y has at most s digits, with half-GCDs while y is large
+static void reduce(Num& x, Num& y, GcdMatrix* t, int s)
+{
+    while (y.data.len > s)
+    {
+        int n = x.data.len;
+        if (y.data.len < gcd_hgcd_threshold)
+        {
+            lehmer_reduce(x, y, t, s);
+            return;
+        }
+
+        // Unbalanced, or no progress from the leading digits: divide
+        GcdMatrix m;
+        if (y.data.len >= n - n / 4)
+        {
+            int p = n / 3;
+            Num xt = high_digits(x, p), yt = high_digits(y, p);
+            hgcd(xt, yt, m);
+        }
+        if (m.is_identity())
+            division_step(x, y, t);
+        else
+            apply(m, x, y, t);
+    }
+}
+
+// ======================================================================================
+
+Num gcd(const NumView& a, const NumView& b)
+{
+    Num x{a}, y{b};
+    x.data.sign = 0;
+    y.data.sign = 0;
+    if (x.magcmp(y) < 0)
+        std::swap(x, y);
+
+    reduce(x, y, nullptr, 2);
+    if (y.data.len == 0)
+        return x;
+
+    uint64_t v = y.small_magnitude();
+    uint64_t u = x.is_small() ? x.small_magnitude() % v : divmod_1(x, Reciprocal<uint64_t>(v));
+    return Num((unsigned long long) gcd_64(u, v));
+}
+
+Num gcdext(const NumView& a, const NumView& b, Num& s, Num& t)
+{
+    if (b.len == 0 || a.len == 0)
+    {
+        s = a.len == 0 ? 0 : a.sign ? -1 : 1;
+        t = a.len != 0 ? 0 : b.sign ? -1 : 1;
+        if (b.len == 0 && a.len == 0)
+            t = 0;
+        Num g{a.len == 0 ? b : a};
+        g.data.sign = 0;
+        return g;
+    }
+
+    Num x{a}, y{b};
+    x.data.sign = 0;
+    y.data.sign = 0;
+    bool swapped = x.magcmp(y) < 0;
+    if (swapped)
+        std::swap(x, y);
+
+    GcdMatrix m;
+    reduce(x, y, &m, 0);
+    Num g = std::move(x);
+
+    // g = m00 x0 + m01 y0. Move s into (-m/2, m/2] for m = |b| / g, which gives the
+    // smallest cofactors, and find t from it.
+    Num abs_a{a}, abs_b{b};
+    abs_a.data.sign = 0;
+    abs_b.data.sign = 0;
+    s = swapped ? m.m[0][1] : m.m[0][0];
+
+    Num mod = divexact(abs_b, g);
+    Num q, r;
+    Num abs_s{s};
+    abs_s.data.sign = 0;
+    abs_s.divmod(mod, q, r);
+    if (s.data.sign && r.data.len != 0)
+    {
+        Num flipped = mod;
+        flipped -= r;
+        r = std::move(flipped);
+    }
+    Num twice = r;
+    twice <<= 1;
+    if (magcmp(twice, mod) > 0)
+        r -= mod;
+    s = std::move(r);
+
+    Num rest = g;
+    rest -= multiply(abs_a, s);
+    t = divexact(rest, abs_b);
+
+    if (a.sign)
+        s.negate();
+    if (b.sign)
+        t.negate();
+    return g;
+}
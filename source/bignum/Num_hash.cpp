@@ -0,0 +1,154 @@
+// ======================================================================================
+// Num_hash.cpp
+//
+// Hashing
+//
+// The hash reads the digits as 64-bit words (pairs of digits, zero-padded at the top)
+// and depends only on the value: the digits, the length and the sign. A Num in its
+// small buffer, the same value in a big buffer, and a NumView of serialized digits all
+// hash the same.
+//
+// Short values, which are most hash keys, are mixed with the wyhash multiply-fold: a
+// 64 x 64 -> 128 bit multiply with the halves xored together. Long values go through
+// four accumulator lanes in the style of XXH3, where each word is xored with a key and
+// its 32-bit halves are multiplied together. That step has no carries between lanes,
+// so it runs two lanes per SSE2 register; the scalar loop computes the same thing. The
+// keys change from stripe to stripe, and the lanes are scrambled after each block of
+// stripes, so that reordering words changes the hash.
+// ======================================================================================
+
+#include "Num.h"
+#include "Intrinsics.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NUM_SSE2 1
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NUM_BIG_ENDIAN
+#endif
+
+// Constants from wyhash
+static constexpr uint64_t kP0 = 0xa076'1d64'78bd'642fULL;
+static constexpr uint64_t kP1 = 0xe703'7ed1'a0b4'28dbULL;
+static constexpr uint64_t kP2 = 0x8ebc'6af0'9c88'c6e3ULL;
+static constexpr uint64_t kP3 = 0x5899'65cc'7537'4cc3ULL;
+
+// Accumulator keys: stripe s of a block uses kKeys[s .. s+3], and the scramble uses
+// kKeys[8 .. 11] (random 64-bit values)
+static constexpr int kStripeWords = 4;
+static constexpr int kBlockStripes = 8;
+static constexpr uint64_t kKeys[kBlockStripes + kStripeWords] = {
+    0xbe4b'a423'396c'feb8ULL, 0x1cad'21f7'2c81'017cULL, 0xdb97'9083'e96d'd4deULL, 0x1f67'b3b7'a4a4'4072ULL,
+    0x78e5'c0cc'4ee6'79cbULL, 0x2172'ffcc'7dd0'5a82ULL, 0x8e24'43f7'7444'69d6ULL, 0x90a2'7b5c'd6a9'd2a5ULL,
+    0xc8f2'a58f'6bb2'9ae9ULL, 0x3e9c'4587'6a0c'b2bfULL, 0xfc6d'b4c3'46e8'2d3dULL, 0x5a1c'57ea'4ef1'df9bULL,
+};
+
+// The wyhash mix
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+    uint64_t hi;
+    uint64_t lo = mul64(a, b, &hi);
+    return lo ^ hi;
+}
+
+// Read n digits (at most 2 * count) as count words, zero-padding the rest
+static inline void load_words(uint64_t* w, const uint32_t* d, int n, int count)
+{
+    for (int j = 0; j < count; j++)
+    {
+        uint64_t lo = 2 * j < n ? d[2 * j] : 0;
+        uint64_t hi = 2 * j + 1 < n ? d[2 * j + 1] : 0;
+        w[j] = (hi << 32) | lo;
+    }
+}
+
+// acc[j] += w[j ^ 1] + lo32(w[j] ^ key[j]) * hi32(w[j] ^ key[j]) for one stripe
+static inline void accumulate_scalar(uint64_t* acc, const uint64_t* w, const uint64_t* key)
+{
+    for (int j = 0; j < kStripeWords; j++)
+    {
+        uint64_t x = w[j] ^ key[j];
+        acc[j] += w[j ^ 1] + (x & 0xFFFF'FFFF) * (x >> 32);
+    }
+}
+
+static inline void scramble(uint64_t* acc)
+{
+    for (int j = 0; j < kStripeWords; j++)
+        acc[j] = (acc[j] ^ (acc[j] >> 47) ^ kKeys[kBlockStripes + j]) * kP0;
+}
+
+// Accumulate the whole stripes of n digits (n is a multiple of 2 * kStripeWords)
+static void accumulate(uint64_t* acc, const uint32_t* d, int n)
+{
+    int stripes = n / (2 * kStripeWords);
+
+    #if defined(NUM_SSE2) && !defined(NUM_BIG_ENDIAN)
+    __m128i a0 = _mm_loadu_si128((const __m128i*) acc);
+    __m128i a1 = _mm_loadu_si128((const __m128i*) (acc + 2));
+    for (int s = 0; s < stripes; s++)
+    {
+        const uint64_t* key = kKeys + s % kBlockStripes;
+        __m128i w0 = _mm_loadu_si128((const __m128i*) (d + 2 * kStripeWords * s));
+        __m128i w1 = _mm_loadu_si128((const __m128i*) (d + 2 * kStripeWords * s + 4));
+        __m128i x0 = _mm_xor_si128(w0, _mm_loadu_si128((const __m128i*) key));
+        __m128i x1 = _mm_xor_si128(w1, _mm_loadu_si128((const __m128i*) (key + 2)));
+
+        // _mm_mul_epu32 multiplies the low halves of each 64-bit lane
+        __m128i p0 = _mm_mul_epu32(x0, _mm_srli_epi64(x0, 32));
+        __m128i p1 = _mm_mul_epu32(x1, _mm_srli_epi64(x1, 32));
+        a0 = _mm_add_epi64(a0, _mm_add_epi64(p0, _mm_shuffle_epi32(w0, _MM_SHUFFLE(1, 0, 3, 2))));
+        a1 = _mm_add_epi64(a1, _mm_add_epi64(p1, _mm_shuffle_epi32(w1, _MM_SHUFFLE(1, 0, 3, 2))));
+
+        if (s % kBlockStripes == kBlockStripes - 1)
+        {
+            _mm_storeu_si128((__m128i*) acc, a0);
+            _mm_storeu_si128((__m128i*) (acc + 2), a1);
+            scramble(acc);
+            a0 = _mm_loadu_si128((const __m128i*) acc);
+            a1 = _mm_loadu_si128((const __m128i*) (acc + 2));
+        }
+    }
+    _mm_storeu_si128((__m128i*) acc, a0);
+    _mm_storeu_si128((__m128i*) (acc + 2), a1);
+    #else
+    for (int s = 0; s < stripes; s++)
+    {
+        uint64_t w[kStripeWords];
+        load_words(w, d + 2 * kStripeWords * s, 2 * kStripeWords, kStripeWords);
+        accumulate_scalar(acc, w, kKeys + s % kBlockStripes);
+        if (s % kBlockStripes == kBlockStripes - 1)
+            scramble(acc);
+    }
+    #endif
+}
+
+uint64_t hash_value(const NumView& n, uint64_t seed)
+{
+    uint64_t h = mix(seed ^ kP0, ((uint64_t(n.len) << 1) | (n.sign ? 1 : 0)) ^ kP1);
+
+    uint64_t w[kStripeWords];
+    if (n.len <= 2 * kStripeWords)
+    {
+        load_words(w, n.digits, n.len, kStripeWords);
+        h = mix(w[0] ^ kP1, w[1] ^ h);
+        h = mix(w[2] ^ kP2, w[3] ^ h);
+    }
+    else
+    {
+        uint64_t acc[kStripeWords] = { kP0, kP1, kP2, kP3 };
+        int whole = n.len - n.len % (2 * kStripeWords);
+        accumulate(acc, n.digits, whole);
+        if (whole != n.len)
+        {
+            load_words(w, n.digits + whole, n.len - whole, kStripeWords);
+            accumulate_scalar(acc, w, kKeys + kStripeWords);
+        }
+        h = mix(acc[0] ^ kP1, acc[1] ^ h);
+        h = mix(acc[2] ^ kP2, acc[3] ^ h);
+    }
+
+    return mix(h ^ kP3, h ^ kP0 ^ seed);
+}
@@ -5,6 +5,9 @@
 // ======================================================================================
 
 #include "Num.h"
+#include "Digits.h"
+#include "Intrinsics.h"
+#include "Reciprocal.h"
 
 #include <cassert>
 #include <cstring>
@@ -28,9 +31,55 @@
 // any seen to that point, so we can just store it rather than add it.
 // ======================================================================================
 
+// r = a * b
+// r must have room for an+bn digits and must not overlap a or b.
+void MultiwordMultiply(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn)
+{
+    mul_digits(r, a, an, b, bn);
+}
+
+// r = a * a
+// r must have room for 2*an digits and must not overlap a.
+//
+// Squaring only needs about half the digit multiplies of a general multiply, because
+// the cross products a[i]*a[j] and a[j]*a[i] are equal. We sum the cross products with
+// i < j once, double the sum with a shift, and then add in the squares a[i]*a[i].
+void MultiwordSquare(uint32_t* r, const uint32_t* a, int an)
+{
+    if (an == 0)
+        return;
+
+    // Cross products
+    memset(r, 0, 2 * an * sizeof(uint32_t));
+    for (int i = 0; i < an - 1; i++)
+        r[i+an] = mul_add_digit(r + 2*i + 1, a + i + 1, an - i - 1, a[i]);
+
+    // Double them
+    uint32_t top = 0;
+    for (int i = 0; i < 2 * an; i++)
+    {
+        uint32_t d = r[i];
+        r[i] = (d << 1) | top;
+        top = d >> 31;
+    }
+
+    // Add the squares on the diagonal
+    unsigned long long carry = 0;
+    for (int i = 0; i < an; i++)
+    {
+        uint64_t sq = uint64_t(a[i]) * uint64_t(a[i]);
+        carry = carry + r[2*i] + (sq & 0xFFFF'FFFF);
+        r[2*i] = (uint32_t) carry;
+        carry >>= 32;
+        carry = carry + r[2*i+1] + (sq >> 32);
+        r[2*i+1] = (uint32_t) carry;
+        carry >>= 32;
+    }
+}
+
 // Num * Num
 // Create a temp and then just call operator*=()
-Num Num::operator*(const Num& rhs)
+Num Num::operator*(const Num& rhs) const
 {
     Num temp{*this};
     return temp.operator*=(rhs);
@@ -40,58 +89,97 @@ Num Num::operator*(const Num& rhs)
 // Grow the lhs Num as needed
 Num& Num::operator*=(const Num& rhs)
 {
-    // Even though this is lhs *= rhs, we need to move the lhs to a temp value because
-    // we are going to write to parts of lhs constantly during the computation.
-    Num multiplicand{*this};
-
-    // We cannot clear out the lhs yet, because it could be the rhs as well
-    // (e.g. n *= n). So set up a temp to accumulate into that we will move into
-    // *this at the end.
-    Num lhs;
-
-    auto candbuf = multiplicand.cdatabuffer();
-    auto plierbuf = rhs.cdatabuffer();
-
-    // Now wipe out our lhs and resize it to hold the result - m digits from rhs, and
-    // m digits from lhs (we may end up with less, depending on the actual multiply).
-    int m = rhs.data.len;
-    int n = multiplicand.data.len;
+    // Both fit in 64 bits, so the product fits in 128
+    if (is_small() && rhs.is_small())
+    {
+        NUM_COUNT_OP(NumOp::Mul, data.len + rhs.data.len);
+        uint64_t hi;
+        uint64_t lo = mul64(small_magnitude(), rhs.small_magnitude(), &hi);
+        set_small(lo, hi, (data.sign == rhs.data.sign) ? 0 : -1);
+        return *this;
+    }
 
-    lhs.resize(m + n);
-    lhs.data.clear_digits(0, n); // initialize |multiplicand| digits to zero (initial partial sums)
-    auto lbuf = lhs.databuffer();
+    *this = multiply(*this, rhs);
+    return *this;
+}
 
-    // Loop through each digit of the multiplier
-    for (int j = 0; j < m; j++)
-    {
-        // Multiply each digit of the multiplicand against this digit of the multiplier,
-        // add new digits to the result, and save the carry into the next digit.
-        unsigned long long carry = 0;
-        for (int i = 0; i < n; i++)
-        {
-            // This won't overflow:
-            // (2^n-1)*(2^n-1) + (2^n-1) =
-            // = 2^(2n) - 2*(2^n-1) + 1
-            // = 2^(2n) - 2^n + 1
-            // = 2^(2n-1) + 1 < 2^(2n)-1
-            carry = carry + uint64_t(lbuf[i+j]) + uint64_t(plierbuf[j]) * uint64_t(candbuf[i]);
-            lbuf[i+j] = (uint32_t) carry;
-            carry >>= 32;
-        }
+// Num * NumView
+Num& Num::operator*=(const NumView& rhs)
+{
+    *this = multiply(*this, rhs);
+    return *this;
+}
 
-        lbuf[j+n] = (uint32_t) carry;
-    }
+// NumView * NumView
+Num multiply(const NumView& lhs, const NumView& rhs)
+{
+    // The result goes in a new Num, since either operand may view the Num the
+    // result is assigned to (e.g. n *= n). It has at most m+n digits (we may end
+    // up with less, depending on the actual multiply).
+    int m = rhs.len;
+    int n = lhs.len;
+    NUM_COUNT_OP(NumOp::Mul, m + n);
+
+    Num result;
+    auto rbuf = result.resize(m + n);
+    if (lhs.digits == rhs.digits && m == n)
+        MultiwordSquare(rbuf, lhs.digits, n);
+    else
+        MultiwordMultiply(rbuf, lhs.digits, n, rhs.digits, m);
 
     // The sign of the result is the exclusive-or of the signs of the operands
-    lhs.data.sign = (multiplicand.data.sign == rhs.data.sign) ? 0 : -1;
+    result.data.sign = (lhs.sign == rhs.sign) ? 0 : -1;
 
     // Now trim the result size down to its actual value, because
     // m+n was the max, not the actual size. We'll have to go at
     // most n places (e.g. n was 1)
-    *this = std::move(lhs);
-    trim();
+    result.trim();
 
-    return *this;
+    return result;
+}
+
+// Num * integer
+// One pass over the digits of a, which may be r: digit i of the product is
+// a[i] * lo + a[i-1] * hi plus the carry, and a[i-1] is kept from the step before.
+void mul_int(Num& r, const Num& a, IntOperand v)
+{
+    NUM_COUNT_OP(NumOp::Mul, a.data.len + 2);
+    int32_t sign = a.data.sign == v.sign ? 0 : -1;
+    if (a.is_small())
+    {
+        uint64_t hi;
+        uint64_t lo = mul64(a.small_magnitude(), v.magnitude, &hi);
+        r.set_small(lo, hi, sign);
+        return;
+    }
+
+    int n = a.data.len;
+    uint32_t lo = uint32_t(v.magnitude);
+    uint32_t hi = uint32_t(v.magnitude >> 32);
+    uint32_t* rd = r.resize(n + 2);
+    const uint32_t* ad = &r == &a ? rd : a.cdatabuffer();
+    if (hi == 0)
+    {
+        rd[n] = mul_digit(rd, ad, n, lo);
+        rd[n + 1] = 0;
+    }
+    else
+    {
+        uint32_t prev = 0;
+        uint64_t carry = 0;
+        for (int i = 0; i < n + 2; i++)
+        {
+            uint32_t cur = i < n ? ad[i] : 0;
+            uint64_t p0 = uint64_t(cur) * lo;
+            uint64_t p1 = uint64_t(prev) * hi;
+            uint64_t sum = (p0 & 0xFFFF'FFFF) + (p1 & 0xFFFF'FFFF) + carry;
+            rd[i] = uint32_t(sum);
+            carry = (sum >> 32) + (p0 >> 32) + (p1 >> 32);
+            prev = cur;
+        }
+    }
+    r.data.sign = sign;
+    r.trim();
 }
 
 // Num * digit
@@ -136,7 +224,7 @@ Num& Num::operator*=(const uint32_t& rhs)
 
 // Num / Num
 // Create a temp and then just call operator/=()
-Num Num::operator/(const Num& rhs)
+Num Num::operator/(const Num& rhs) const
 {
     Num temp{*this};
     return temp.operator/=(rhs);
@@ -155,6 +243,28 @@ Num& Num::operator/=(const Num& rhs)
     return *this;
 }
 
+// Num % Num
+// Create a temp and then just call operator%=()
+Num Num::operator%(const Num& rhs) const
+{
+    Num temp{*this};
+    return temp.operator%=(rhs);
+}
+
+// Num % Num
+// The remainder takes the sign of the dividend, like the C++ % operator.
+Num& Num::operator%=(const Num& rhs)
+{
+    Num quotient;
+    Num remainder;
+    int sign = data.sign;
+    divmod(rhs, quotient, remainder);
+    *this = std::move(remainder);
+    data.sign = data.len != 0 ? sign : 0;
+
+    return *this;
+}
+
 // Num / uint32_t
 // Create a temp and just call operator /=()
 #if 0
@@ -177,6 +287,8 @@ Num& Num::operator/=(const uint32_t& rhs)
 // TBD maybe we should return quotient? Or tuple of quotient, remainder?
 void Num::divmod(const Num& rhs, Num& quotient, Num& remainder)
 {
+    NUM_COUNT_OP(NumOp::Div, data.len + rhs.data.len);
+
     // If dividend is zero, then quotient and remainder are both zero
     if (data.len == 0)
     {
@@ -185,6 +297,33 @@ void Num::divmod(const Num& rhs, Num& quotient, Num& remainder)
         return;
     }
 
+    // Both fit in 64 bits, so use the native divide
+    if (is_small() && rhs.is_small() && rhs.data.len != 0)
+    {
+        uint64_t a = small_magnitude();
+        uint64_t b = rhs.small_magnitude();
+        quotient.set_small(a / b, 0, 0);
+        remainder.set_small(a % b, 0, 0);
+        return;
+    }
+
+    // A single digit divisor divides with a reciprocal instead of a divide per digit
+    if (rhs.data.len == 1)
+    {
+        remainder.set_small(divmod_1(*this, Reciprocal<NativeLimb>(rhs.cdatabuffer()[0]), &quotient), 0, 0);
+        return;
+    }
+
+    // If the divisor is longer than the dividend, the quotient is zero and the
+    // dividend is the remainder
+    if (data.len < rhs.data.len)
+    {
+        remainder = *this;
+        remainder.data.sign = 0;
+        quotient.resize(0);
+        return;
+    }
+
     // resize quotient and remainder as needed
     // these are max sizes, the real quotient and remainder could be smaller
     int dividendSize = data.len;
@@ -195,12 +334,12 @@ void Num::divmod(const Num& rhs, Num& quotient, Num& remainder)
     int scratchSize = divisorSize + dividendSize + 1;
     uint32_t* scratch = nullptr;
     if (scratchSize > 16)
-        scratch = new uint32_t[scratchSize];
+        scratch = num_alloc_digits(scratchSize);
 
     bool ok = MultiwordDivide<uint32_t>(
         quotient.databuffer(), remainder.databuffer(), databuffer(), rhs.cdatabuffer(), data.len, rhs.data.len, scratch);
     assert(ok);
-    delete[] scratch;
+    num_free_digits(scratch);
     if (!ok)
         return; // this is not supposed to ever happen
 
@@ -208,24 +347,245 @@ void Num::divmod(const Num& rhs, Num& quotient, Num& remainder)
     remainder.trim();
 }
 
+// |Num| / integer, with a reciprocal of the divisor
+uint64_t div_int(Num* q, const Num& a, uint64_t m)
+{
+    NUM_COUNT_OP(NumOp::Div, a.data.len + 2);
+    assert(m != 0);
+    if (a.is_small())
+    {
+        uint64_t x = a.small_magnitude();
+        if (q)
+            q->set_small(x / m, 0, 0);
+        return x % m;
+    }
+    if (m <= 0xFFFF'FFFF)
+        return divmod_1(a, Reciprocal<NativeLimb>(NativeLimb(m)), q);
+    return divmod_1(a, Reciprocal<uint64_t>(m), q);
+}
+
 // Num / uint32_t
-#if 0
 uint32_t Num::divmod(uint32_t rhs, Num& quotient)
 {
-    quotient.resize(data.len);
+    NUM_COUNT_OP(NumOp::Div, data.len + 1);
+    return uint32_t(divmod_1(*this, Reciprocal<NativeLimb>(rhs), &quotient));
+}
 
-    auto buf = databuffer();
-    auto qbuf = quotient.databuffer();
+// ======================================================================================
+// Exact division
+//
+// When the divisor is known to divide the dividend, the quotient can be found from the
+// low digits up (Hensel division, see Jebelean, "An algorithm for exact division").
+// With d odd and dinv = 1/d mod 2^32, the low digit of the quotient is just
+// a[0] * dinv; subtracting q[0] * d clears a[0], and the next digit follows the same
+// way. There is no quotient digit estimate and no correction step, and the digits of
+// the dividend above the quotient length are never touched.
+//
+// An even divisor is first shifted right, which leaves the dividend exactly as
+// divisible by the odd part.
+// ======================================================================================
 
-    uint32_t rem = 0;
-    for (int i = data.len - 1; i >= 0; --i)
+Num divexact(const NumView& a, const NumView& b)
+{
+    assert(b.len != 0);
+    if (a.len == 0)
+        return Num();
+
+    Num r{a};
+    Num d{b};
+    r.data.sign = 0;
+    d.data.sign = 0;
+    int s = d.ctz();
+    if (s != 0)
     {
-        uint32_t dig = uint32_t((rem * 0x1'0000'0000LL + buf[i]) / rhs);
-        rem = uint64_t(buf[i]) - uint64_t(dig * rhs);
-        qbuf[i] = dig;
+        r >>= s;
+        d >>= s;
     }
 
-    quotient.trim();
-    return rem;
+    int rn = r.data.len;
+    int dn = d.data.len;
+    int qn = rn - dn + 1;
+    Num q;
+    if (qn <= 0)
+        return q;
+
+    uint32_t* qd = q.resize(qn);
+    uint32_t* rd = r.databuffer();
+    const uint32_t* dd = d.cdatabuffer();
+    uint32_t dinv = inverse_digit(dd[0]);
+
+    if (dn == 1)
+    {
+        // A single digit divisor keeps the running borrow in a register
+        uint32_t d0 = dd[0];
+        uint32_t c = 0;
+        for (int i = 0; i < qn; i++)
+        {
+            uint32_t x = rd[i] - c;
+            c = x > rd[i] ? 1 : 0;
+            qd[i] = x * dinv;
+            c += uint32_t((uint64_t(qd[i]) * d0) >> 32);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < qn; i++)
+        {
+            qd[i] = rd[i] * dinv;
+
+            // Only the low qn digits of the remainder are ever read
+            int n = dn < qn - i ? dn : qn - i;
+            uint32_t borrow = sub_mul_digit(rd + i, dd, n, qd[i]);
+            if (i + n < qn)
+                sub_digit(rd + i + n, rd + i + n, qn - i - n, borrow);
+        }
+    }
+
+    q.trim();
+    q.data.sign = (q.data.len != 0 && a.sign != b.sign) ? -1 : 0;
+    return q;
+}
+
+// Divisibility by a single digit. For odd d this is the exact division loop above,
+// run over 64-bit pairs of digits, keeping only the borrow: with Q the quotient
+// digits it produces, Q * d = a - c * 2^(64*n), so d divides a exactly when d divides
+// the final c. Each step leaves c in [0, d], so that means c is 0 or d.
+bool divisible_by(const NumView& a, uint32_t d)
+{
+    assert(d != 0);
+    if (a.len == 0)
+        return true;
+
+    // 2^k divides a when its low k bits are zero; the odd part of d is coprime to
+    // 2^k, so then only it remains to be checked
+    int k = ctz32(d);
+    if ((a.digits[0] & ((uint32_t(1) << k) - 1)) != 0)
+        return false;
+    uint64_t odd = d >> k;
+    if (odd == 1)
+        return true;
+
+    uint64_t dinv = inverse_digit64(odd);
+    uint64_t c = 0;
+    for (int i = 0; i < a.len; i += 2)
+    {
+        uint64_t s = a.digits[i];
+        if (i + 1 < a.len)
+            s |= uint64_t(a.digits[i + 1]) << 32;
+        uint64_t x = s - c;
+        c = x > s ? 1 : 0;
+        uint64_t hi;
+        mul64(x * dinv, odd, &hi);
+        c += hi;
+    }
+    return c == 0 || c == odd;
+}
+
+// ======================================================================================
+// Division by a single limb
+//
+// Each step divides the running remainder and the next limb (two limbs in all) by
+// the divisor, from the top down, using the reciprocal in Reciprocal.h. A 64-bit limb
+// is a pair of digits, which halves the number of steps; on a machine with a 64-bit
+// multiply, each step costs about the same as a 32-bit one.
+// ======================================================================================
+
+static void load_limb(uint32_t& limb, const uint32_t* p) { limb = p[0]; }
+static void load_limb(uint64_t& limb, const uint32_t* p) { limb = (uint64_t(p[1]) << 32) | p[0]; }
+static void store_limb(uint32_t* p, uint32_t limb) { p[0] = limb; }
+static void store_limb(uint32_t* p, uint64_t limb) { p[0] = uint32_t(limb); p[1] = uint32_t(limb >> 32); }
+
+template<typename Limb>
+static Limb divmod_limbs(const NumView& a, const Reciprocal<Limb>& divisor, Num* quotient)
+{
+    constexpr int digits_per_limb = sizeof(Limb) / sizeof(uint32_t);
+
+    // A local copy, so that the compiler knows the quotient stores can't change it
+    const Reciprocal<Limb> d = divisor;
+    const uint32_t* ad = a.digits;
+    int i = a.len;
+
+    // Resizing to the same length keeps the digits in place if a views quotient,
+    // and each quotient limb is written after the dividend limb it replaces is read
+    uint32_t* q = quotient != nullptr ? quotient->resize(i) : nullptr;
+
+    // The remainder is carried shifted left by d.shift
+    Limb rn = 0;
+
+    // An odd top digit is a limb by itself
+    if (digits_per_limb == 2 && (i & 1) != 0)
+    {
+        i -= 1;
+        uint32_t qi = uint32_t(d.divrem_shifted(rn, ad[i]));
+        if (q != nullptr)
+            q[i] = qi;
+    }
+
+    while (i > 0)
+    {
+        i -= digits_per_limb;
+        Limb limb;
+        load_limb(limb, ad + i);
+        Limb qi = d.divrem_shifted(rn, limb);
+        if (q != nullptr)
+            store_limb(q + i, qi);
+    }
+
+    if (quotient != nullptr)
+    {
+        quotient->trim();
+        quotient->data.sign = 0;
+    }
+    return rn >> d.shift;
+}
+
+// The remainders for different divisors don't depend on each other, so running them
+// side by side in the inner loop overlaps their multiply latencies.
+template<typename Limb>
+static void mod_limbs(Limb* rems, const NumView& a, const Reciprocal<Limb>* divisors, int count)
+{
+    constexpr int digits_per_limb = sizeof(Limb) / sizeof(uint32_t);
+
+    for (int k = 0; k < count; k++)
+        rems[k] = 0;
+
+    int i = a.len;
+    if (digits_per_limb == 2 && (i & 1) != 0)
+    {
+        i -= 1;
+        for (int k = 0; k < count; k++)
+            divisors[k].divrem_shifted(rems[k], a.digits[i]);
+    }
+
+    while (i > 0)
+    {
+        i -= digits_per_limb;
+        Limb limb;
+        load_limb(limb, a.digits + i);
+        for (int k = 0; k < count; k++)
+            divisors[k].divrem_shifted(rems[k], limb);
+    }
+
+    for (int k = 0; k < count; k++)
+        rems[k] >>= divisors[k].shift;
+}
+
+uint32_t divmod_1(const NumView& a, const Reciprocal<uint32_t>& d, Num* quotient)
+{
+    return divmod_limbs(a, d, quotient);
+}
+
+uint64_t divmod_1(const NumView& a, const Reciprocal<uint64_t>& d, Num* quotient)
+{
+    return divmod_limbs(a, d, quotient);
+}
+
+void mod_1(uint32_t* rems, const NumView& a, const Reciprocal<uint32_t>* divisors, int count)
+{
+    mod_limbs(rems, a, divisors, count);
+}
+
+void mod_1(uint64_t* rems, const NumView& a, const Reciprocal<uint64_t>* divisors, int count)
+{
+    mod_limbs(rems, a, divisors, count);
 }
-#endif
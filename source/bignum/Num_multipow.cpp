@@ -0,0 +1,370 @@
+// ======================================================================================
+// Num_multipow.cpp
+//
+// Multi-exponentiation: b1^e1 * b2^e2 * ... * bn^en with one chain of squarings
+//
+// Computing each power on its own costs a squaring per exponent bit for every base.
+// Here all the powers are built up in one accumulator from the top bit down, so the
+// squarings are paid once, and only the multiplies by the bases are per base. Two
+// methods are used:
+//
+// - Straus (Shamir's trick, with sliding windows): each base gets a table of its odd
+//   powers, and each exponent is cut into windows ahead of time. At each bit the
+//   accumulator is squared and multiplied by the table entry of every window ending
+//   there. This is the method for a few bases, like g^a * h^b.
+//
+// - Pippenger (the bucket method): the exponents are read c bits at a time, and for
+//   each window every base is multiplied into the bucket of its digit. The buckets
+//   are combined into prod B[d]^d with two running products, which takes 2 * 2^c
+//   multiplies whatever the number of bases. For many bases this is far fewer than
+//   Straus's table entries and multiplies.
+//
+// The cost of each is estimated in multiplies, and the cheaper one is used. The same
+// code runs on Montgomery values and on plain Nums (with or without a modulus),
+// through a small class of operations for each.
+// ======================================================================================
+
+#include "Num.h"
+#include "Montgomery.h"
+
+#include <cassert>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Exact products of Nums
+struct NumOps
+{
+    using Element = Num;
+    Num one() const { return Num(1); }
+    void mul(Num& r, const Num& a, const Num& b) const { r = multiply(a, b); }
+};
+
+// Products of Nums modulo an (even) modulus, with a divide after each one
+struct NumModOps
+{
+    using Element = Num;
+    const Num& modulus;
+    Num one() const { return Num(1); }
+    void mul(Num& r, const Num& a, const Num& b) const
+    {
+        r = multiply(a, b);
+        r %= modulus;
+    }
+};
+
+// A value in Montgomery form: a fixed number of digits from num_alloc_digits, so the
+// tables and accumulators are seen by the allocation counters
+class MontDigits
+{
+public:
+    MontDigits() {}
+    explicit MontDigits(int n) : n(n), d(n != 0 ? num_alloc_digits(n) : nullptr) {}
+    MontDigits(const uint32_t* src, int n) : MontDigits(n) { copy_from(src); }
+    MontDigits(const MontDigits& rhs) : MontDigits(rhs.d, rhs.n) {}
+    MontDigits(MontDigits&& rhs) noexcept { swap(rhs); }
+    ~MontDigits() { num_free_digits(d); }
+
+    // Reuses the digits when the sizes match, which they do after the first time
+    MontDigits& operator=(const MontDigits& rhs)
+    {
+        if (this == &rhs)
+            return *this;
+        if (n != rhs.n)
+            MontDigits(rhs.n).swap(*this);
+        copy_from(rhs.d);
+        return *this;
+    }
+    MontDigits& operator=(MontDigits&& rhs) noexcept
+    {
+        swap(rhs);
+        return *this;
+    }
+
+    uint32_t* data() { return d; }
+    const uint32_t* data() const { return d; }
+
+private:
+    void copy_from(const uint32_t* src)
+    {
+        if (n != 0)
+            memcpy(d, src, size_t(n) * sizeof(uint32_t));
+    }
+    void swap(MontDigits& rhs)
+    {
+        std::swap(n, rhs.n);
+        std::swap(d, rhs.d);
+    }
+
+    int n = 0;
+    uint32_t* d = nullptr;
+};
+
+// Products in Montgomery form
+struct MontOps
+{
+    using Element = MontDigits;
+    const Montgomery& m;
+    Element one() const
+    {
+        Element e(m.size());
+        m.one(e.data());
+        return e;
+    }
+    void mul(Element& r, const Element& a, const Element& b) const { m.mul(r.data(), a.data(), b.data()); }
+};
+
+// c bits of e starting at bit pos (c <= 32)
+static uint32_t exponent_bits(const Num& e, int pos, int c)
+{
+    const uint32_t* d = e.cdatabuffer();
+    int len = e.data.len;
+    int i = pos / 32;
+    int s = pos % 32;
+    uint64_t lo = i < len ? d[i] : 0;
+    uint64_t hi = i + 1 < len ? d[i + 1] : 0;
+    return uint32_t((((hi << 32) | lo) >> s) & ((uint64_t(1) << c) - 1));
+}
+
+// The sliding window width that costs the fewest multiplies for an exponent: a table
+// of 2^(w-1) odd powers, then about one multiply per w+1 bits
+static int straus_window(int bits, int* cost)
+{
+    int best = 1;
+    *cost = bits;
+    for (int w = 2; w <= 8; w++)
+    {
+        int c = (1 << (w - 1)) + bits / (w + 1);
+        if (c < *cost)
+        {
+            *cost = c;
+            best = w;
+        }
+    }
+    return best;
+}
+
+template<typename Ops>
+static typename Ops::Element straus(const Ops& ops, const typename Ops::Element* bases, const Num* exps, int count, int bits)
+{
+    using Element = typename Ops::Element;
+
+    // For each base, its odd powers b, b^3, ... b^(2^w - 1), and for each bit of its
+    // exponent the odd window value that ends there (0 for none)
+    std::vector<std::vector<Element>> tables(count);
+    std::vector<std::vector<uint8_t>> windows(count);
+    for (int i = 0; i < count; i++)
+    {
+        int ebits = exps[i].bit_length();
+        if (ebits == 0)
+            continue;
+        int cost;
+        int w = straus_window(ebits, &cost);
+
+        std::vector<Element>& table = tables[i];
+        table.resize(size_t(1) << (w - 1));
+        table[0] = bases[i];
+        if (table.size() > 1)
+        {
+            Element square = ops.one();
+            ops.mul(square, bases[i], bases[i]);
+            for (size_t j = 1; j < table.size(); j++)
+            {
+                table[j] = table[j - 1];
+                ops.mul(table[j], table[j - 1], square);
+            }
+        }
+
+        std::vector<uint8_t>& win = windows[i];
+        win.assign(size_t(bits), 0);
+        for (int top = ebits - 1; top >= 0; )
+        {
+            if (!exps[i].test_bit(top))
+            {
+                top--;
+                continue;
+            }
+            int low = top - w + 1 < 0 ? 0 : top - w + 1;
+            while (!exps[i].test_bit(low))
+                low++;
+            win[low] = uint8_t(exponent_bits(exps[i], low, top - low + 1));
+            top = low - 1;
+        }
+    }
+
+    Element acc = ops.one();
+    bool started = false;
+    for (int pos = bits - 1; pos >= 0; pos--)
+    {
+        if (started)
+            ops.mul(acc, acc, acc);
+        for (int i = 0; i < count; i++)
+        {
+            int d = windows[i].empty() ? 0 : windows[i][pos];
+            if (d == 0)
+                continue;
+            if (started)
+                ops.mul(acc, acc, tables[i][d >> 1]);
+            else
+                acc = tables[i][d >> 1];
+            started = true;
+        }
+    }
+    return acc;
+}
+
+template<typename Ops>
+static typename Ops::Element pippenger(const Ops& ops, const typename Ops::Element* bases, const Num* exps, int count, int bits, int c)
+{
+    using Element = typename Ops::Element;
+
+    std::vector<Element> buckets(size_t(1) << c, ops.one());
+    std::vector<bool> used(buckets.size());
+    Element running = ops.one(), total = ops.one();
+
+    Element acc = ops.one();
+    bool started = false;
+    for (int pos = (bits - 1) / c * c; pos >= 0; pos -= c)
+    {
+        if (started)
+            for (int s = 0; s < c; s++)
+                ops.mul(acc, acc, acc);
+
+        std::fill(used.begin(), used.end(), false);
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t d = exponent_bits(exps[i], pos, c);
+            if (d == 0)
+                continue;
+            if (used[d])
+                ops.mul(buckets[d], buckets[d], bases[i]);
+            else
+                buckets[d] = bases[i];
+            used[d] = true;
+        }
+
+        // prod B[d]^d = prod over d of (B[d] * B[d+1] * ... * B[top])
+        bool have_running = false, have_total = false;
+        for (size_t d = buckets.size() - 1; d > 0; d--)
+        {
+            if (used[d])
+            {
+                if (have_running)
+                    ops.mul(running, running, buckets[d]);
+                else
+                    running = buckets[d];
+                have_running = true;
+            }
+            if (have_running)
+            {
+                if (have_total)
+                    ops.mul(total, total, running);
+                else
+                    total = running;
+                have_total = true;
+            }
+        }
+
+        if (have_total)
+        {
+            if (started)
+                ops.mul(acc, acc, total);
+            else
+                acc = total;
+            started = true;
+        }
+    }
+    return acc;
+}
+
+template<typename Ops>
+static typename Ops::Element multi_pow_with(const Ops& ops, const typename Ops::Element* bases, const Num* exps, int count)
+{
+    int bits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        assert(!exps[i].data.sign && "negative exponent");
+        int b = exps[i].bit_length();
+        bits = b > bits ? b : bits;
+    }
+    if (bits == 0)
+        return ops.one();
+
+    // Multiplies beyond the squarings, which both methods share
+    int64_t straus_cost = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int cost;
+        straus_window(exps[i].bit_length(), &cost);
+        straus_cost += cost;
+    }
+
+    int best_c = 0;
+    int64_t pippenger_cost = straus_cost;
+    for (int c = 1; c <= 16; c++)
+    {
+        int64_t cost = int64_t((bits + c - 1) / c) * (count + (int64_t(2) << c));
+        if (cost < pippenger_cost)
+        {
+            pippenger_cost = cost;
+            best_c = c;
+        }
+    }
+
+    if (best_c == 0)
+        return straus(ops, bases, exps, count, bits);
+    return pippenger(ops, bases, exps, count, bits, best_c);
+}
+
+// ======================================================================================
+
+Num multi_pow(const Num* bases, const Num* exps, int count)
+{
+    return multi_pow_with(NumOps{}, bases, exps, count);
+}
+
+Num multi_pow_mod(const Num* bases, const Num* exps, int count, const Num& modulus)
+{
+    assert(modulus.data.len != 0 && !modulus.data.sign && "modulus must be positive");
+
+    // The bases reduced into [0, modulus)
+    Num m = modulus;
+    std::vector<Num> reduced(bases, bases + count);
+    for (Num& b : reduced)
+    {
+        bool negative = b.data.sign != 0;
+        b.data.sign = 0;
+        if (b.magcmp(m) >= 0)
+            b %= m;
+        if (negative && b.data.len != 0)
+            b = m - b;
+    }
+
+    if (m.data.len == 1 && m.cdatabuffer()[0] == 1)
+        return Num();
+
+    if (!m.test_bit(0))
+    {
+        Num r = multi_pow_with(NumModOps{m}, reduced.data(), exps, count);
+        if (r.magcmp(m) >= 0)
+            r %= m;
+        return r;
+    }
+
+    Montgomery mont(m);
+    std::vector<MontOps::Element> mbases(count, MontOps::Element(mont.size()));
+    for (int i = 0; i < count; i++)
+        mont.to_mont(mbases[i].data(), reduced[i]);
+    MontOps::Element r = multi_pow_with(MontOps{mont}, mbases.data(), exps, count);
+    return mont.from_mont(r.data());
+}
+
+void Montgomery::multi_pow(uint32_t* r, const uint32_t* const* bases, const Num* exps, int count) const
+{
+    std::vector<MontOps::Element> b;
+    b.reserve(size_t(count));
+    for (int i = 0; i < count; i++)
+        b.emplace_back(bases[i], k);
+    MontOps::Element result = multi_pow_with(MontOps{*this}, b.data(), exps, count);
+    copy(r, result.data());
+}
@@ -8,78 +8,225 @@
 // ======================================================================================
 
 #include "Num.h"
+#include "Intrinsics.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// Pick the sliding window width for an exponent of the given bit length. Wider windows
+// need a bigger table of odd powers but save multiplies; these are the usual crossover
+// points where the table cost (2^(k-1) multiplies) is paid back.
+static int window_bits(int ebits)
+{
+    if (ebits > 671) return 6;
+    if (ebits > 239) return 5;
+    if (ebits > 79) return 4;
+    if (ebits > 23) return 3;
+    if (ebits > 6) return 2;
+    return 1;
+}
+
+// r = a * b or r = a * a without any allocation in r as long as it already has
+// the capacity. The result is left trimmed and positive.
+static void mul_into(Num& r, const Num& a, const Num& b)
+{
+    uint32_t* rbuf = r.resize(a.data.length() + b.data.length());
+    if (&a == &b)
+        MultiwordSquare(rbuf, a.cdatabuffer(), a.data.length());
+    else
+        MultiwordMultiply(rbuf, a.cdatabuffer(), a.data.length(), b.cdatabuffer(), b.data.length());
+    r.data.sign = 0;
+    r.trim();
+}
 
-Num Num::operator^(const Num& rhs)
+Num Num::operator^(const Num& rhs) const
 {
     Num temp{*this};
     return temp.operator^=(rhs);
 }
 
+// Exponentiation
+//
+// We split the base into its odd part and a power of two, b = m * 2^t, so that
+// b^n = m^n * 2^(t*n). The power of two is just a shift at the end, which means that
+// powers of two (including 2^n) cost nothing more than writing the result, and the
+// exponent is only limited by the size a Num can hold.
+//
+// m^n is done with left-to-right sliding windows: we precompute the odd powers
+// m, m^3, ..., m^(2^k - 1), and then scan the exponent from the top bit down, squaring
+// once per bit and multiplying once per window. The running value ping-pongs between
+// two Nums reserved for the final size, so nothing is allocated inside the loop.
 Num& Num::operator^=(const Num& rhs)
 {
-    // there isn't enough memory to handle exponents this big
-    if (rhs.data.len > 1 || rhs.cdatabuffer()[0] >= (1ULL << 31))
+    int sign = data.sign;
+    bool odd = rhs.data.len != 0 && (rhs.cdatabuffer()[0] & 1) != 0;
+    bool unit = data.len == 1 && cdatabuffer()[0] == 1;
+
+    // x^0 == 1 (including 0^0)
+    if (rhs.data.len == 0)
+    {
+        *this = 1;
+        return *this;
+    }
+
+    // Negative exponents give 1/b^n, which truncates to zero except for b = +-1
+    if (rhs.data.sign != 0)
+    {
+        assert(data.len != 0 && "zero to a negative power");
+        if (!unit)
+            *this = 0;
+        else
+            data.sign = odd ? sign : 0;
+        return *this;
+    }
+
+    // 0^n == 0, 1^n == 1, (-1)^n == +-1, for any size of n
+    if (data.len == 0)
+        return *this;
+    if (unit)
+    {
+        data.sign = odd ? sign : 0;
+        return *this;
+    }
+
+    // Anything else needs at least n bits, so n has to fit in 64 bits
+    if (rhs.data.len > 2)
+    {
+        assert(!"can't handle");
+        return *this;
+    }
+    uint64_t n = rhs.to_uint64();
+
+    // Split off the power of two
+    int t = ctz();
+    Num m{*this};
+    m.data.sign = 0;
+    m >>= t;
+    int mbits = m.bit_length();
+
+    // Make sure the result can be represented: m^n has at most mbits*n bits (one bit
+    // when m is 1), so the result has at most zbits more, and the shift needs a digit
+    // to spare. Each product is checked before it is computed, so nothing wraps.
+    uint64_t limit = uint64_t(NumBuffer::maxlen) * 32 - 32;
+    uint64_t mterm = mbits > 1 ? uint64_t(mbits) : 0;
+    if (n > limit || (t != 0 && n > limit / uint64_t(t)))
+    {
+        assert(!"can't handle");
+        return *this;
+    }
+    uint64_t zbits = uint64_t(t) * n; // multiplied by 2^zbits at the end
+    if (mterm != 0 ? n > (limit - zbits) / mterm : zbits + 1 > limit)
     {
         assert(!"can't handle");
         return *this;
     }
+    int mdigits = int((uint64_t(mbits) * n) / 32 + 1);
 
-    uint32_t n = rhs.cdatabuffer()[0];
     Num y = 1;
-    Num p = std::move(*this);
-
-    for (; n != 0; p *= p)
+    if (mbits > 1)
     {
-        if (n & 1)
-            y = p * y;
-        n >>= 1;
+        int ebits = 64 - clz64(n);
+        int k = window_bits(ebits);
+
+        // Odd powers m^1, m^3, ... m^(2^k - 1)
+        int tsize = 1 << (k - 1);
+        std::vector<Num> table(tsize);
+        table[0] = std::move(m);
+        if (tsize > 1)
+        {
+            Num m2;
+            mul_into(m2, table[0], table[0]);
+            for (int i = 1; i < tsize; i++)
+                mul_into(table[i], table[i - 1], m2);
+        }
+
+        Num scratch;
+        y.reserve(mdigits + 1);
+        scratch.reserve(mdigits + 1);
+
+        bool started = false;
+        int i = ebits - 1;
+        while (i >= 0)
+        {
+            if (((n >> i) & 1) == 0)
+            {
+                mul_into(scratch, y, y);
+                std::swap(y, scratch);
+                i -= 1;
+                continue;
+            }
+
+            // Take the longest window of at most k bits that ends in a 1 bit
+            int l = i - k + 1 < 0 ? 0 : i - k + 1;
+            while (((n >> l) & 1) == 0)
+                l += 1;
+            int w = int((n >> l) & ((uint64_t(1) << (i - l + 1)) - 1));
+
+            if (started)
+            {
+                for (int s = 0; s < i - l + 1; s++)
+                {
+                    mul_into(scratch, y, y);
+                    std::swap(y, scratch);
+                }
+                mul_into(scratch, y, table[w >> 1]);
+                std::swap(y, scratch);
+            }
+            else
+            {
+                y = table[w >> 1];
+                started = true;
+            }
+            i = l - 1;
+        }
     }
 
+    // Multiply by 2^zbits, which can be more than an int shift count
+    for (uint64_t left = zbits; left != 0;)
+    {
+        int step = int(std::min<uint64_t>(left, uint64_t(1) << 30));
+        y <<= step;
+        left -= uint64_t(step);
+    }
     *this = std::move(y);
-    return *this;
-}
 
-Num& Num::operator>>(const int rhs)
-{
-    Num temp{*this};
-    return temp.operator>>=(rhs);
+    data.sign = odd ? sign : 0;
+    return *this;
 }
 
-Num& Num::operator>>=(const int rhs)
+// Square root, from the square root of the top half. If n >> 2k has the root r, then
+// (r + 1) << k is above the root of n, and within 2^k of it, with k a quarter of the
+// length of n. From an overestimate Newton's method goes down to the root without
+// overshooting, and the first step already leaves it within one or two.
+Num isqrt(const NumView& n)
 {
-    uint32_t* buf = databuffer();
-
-    // If we have a trivial shift by zero, just return
-    if (rhs == 0)
-        return *this;
-
-    // shift by digits first
-    int shift = rhs & 0x1F;
-    int dig = rhs >> 5;
-
-    // If we shift past all the data, we just have zero remaining
-    if (dig >= data.len)
+    assert(!n.sign && "square root of a negative number");
+    if (n.len <= 2)
     {
-        data.len = 0;
-        data.sign = 0;
-        return *this;
+        uint64_t v = n.len == 0 ? 0 : n.len == 1 ? n.digits[0] : (uint64_t(n.digits[1]) << 32) | n.digits[0];
+        uint64_t x = uint64_t(std::sqrt(double(v)));
+        while (x != 0 && x > v / x)
+            x--;
+        while (x + 1 <= v / (x + 1))
+            x++;
+        return Num((unsigned long long) x);
     }
 
-    // TBD combine both steps together
-    // Shift whole digits
-    for (int i = 0; i < dig; i++)
-        buf[i] = buf[i+dig];
-    data.len = data.len - dig;
-
-    //  Now shift the bits themselves.
-    for (int i = 0; i < data.len - 1; i++)
-        buf[i] = (buf[i+1] << (32-shift)) | (buf[i] >> shift);
-    buf[data.len - 1] >>= shift;
-
-    // Remove extraneous leading zeros
-    trim();
-
-    return *this;
+    Num a{n};
+    int k = a.bit_length() / 4;
+    Num x = isqrt(a >> (2 * k));
+    x += Num(1);
+    x <<= k;
+    for (;;)
+    {
+        Num y = a / x;
+        y += x;
+        y >>= 1;
+        if (y.magcmp(x) >= 0)
+            return x;
+        x = std::move(y);
+    }
 }
@@ -0,0 +1,434 @@
+// ======================================================================================
+// Num_prime.cpp
+//
+// Primality testing and prime generation
+//
+// is_probable_prime is the Baillie-PSW test: trial division by a table of small
+// primes, then a strong Miller-Rabin test to base 2, then a strong Lucas test with
+// Selfridge's parameters. There is no known composite that passes BPSW, and it has been
+// checked exhaustively up to 2^64. Callers that want extra assurance can ask for more
+// Miller-Rabin rounds on top.
+//
+// All of the modular exponentiation is done in Montgomery form (see Montgomery.cpp),
+// so there are no multiword divides after setup.
+// ======================================================================================
+
+#include "Num.h"
+#include "Montgomery.h"
+#include "Reciprocal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+// ======================================================================================
+// Small prime table
+// ======================================================================================
+
+// The table holds all primes below this bound. Trial division to 2^11 removes about
+// 93% of random odd candidates, which is where the cost of one more remainder pass
+// over the candidate starts to outweigh the chance of avoiding a Miller-Rabin test.
+static constexpr uint32_t kSmallPrimeBound = 2048;
+
+// Primes are grouped so that the product of each group fits in a single limb. We
+// take one remainder pass over the Num for all the groups together, and then get the
+// remainder for each prime in the group from that single-limb remainder. Every
+// divisor has a precomputed reciprocal, so none of this uses a hardware divide.
+struct PrimeGroup
+{
+    NativeLimb product;
+    int first; // index of first prime in the group
+    int count; // number of primes in the group
+};
+
+struct PrimeTable
+{
+    std::vector<uint32_t> primes; // 2, 3, 5, ...
+    std::vector<Reciprocal<NativeLimb>> prime_divisors; // for each prime
+    std::vector<PrimeGroup> groups; // groups of odd primes (3 onwards)
+    std::vector<Reciprocal<NativeLimb>> group_divisors; // for each group product
+    uint32_t largest;
+
+    PrimeTable()
+    {
+        // Sieve of Eratosthenes
+        std::vector<bool> composite(kSmallPrimeBound, false);
+        for (uint32_t i = 2; i < kSmallPrimeBound; i++)
+        {
+            if (composite[i])
+                continue;
+            primes.push_back(i);
+            for (uint32_t j = i * i; j < kSmallPrimeBound; j += i)
+                composite[j] = true;
+        }
+        largest = primes.back();
+
+        // Group the odd primes
+        int i = 1;
+        while (i < int(primes.size()))
+        {
+            PrimeGroup g{1, i, 0};
+            NativeLimb product = 1;
+            while (i < int(primes.size()) && product <= NativeLimb(~NativeLimb(0) / primes[i]))
+            {
+                product *= primes[i++];
+                g.count += 1;
+            }
+            g.product = product;
+            groups.push_back(g);
+            group_divisors.emplace_back(g.product);
+        }
+
+        for (uint32_t p : primes)
+            prime_divisors.emplace_back(p);
+    }
+
+    // The remainder of n modulo each group product
+    std::vector<NativeLimb> group_residues(const Num& n) const
+    {
+        std::vector<NativeLimb> rems(groups.size());
+        mod_1(rems.data(), n, group_divisors.data(), int(groups.size()));
+        return rems;
+    }
+};
+
+static const PrimeTable& prime_table()
+{
+    static const PrimeTable table;
+    return table;
+}
+
+// ======================================================================================
+// Helpers
+// ======================================================================================
+
+// Write n = d * 2^s with d odd (n must be non-zero)
+static int split_odd(const Num& n, Num& d)
+{
+    int s = n.ctz();
+    d = n;
+    d >>= s;
+    return s;
+}
+
+// Jacobi symbol (a/n) for small odd positive n
+static int jacobi_small(uint32_t a, uint32_t n)
+{
+    int result = 1;
+    a %= n;
+    while (a != 0)
+    {
+        while ((a & 1) == 0)
+        {
+            a >>= 1;
+            uint32_t r = n & 7;
+            if (r == 3 || r == 5)
+                result = -result;
+        }
+        std::swap(a, n);
+        if ((a & 3) == 3 && (n & 3) == 3)
+            result = -result;
+        a %= n;
+    }
+    return n == 1 ? result : 0;
+}
+
+// Jacobi symbol (D/n) for small signed D and big odd positive n
+static int jacobi(int D, const Num& n)
+{
+    uint32_t n0 = n.cdatabuffer()[0];
+    int result = 1;
+
+    uint32_t a = D < 0 ? uint32_t(-D) : uint32_t(D);
+    if (D < 0 && (n0 & 3) == 3)
+        result = -result; // (-1/n)
+
+    while ((a & 1) == 0)
+    {
+        a >>= 1;
+        uint32_t r = n0 & 7;
+        if (r == 3 || r == 5)
+            result = -result; // (2/n)
+    }
+
+    // Quadratic reciprocity: (a/n) = (n/a) unless both are 3 mod 4
+    if ((a & 3) == 3 && (n0 & 3) == 3)
+        result = -result;
+    return result * jacobi_small(uint32_t(divmod_1(n, Reciprocal<NativeLimb>(a))), a);
+}
+
+// Is n a perfect square? Newton's method on Num, starting from a power of two that
+// is at least sqrt(n).
+static bool is_square(const Num& n)
+{
+    // Squares are 0, 1, 4 or 9 mod 16
+    uint32_t r16 = n.cdatabuffer()[0] & 15;
+    if (r16 != 0 && r16 != 1 && r16 != 4 && r16 != 9)
+        return false;
+
+    Num x = 1;
+    x <<= (n.bit_length() + 1) / 2;
+
+    for (;;)
+    {
+        Num y{n};
+        y /= x;
+        y += x;
+        y >>= 1;
+        if (y >= x)
+            break;
+        x = std::move(y);
+    }
+
+    Num sq{x};
+    sq *= x;
+    return sq == n;
+}
+
+// ======================================================================================
+// Probable prime tests
+// ======================================================================================
+
+// Strong probable prime test to the given base (Miller-Rabin)
+static bool miller_rabin(const Montgomery& mont, uint32_t base)
+{
+    int k = mont.size();
+    Num nm1{mont.n};
+    nm1 -= Num(1);
+    Num d;
+    int s = split_odd(nm1, d);
+
+    uint32_t* x = num_alloc_digits(3 * k);
+    uint32_t* one = x + k;
+    uint32_t* minus_one = one + k;
+    mont.one(one);
+    mont.minus_one(minus_one);
+
+    mont.to_mont(x, base);
+    mont.pow(x, x, d);
+
+    bool probable = mont.equal(x, one) || mont.equal(x, minus_one);
+    for (int r = 1; r < s && !probable; r++)
+    {
+        mont.sqr(x, x);
+        if (mont.equal(x, minus_one))
+            probable = true;
+        else if (mont.equal(x, one))
+            break; // non-trivial square root of 1
+    }
+
+    num_free_digits(x);
+    return probable;
+}
+
+// Strong Lucas probable prime test with Selfridge's method A parameters: D is the
+// first of 5, -7, 9, -11, ... with (D/n) = -1, P = 1, Q = (1 - D)/4.
+//
+// With n + 1 = d * 2^s, n is a strong Lucas probable prime if U(d) = 0 or V(d*2^r) = 0
+// for some 0 <= r < s. U and V are computed left-to-right over the bits of d with
+//   U(2k) = U(k)V(k)              V(2k) = V(k)^2 - 2Q^k
+//   U(k+1) = (P U(k) + V(k))/2    V(k+1) = (D U(k) + P V(k))/2
+static bool strong_lucas(const Montgomery& mont)
+{
+    const Num& n = mont.n;
+
+    int D = 5;
+    for (int tries = 0; ; tries++)
+    {
+        int j = jacobi(D, n);
+        if (j == -1)
+            break;
+        if (j == 0)
+            return false; // |D| shares a factor with n, and n is bigger than |D|
+
+        // A perfect square never finds a D with (D/n) = -1, so check for that once
+        // the search has run longer than it does for almost all non-squares.
+        if (tries == 5 && is_square(n))
+            return false;
+
+        D = D > 0 ? -(D + 2) : -D + 2;
+    }
+    int Q = (1 - D) / 4;
+
+    Num np1{n};
+    np1 += Num(1);
+    Num d;
+    int s = split_odd(np1, d);
+
+    int k = mont.size();
+    uint32_t* U = num_alloc_digits(6 * k);
+    uint32_t* V = U + k;
+    uint32_t* Qk = V + k;
+    uint32_t* Qm = Qk + k;
+    uint32_t* Dm = Qm + k;
+    uint32_t* t = Dm + k;
+
+    // Signed small constants into Montgomery form
+    mont.to_mont(Qm, uint32_t(Q < 0 ? -Q : Q));
+    if (Q < 0)
+        mont.neg(Qm, Qm);
+    mont.to_mont(Dm, uint32_t(D < 0 ? -D : D));
+    if (D < 0)
+        mont.neg(Dm, Dm);
+
+    // k = 1: U = 1, V = P = 1, Q^k = Q
+    mont.one(U);
+    mont.one(V);
+    mont.copy(Qk, Qm);
+
+    for (int i = d.bit_length() - 2; i >= 0; --i)
+    {
+        // double
+        mont.mul(U, U, V);
+        mont.sqr(V, V);
+        mont.sub(V, V, Qk);
+        mont.sub(V, V, Qk);
+        mont.sqr(Qk, Qk);
+
+        // increment
+        if (d.test_bit(i))
+        {
+            mont.mul(t, Dm, U);
+            mont.add(U, U, V);
+            mont.half(U, U);
+            mont.add(V, t, V);
+            mont.half(V, V);
+            mont.mul(Qk, Qk, Qm);
+        }
+    }
+
+    bool probable = mont.is_zero(U) || mont.is_zero(V);
+    for (int r = 1; r < s && !probable; r++)
+    {
+        mont.sqr(V, V);
+        mont.sub(V, V, Qk);
+        mont.sub(V, V, Qk);
+        mont.sqr(Qk, Qk);
+        probable = mont.is_zero(V);
+    }
+
+    num_free_digits(U);
+    return probable;
+}
+
+// Trial division against the small prime table. Returns true if n has a factor
+// in the table (the caller has already handled n that are themselves in the table).
+static bool has_small_factor(const Num& n)
+{
+    const PrimeTable& pt = prime_table();
+    if ((n.cdatabuffer()[0] & 1) == 0)
+        return true;
+
+    std::vector<NativeLimb> rems = pt.group_residues(n);
+    for (size_t k = 0; k < pt.groups.size(); k++)
+    {
+        const PrimeGroup& g = pt.groups[k];
+        for (int i = g.first; i < g.first + g.count; i++)
+            if (pt.prime_divisors[i].mod(rems[k]) == 0)
+                return true;
+    }
+    return false;
+}
+
+bool is_probable_prime(const Num& n, int extra_rounds)
+{
+    if (n.data.sign != 0 || n.data.length() == 0)
+        return false;
+
+    // Small values are answered exactly from the table
+    const PrimeTable& pt = prime_table();
+    if (n.data.length() == 1 && n.cdatabuffer()[0] <= pt.largest)
+        return std::binary_search(pt.primes.begin(), pt.primes.end(), n.cdatabuffer()[0]);
+
+    if (has_small_factor(n))
+        return false;
+
+    // Anything below the square of the largest table prime with no factor in the table
+    // is prime
+    if (n.data.length() == 1 && n.cdatabuffer()[0] < pt.largest * pt.largest)
+        return true;
+
+    Montgomery mont(n);
+    if (!miller_rabin(mont, 2) || !strong_lucas(mont))
+        return false;
+
+    // Extra rounds use the odd primes as bases, so results are reproducible
+    int rounds = std::min(extra_rounds, int(pt.primes.size()) - 1);
+    for (int i = 1; i <= rounds; i++)
+        if (!miller_rabin(mont, pt.primes[i]))
+            return false;
+
+    return true;
+}
+
+// ======================================================================================
+// Prime generation
+// ======================================================================================
+
+// Find the smallest prime greater than n. Odd candidates are sieved in windows by every
+// prime in the table, using one single-digit remainder per prime group for the start of
+// the window, and only the survivors get a BPSW test.
+Num next_prime(const Num& n)
+{
+    const PrimeTable& pt = prime_table();
+
+    if (n.data.sign != 0 || n.magcmp(Num(2)) < 0)
+        return Num(2);
+
+    // Below the largest table prime, the answer is in the table
+    if (n.magcmp(Num(pt.largest)) < 0)
+    {
+        uint32_t v = uint32_t(n.to_uint64());
+        return Num(*std::upper_bound(pt.primes.begin(), pt.primes.end(), v));
+    }
+
+    // Start at the first odd number above n. Since start > largest, no candidate
+    // can be a table prime, so anything the sieve marks is composite.
+    Num start{n};
+    start += Num((n.cdatabuffer()[0] & 1) ? 2 : 1);
+
+    static constexpr int window = 4096; // candidates per window, covering 2*window integers
+    std::vector<char> composite(window);
+    std::vector<uint32_t> residues(pt.primes.size());
+
+    for (;;)
+    {
+        // start mod p for each odd table prime
+        std::vector<NativeLimb> rems = pt.group_residues(start);
+        for (size_t k = 0; k < pt.groups.size(); k++)
+        {
+            const PrimeGroup& g = pt.groups[k];
+            for (int i = g.first; i < g.first + g.count; i++)
+                residues[i] = uint32_t(pt.prime_divisors[i].mod(rems[k]));
+        }
+
+        // Candidate j is start + 2j. It is divisible by p when 2j = -r (mod p), i.e.
+        // j = (p - r) * (p + 1)/2 (mod p), since (p + 1)/2 is the inverse of 2.
+        std::fill(composite.begin(), composite.end(), 0);
+        for (int i = 1; i < int(pt.primes.size()); i++)
+        {
+            uint32_t p = pt.primes[i];
+            uint32_t r = residues[i];
+            uint32_t j = uint32_t((uint64_t(r == 0 ? 0 : p - r) * ((p + 1) / 2)) % p);
+            for (; j < uint32_t(window); j += p)
+                composite[j] = 1;
+        }
+
+        Num candidate{start};
+        int last = 0;
+        for (int j = 0; j < window; j++)
+        {
+            if (composite[j])
+                continue;
+            candidate += Num(2 * (j - last));
+            last = j;
+
+            // Trial division has been done by the sieve already, so go straight to BPSW
+            Montgomery mont(candidate);
+            if (miller_rabin(mont, 2) && strong_lucas(mont))
+                return candidate;
+        }
+
+        start += Num(2 * window);
+    }
+}
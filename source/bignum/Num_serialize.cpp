@@ -0,0 +1,199 @@
+// ======================================================================================
+// Num_serialize.cpp
+//
+// Binary serialization
+//
+// Num.h describes the two formats. Both are little-endian whatever the host is. On a
+// little-endian host the digits of the fixed format are a straight memcpy of the
+// NumBuffer digits, which is also what lets view_serialized read them in place.
+// ======================================================================================
+
+#include "Num.h"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NUM_BIG_ENDIAN
+#endif
+
+static void store_le32(uint8_t* p, uint32_t v)
+{
+    p[0] = uint8_t(v);
+    p[1] = uint8_t(v >> 8);
+    p[2] = uint8_t(v >> 16);
+    p[3] = uint8_t(v >> 24);
+}
+
+static uint32_t load_le32(const uint8_t* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+// ======================================================================================
+// Fixed format
+// ======================================================================================
+
+size_t serialized_size(const NumView& n)
+{
+    return 4 + size_t(n.len) * 4;
+}
+
+size_t serialize(const NumView& n, uint8_t* out)
+{
+    store_le32(out, (uint32_t(n.len) << 1) | (n.sign ? 1 : 0));
+
+    #if defined(NUM_BIG_ENDIAN)
+    for (int i = 0; i < n.len; i++)
+        store_le32(out + 4 + 4 * i, n.digits[i]);
+    #else
+    if (n.len != 0)
+        memcpy(out + 4, n.digits, size_t(n.len) * 4);
+    #endif
+
+    return serialized_size(n);
+}
+
+// Read a fixed format header, and check that the digits it promises are there
+static bool read_header(const uint8_t* in, size_t avail, int& len, bool& negative)
+{
+    if (avail < 4)
+        return false;
+
+    uint32_t header = load_le32(in);
+    uint32_t n = header >> 1;
+    if (n > uint32_t(NumBuffer::maxlen) || (avail - 4) / 4 < n)
+        return false;
+
+    len = int(n);
+    negative = (header & 1) != 0;
+    return true;
+}
+
+size_t deserialize(Num& n, const uint8_t* in, size_t avail)
+{
+    int len;
+    bool negative;
+    if (!read_header(in, avail, len, negative))
+        return 0;
+
+    uint32_t* d = n.resize(len);
+    #if defined(NUM_BIG_ENDIAN)
+    for (int i = 0; i < len; i++)
+        d[i] = load_le32(in + 4 + 4 * i);
+    #else
+    if (len != 0)
+        memcpy(d, in + 4, size_t(len) * 4);
+    #endif
+
+    // Accept leading zero digits and negative zero, but don't keep them
+    n.trim();
+    n.data.sign = (negative && n.data.len != 0) ? -1 : 0;
+
+    return 4 + size_t(len) * 4;
+}
+
+size_t view_serialized(NumView& view, const uint8_t* in, size_t avail)
+{
+    #if defined(NUM_BIG_ENDIAN)
+    // The digits are little-endian, so they can't be used in place
+    (void) view; (void) in; (void) avail;
+    return 0;
+    #else
+    assert((uintptr_t(in) & 3) == 0);
+
+    int len;
+    bool negative;
+    if (!read_header(in, avail, len, negative))
+        return 0;
+
+    view = NumView(reinterpret_cast<const uint32_t*>(in + 4), len, negative);
+    return 4 + size_t(len) * 4;
+    #endif
+}
+
+// ======================================================================================
+// Compact format
+// ======================================================================================
+
+// Number of bytes in the magnitude, without leading zero bytes
+static size_t magnitude_bytes(const NumView& n)
+{
+    if (n.len == 0)
+        return 0;
+    uint32_t top = n.digits[n.len - 1];
+    return size_t(n.len - 1) * 4 + (top > 0xFF'FFFF ? 4 : top > 0xFFFF ? 3 : top > 0xFF ? 2 : 1);
+}
+
+size_t compact_size(const NumView& n)
+{
+    size_t bytes = magnitude_bytes(n);
+    uint64_t header = (uint64_t(bytes) << 1) | (n.sign ? 1 : 0);
+
+    size_t size = 1;
+    for (; header >= 0x80; header >>= 7)
+        size += 1;
+    return size + bytes;
+}
+
+size_t serialize_compact(const NumView& n, uint8_t* out)
+{
+    size_t bytes = magnitude_bytes(n);
+    uint64_t header = (uint64_t(bytes) << 1) | (n.sign ? 1 : 0);
+
+    uint8_t* p = out;
+    for (; header >= 0x80; header >>= 7)
+        *p++ = uint8_t(header) | 0x80;
+    *p++ = uint8_t(header);
+
+    #if defined(NUM_BIG_ENDIAN)
+    for (size_t i = 0; i < bytes; i++)
+        p[i] = uint8_t(n.digits[i / 4] >> (8 * (i % 4)));
+    #else
+    if (bytes != 0)
+        memcpy(p, n.digits, bytes);
+    #endif
+
+    return size_t(p - out) + bytes;
+}
+
+size_t deserialize_compact(Num& n, const uint8_t* in, size_t avail)
+{
+    // The header is at most 5 bytes, since a Num has fewer than 2^31 magnitude bytes
+    uint64_t header = 0;
+    size_t k = 0;
+    for (int shift = 0; ; shift += 7)
+    {
+        if (k == avail || shift > 28)
+            return 0;
+        uint8_t b = in[k++];
+        header |= uint64_t(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            break;
+    }
+
+    uint64_t bytes = header >> 1;
+    if (bytes > uint64_t(NumBuffer::maxlen) * 4 || avail - k < bytes)
+        return 0;
+
+    // Clear the top digit, since the magnitude may only fill part of it
+    int len = int((bytes + 3) / 4);
+    uint32_t* d = n.resize(len);
+    if (len != 0)
+        d[len - 1] = 0;
+
+    #if defined(NUM_BIG_ENDIAN)
+    for (int i = 0; i < len; i++)
+        d[i] = 0;
+    for (size_t i = 0; i < bytes; i++)
+        d[i / 4] |= uint32_t(in[k + i]) << (8 * (i % 4));
+    #else
+    if (bytes != 0)
+        memcpy(d, in + k, size_t(bytes));
+    #endif
+
+    n.trim();
+    n.data.sign = ((header & 1) != 0 && n.data.len != 0) ? -1 : 0;
+
+    return k + size_t(bytes);
+}
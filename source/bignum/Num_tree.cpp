@@ -0,0 +1,88 @@
+// ======================================================================================
+// Num_tree.cpp
+//
+// Product and remainder trees
+//
+// A product tree over m0, m1, ... mn-1 multiplies neighbours pairwise, level by level,
+// until there is a single product. A remainder tree runs back down it: x mod the root,
+// then that mod each child, and so on to the leaves. Each step down halves the size of
+// the numbers involved, so reducing one big x by many small moduli costs a few big
+// divides and a lot of small ones, instead of n full-length divides.
+//
+// The nodes of a level are independent of each other, so a level of big enough nodes
+// is spread over the shared TaskPool.
+//
+// See "Modern Computer Arithmetic" (Brent, Zimmermann) 2.7 for the tree algorithms.
+// ======================================================================================
+
+#include "Num.h"
+#include "../tasks/TaskPool.h"
+
+#include <cassert>
+
+// Levels whose nodes are smaller than this many digits are done on one thread, since
+// each multiply or divide would take less time than handing it to another thread
+static constexpr int kParallelDigits = 32;
+
+// body(i) for i in [0, n), spread over the task pool if the nodes are big enough
+template <typename F>
+static void for_each_node(size_t n, int digits, const F& body)
+{
+    if (digits >= kParallelDigits && n > 1)
+    {
+        parallel_for(0, int64_t(n), body);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        body(int64_t(i));
+}
+
+ProductTree product_tree(const std::vector<Num>& moduli)
+{
+    assert(!moduli.empty());
+
+    ProductTree tree;
+    tree.push_back(moduli);
+    while (tree.back().size() > 1)
+    {
+        const std::vector<Num>& below = tree.back();
+        size_t pairs = below.size() / 2;
+        std::vector<Num> level((below.size() + 1) / 2);
+        for_each_node(pairs, below[0].data.len, [&below, &level](int64_t i) {
+            level[i] = multiply(below[2 * i], below[2 * i + 1]);
+        });
+
+        // An odd node out is carried up unchanged
+        if (below.size() & 1)
+            level.back() = below.back();
+
+        tree.push_back(std::move(level));
+    }
+    return tree;
+}
+
+std::vector<Num> remainder_tree(const Num& x, const ProductTree& tree)
+{
+    assert(!tree.empty());
+
+    // Start from the magnitude of x mod the root
+    std::vector<Num> rems(1, x);
+    rems[0].data.sign = 0;
+    if (rems[0].magcmp(tree.back()[0]) >= 0)
+        rems[0] %= tree.back()[0];
+
+    for (int level = int(tree.size()) - 2; level >= 0; --level)
+    {
+        const std::vector<Num>& nodes = tree[level];
+        std::vector<Num> next(nodes.size());
+        for_each_node(nodes.size(), nodes[0].data.len, [&nodes, &rems, &next](int64_t i) {
+            // A remainder already smaller than the node doesn't need a divide, which
+            // is the common case for a carried-up odd node
+            next[i] = rems[i / 2];
+            if (next[i].magcmp(nodes[i]) >= 0)
+                next[i] %= nodes[i];
+        });
+        rems = std::move(next);
+    }
+    return rems;
+}
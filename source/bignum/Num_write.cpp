@@ -0,0 +1,258 @@
+// ======================================================================================
+// Num_write.cpp
+//
+// Streaming output of Num in any base
+//
+// Digits come out most significant first, so they can go straight to a file or socket
+// instead of being built up in memory and reversed. This uses the recursive split:
+// with P = base^k, x = q * P + r, where q is written first and then r, padded with
+// zeros to k digits, and each of them is split the same way with the square root of
+// P. The powers are base^c squared again and again, where base^c is the largest power
+// of the base in a limb. Pieces of a few digits are converted with a reciprocal
+// divide per limb, as to_cstring does.
+//
+// Each split frees the number it divides before going down into the quotient, and
+// the quotient before going down into the remainder. What stays alive is the powers
+// and one remainder per level, which together come to about twice the size of the
+// number. The output goes through a buffer on the heap, of at most 64 KB and no
+// bigger than the number needs, so a small number doesn't pay for a big one.
+// ======================================================================================
+
+#include "Num.h"
+#include "Reciprocal.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Numbers of at most this many digits are converted with single-limb divides
+static constexpr int kLeafDigits = 32;
+
+// The most output held before it goes to the sink
+static constexpr size_t kBufferSize = size_t(1) << 16;
+
+class DigitWriter
+{
+public:
+    DigitWriter(const DigitSink& sink, int base);
+
+    bool write(const NumView& n);
+
+private:
+    void put(const char* p, size_t len);
+    void put_zeros(int64_t count);
+    void put_leaf(Num& x, int64_t pad);
+    void put_split(Num& x, int level, int64_t pad);
+    void flush();
+
+    const DigitSink& sink;
+    int base;
+    bool ok = true;
+
+    NativeLimb chunk;
+    int chunk_digits;
+    Reciprocal<NativeLimb> by_chunk;
+    Reciprocal<NativeLimb> by_base;
+
+    std::vector<Num> powers;          // powers[i] = chunk^(2^i)
+    std::vector<int64_t> power_digits; // digits in the base of powers[i] - 1
+
+    std::vector<char> buf;
+    size_t used = 0;
+};
+
+// The largest power of base that fits in a limb, and its number of digits
+static NativeLimb limb_power(int base, int* digits)
+{
+    NativeLimb p = NativeLimb(base);
+    *digits = 1;
+    while (p <= NativeLimb(~NativeLimb(0) / NativeLimb(base)))
+    {
+        p *= NativeLimb(base);
+        *digits += 1;
+    }
+    return p;
+}
+
+DigitWriter::DigitWriter(const DigitSink& sink, int base)
+    : sink(sink), base(base), chunk(limb_power(base, &chunk_digits)),
+      by_chunk(chunk), by_base(NativeLimb(base))
+{
+}
+
+bool DigitWriter::write(const NumView& n)
+{
+    // At least one digit per floor(log2(base)) bits, and the sign
+    int bits_per_digit = 0;
+    for (int b = base; b > 1; b >>= 1)
+        bits_per_digit++;
+    int64_t most = int64_t(n.len) * 32 / bits_per_digit + 2;
+    buf.resize(size_t(most) < kBufferSize ? size_t(most) : kBufferSize);
+
+    if (n.sign)
+        put("-", 1);
+
+    Num x{n};
+    x.data.sign = 0;
+    if (x.data.len <= kLeafDigits)
+    {
+        put_leaf(x, 0);
+        flush();
+        return ok;
+    }
+
+    // The powers up to the largest one whose square exceeds x
+    powers.push_back(Num((unsigned long long) chunk));
+    power_digits.push_back(chunk_digits);
+    while (powers.back().data.len * 2 - 1 <= x.data.len)
+    {
+        Num square = multiply(powers.back(), powers.back());
+        if (square.magcmp(x) > 0)
+            break;
+        powers.push_back(std::move(square));
+        power_digits.push_back(power_digits.back() * 2);
+    }
+
+    put_split(x, int(powers.size()) - 1, 0);
+    flush();
+    return ok;
+}
+
+void DigitWriter::put(const char* p, size_t len)
+{
+    while (len != 0)
+    {
+        if (used == buf.size())
+            flush();
+        size_t n = len < buf.size() - used ? len : buf.size() - used;
+        memcpy(buf.data() + used, p, n);
+        used += n;
+        p += n;
+        len -= n;
+    }
+}
+
+void DigitWriter::put_zeros(int64_t count)
+{
+    while (count > 0)
+    {
+        if (used == buf.size())
+            flush();
+        size_t n = size_t(count) < buf.size() - used ? size_t(count) : buf.size() - used;
+        memset(buf.data() + used, '0', n);
+        used += n;
+        count -= int64_t(n);
+    }
+}
+
+void DigitWriter::flush()
+{
+    if (ok && used != 0)
+        ok = sink(buf.data(), used);
+    used = 0;
+}
+
+// x padded to pad digits, or unpadded if pad is 0 (x is destroyed)
+void DigitWriter::put_leaf(Num& x, int64_t pad)
+{
+    char digits[32 * kLeafDigits + 64];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    while (x.data.len != 0)
+    {
+        NativeLimb r = divmod_1(x, by_chunk, &x);
+        for (int k = 0; k < chunk_digits; k++)
+        {
+            NativeLimb digit = 0;
+            r = by_base.divrem(digit, r);
+            *--p = char(digit < 10 ? '0' + digit : 'A' + digit - 10);
+        }
+    }
+
+    // The top chunk was written out in full, so drop its leading zeros
+    while (p != end && *p == '0')
+        p++;
+    if (pad == 0 && p == end)
+        *--p = '0';
+
+    put_zeros(pad - (end - p));
+    put(p, size_t(end - p));
+}
+
+// x padded to pad digits, or unpadded if pad is 0 (x is destroyed). x is less than
+// powers[level]^2, and pad is either 0 or the number of digits of that.
+void DigitWriter::put_split(Num& x, int level, int64_t pad)
+{
+    if (!ok)
+        return;
+    if (x.data.len <= kLeafDigits)
+    {
+        put_leaf(x, pad);
+        return;
+    }
+
+    // The leading piece has no padding, so it can skip levels it is too small for
+    Num& power = powers[level];
+    if (pad == 0 && x.magcmp(power) < 0)
+    {
+        put_split(x, level - 1, 0);
+        return;
+    }
+
+    Num q, r;
+    x.divmod(power, q, r);
+    x = Num();
+
+    put_split(q, level - 1, pad != 0 ? pad - power_digits[level] : 0);
+    q = Num();
+    put_split(r, level - 1, power_digits[level]);
+}
+
+// ======================================================================================
+
+bool write_num(const NumView& n, const DigitSink& sink, int base)
+{
+    assert(base >= 2 && base <= 36);
+    DigitWriter writer(sink, base);
+    return writer.write(n);
+}
+
+bool write_num(const NumView& n, FILE* f, int base)
+{
+    return write_num(n, [f](const char* p, size_t len) { return fwrite(p, 1, len, f) == len; }, base);
+}
+
+bool write_num_fd(const NumView& n, int fd, int base)
+{
+    return write_num(n, [fd](const char* p, size_t len) {
+        while (len != 0)
+        {
+            #if defined(_WIN32)
+            int written = _write(fd, p, unsigned(len));
+            #else
+            ssize_t written = ::write(fd, p, len);
+            #endif
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+            p += written;
+            len -= size_t(written);
+        }
+        return true;
+    }, base);
+}
+
+std::string Num::to_string(int base)
+{
+    std::string s;
+    write_num(*this, [&s](const char* p, size_t len) { s.append(p, len); return true; }, base);
+    return s;
+}
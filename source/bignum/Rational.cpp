@@ -0,0 +1,210 @@
+// ======================================================================================
+// Rational.cpp
+// ======================================================================================
+
+#include "Rational.h"
+
+#include <cassert>
+#include <cmath>
+
+// A reduced value is put in lowest terms again once it is this many bits past twice
+// its reduced size, so that small values aren't reduced all the time
+static constexpr int kSlackBits = 128;
+
+static bool is_one(const Num& n)
+{
+    return n.data.len == 1 && !n.data.sign && n.cdatabuffer()[0] == 1;
+}
+
+// a / g, for a g that divides a
+static Num divide_out(const Num& a, const Num& g)
+{
+    return is_one(g) ? a : divexact(a, g);
+}
+
+Rational::Rational(const Num& n, const Num& d) : num(n), den(d)
+{
+    assert(d.data.len != 0 && "zero denominator");
+    if (den.data.sign)
+    {
+        den.data.sign = 0;
+        if (num.data.len != 0)
+            num.data.sign = num.data.sign ? 0 : -1;
+    }
+    reduced = is_one(den);
+
+    // Reducing single-word values is cheap, and lets later operations keep them reduced
+    if (num.is_small() && den.is_small())
+        normalize();
+}
+
+Rational& Rational::normalize()
+{
+    if (!reduced)
+    {
+        Num g = gcd(num, den);
+        num = divide_out(num, g);
+        den = divide_out(den, g);
+        reduced = true;
+    }
+    reduced_bits = bits();
+    return *this;
+}
+
+void Rational::reduce_if_grown()
+{
+    if (!reduced && bits() > 2 * reduced_bits + kSlackBits)
+        normalize();
+}
+
+std::string Rational::to_string(int base)
+{
+    normalize();
+    std::string s = num.to_string(base);
+    if (!is_one(den))
+        s += "/" + den.to_string(base);
+    return s;
+}
+
+double Rational::to_double() const
+{
+    int64_t ne, de;
+    double n = num.to_double_with_exponent(&ne);
+    double d = den.to_double_with_exponent(&de);
+    int64_t e = ne - de;
+    if (e > 4096)
+        e = 4096;
+    if (e < -4096)
+        e = -4096;
+    return std::ldexp(n / d, int(e));
+}
+
+Rational Rational::operator-() const
+{
+    Rational r = *this;
+    if (r.num.data.len != 0)
+        r.num.data.sign = r.num.data.sign ? 0 : -1;
+    return r;
+}
+
+// ======================================================================================
+
+Rational& Rational::add(const Rational& rhs, bool subtract)
+{
+    Num c = rhs.num;
+    if (subtract && c.data.len != 0)
+        c.data.sign = c.data.sign ? 0 : -1;
+
+    // Same denominator, including integers
+    if (compare(den, rhs.den) == 0)
+    {
+        num += c;
+        reduced = is_one(den);
+        reduce_if_grown();
+        return *this;
+    }
+
+    if (reduced && rhs.reduced)
+    {
+        // With g = gcd(b, d), a/b + c/d = (a (d/g) + c (b/g)) / (b d/g), and only the
+        // factors of g can be common to the numerator and denominator of that
+        Num g = gcd(den, rhs.den);
+        Num bg = divide_out(den, g);
+        Num dg = divide_out(rhs.den, g);
+        Num t = multiply(num, dg);
+        t += multiply(c, bg);
+        if (t.data.len == 0)
+            den = 1;
+        else
+        {
+            Num g2 = is_one(g) ? g : gcd(t, g);
+            t = divide_out(t, g2);
+            den = multiply(bg, divide_out(rhs.den, g2));
+        }
+        num = std::move(t);
+        reduced_bits = bits();
+        return *this;
+    }
+
+    Num t = multiply(num, rhs.den);
+    t += multiply(c, den);
+    den = multiply(den, rhs.den);
+    num = std::move(t);
+    reduced = false;
+    reduce_if_grown();
+    return *this;
+}
+
+Rational& Rational::operator+=(const Rational& rhs)
+{
+    return add(rhs, false);
+}
+
+Rational& Rational::operator-=(const Rational& rhs)
+{
+    return add(rhs, true);
+}
+
+Rational& Rational::operator*=(const Rational& rhs)
+{
+    if (reduced && rhs.reduced)
+    {
+        // (a/b) (c/d): only gcd(a, d) and gcd(c, b) can cancel, and those are GCDs of
+        // the operands rather than of the much bigger product
+        Num g1 = gcd(num, rhs.den);
+        Num g2 = gcd(rhs.num, den);
+        Num n = multiply(divide_out(num, g1), divide_out(rhs.num, g2));
+        den = multiply(divide_out(den, g2), divide_out(rhs.den, g1));
+        num = std::move(n);
+        reduced_bits = bits();
+        return *this;
+    }
+
+    num = multiply(num, rhs.num);
+    den = multiply(den, rhs.den);
+    reduced = false;
+    reduce_if_grown();
+    return *this;
+}
+
+Rational& Rational::operator/=(const Rational& rhs)
+{
+    assert(rhs.num.data.len != 0 && "division by zero");
+    int32_t sign = rhs.num.data.sign;
+
+    // (a/b) / (c/d) = (a d) / (b c), cancelling gcd(a, c) and gcd(d, b) as for a multiply
+    if (reduced && rhs.reduced)
+    {
+        Num g1 = gcd(num, rhs.num);
+        Num g2 = gcd(rhs.den, den);
+        Num n = multiply(divide_out(num, g1), divide_out(rhs.den, g2));
+        den = multiply(divide_out(den, g2), divide_out(rhs.num, g1));
+        num = std::move(n);
+        reduced_bits = bits();
+    }
+    else
+    {
+        Num n = multiply(num, rhs.den);
+        den = multiply(den, rhs.num);
+        num = std::move(n);
+        reduced = false;
+    }
+
+    // The denominator took the sign of c
+    if (sign)
+    {
+        den.data.sign = 0;
+        if (num.data.len != 0)
+            num.data.sign = num.data.sign ? 0 : -1;
+    }
+    reduce_if_grown();
+    return *this;
+}
+
+int compare(const Rational& lhs, const Rational& rhs)
+{
+    // The denominators are positive, so a/b <=> c/d is a d <=> c b
+    if (compare(lhs.den, rhs.den) == 0)
+        return compare(lhs.num, rhs.num);
+    return compare(multiply(lhs.num, rhs.den), multiply(rhs.num, lhs.den));
+}
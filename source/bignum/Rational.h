@@ -0,0 +1,74 @@
+// ======================================================================================
+// Rational.h
+// - exact rational numbers
+//
+// A Rational is num / den with a positive denominator, and it is not kept in lowest
+// terms after every operation. The GCD that would take is usually the most expensive
+// part of the arithmetic, and most of the time it isn't needed: an add of two
+// fractions in lowest terms can be brought to lowest terms with a GCD of smaller
+// numbers (Henrici's method), a multiply by cancelling across the operands first,
+// and a comparison by cross-multiplying.
+//
+// The other cases leave the result unreduced, and it is reduced when it has grown to
+// twice its size from the last time it was in lowest terms, or when it is written
+// out. That bounds both the growth and the number of GCDs.
+// ======================================================================================
+
+#pragma once
+
+#include "Num.h"
+
+#include <string>
+
+class Rational
+{
+public:
+    // Zero
+    Rational() {}
+
+    explicit Rational(const Num& n) : num(n), reduced_bits(n.bit_length() + 1) {}
+
+    // n / d for a non-zero d, put in lowest terms if both fit in 64 bits
+    Rational(const Num& n, const Num& d);
+
+    // Put in lowest terms
+    Rational& normalize();
+
+    // In lowest terms, as "n/d", or "n" for an integer
+    std::string to_string(int base = 10);
+
+    // Within an ulp of the nearest double
+    double to_double() const;
+
+    Rational& operator+=(const Rational& rhs);
+    Rational& operator-=(const Rational& rhs);
+    Rational& operator*=(const Rational& rhs);
+    Rational& operator/=(const Rational& rhs);
+
+    Rational operator-() const;
+
+    Num num;              // carries the sign
+    Num den = 1;          // positive
+    bool reduced = true;  // known to be in lowest terms
+    int reduced_bits = 0; // size of num and den when last put in lowest terms
+
+private:
+    Rational& add(const Rational& rhs, bool subtract);
+    int bits() const { return num.bit_length() + den.bit_length(); }
+    void reduce_if_grown();
+};
+
+// -1, 0 or 1, without putting either one in lowest terms
+int compare(const Rational& lhs, const Rational& rhs);
+
+inline Rational operator+(Rational lhs, const Rational& rhs) { return lhs += rhs; }
+inline Rational operator-(Rational lhs, const Rational& rhs) { return lhs -= rhs; }
+inline Rational operator*(Rational lhs, const Rational& rhs) { return lhs *= rhs; }
+inline Rational operator/(Rational lhs, const Rational& rhs) { return lhs /= rhs; }
+
+inline bool operator==(const Rational& lhs, const Rational& rhs) { return compare(lhs, rhs) == 0; }
+inline bool operator!=(const Rational& lhs, const Rational& rhs) { return compare(lhs, rhs) != 0; }
+inline bool operator<(const Rational& lhs, const Rational& rhs) { return compare(lhs, rhs) < 0; }
+inline bool operator<=(const Rational& lhs, const Rational& rhs) { return compare(lhs, rhs) <= 0; }
+inline bool operator>(const Rational& lhs, const Rational& rhs) { return compare(lhs, rhs) > 0; }
+inline bool operator>=(const Rational& lhs, const Rational& rhs) { return compare(lhs, rhs) >= 0; }
@@ -0,0 +1,153 @@
+// ======================================================================================
+// Reciprocal.h
+// - division by a single invariant limb with a precomputed reciprocal
+//
+// This follows Möller and Granlund, "Improved division by invariant integers" (2011).
+// For a divisor d normalized so that its top bit is set, the reciprocal is
+//
+//   v = floor((B^2 - 1) / d) - B          (B = 2^32 or 2^64)
+//
+// and dividing a two-limb number by d takes two multiplies and a rarely taken
+// adjustment, instead of a hardware divide. The reciprocal costs one real divide,
+// so it pays off whenever the same divisor is used for more than a couple of limbs.
+//
+// Divisors that aren't normalized are handled by shifting each partial dividend as
+// it is formed; the quotient is the same, and the remainder is shifted back.
+// ======================================================================================
+
+#pragma once
+
+#include "Intrinsics.h"
+
+#include <cassert>
+#include <cstdint>
+
+// The limb size that divides fastest on this machine: 64 bits wherever there is a
+// 64 x 64 -> 128 bit multiply instruction, since a 64-bit step does the work of two
+// 32-bit steps in about the same time
+#if defined(__SIZEOF_INT128__) || (defined(_MSC_VER) && defined(_M_X64))
+using NativeLimb = uint64_t;
+#else
+using NativeLimb = uint32_t;
+#endif
+
+// Full product of two limbs: returns the low limb and stores the high limb
+inline uint32_t mul_limb(uint32_t a, uint32_t b, uint32_t* hi)
+{
+    uint64_t p = uint64_t(a) * b;
+    *hi = uint32_t(p >> 32);
+    return uint32_t(p);
+}
+
+inline uint64_t mul_limb(uint64_t a, uint64_t b, uint64_t* hi)
+{
+    return mul64(a, b, hi);
+}
+
+inline int clz_limb(uint32_t v) { return clz32(v); }
+inline int clz_limb(uint64_t v) { return clz64(v); }
+
+// floor((B^2 - 1) / d) - B for a normalized d, which is (~d * B + (B - 1)) / d
+inline uint32_t reciprocal_limb(uint32_t d)
+{
+    return uint32_t(((uint64_t(~d) << 32) | 0xFFFF'FFFF) / d);
+}
+
+inline uint64_t reciprocal_limb(uint64_t d)
+{
+    #if defined(__SIZEOF_INT128__)
+    return uint64_t(((unsigned __int128) ~d << 64 | ~uint64_t(0)) / d);
+    #elif defined(_MSC_VER) && defined(_M_X64) && _MSC_VER >= 1920
+    uint64_t r;
+    return _udiv128(~d, ~uint64_t(0), d, &r);
+    #else
+    // Restoring division, one quotient bit at a time. The running remainder can be
+    // 65 bits wide for a moment, which the carry out of the shift keeps track of.
+    uint64_t hi = ~d, lo = ~uint64_t(0), q = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        uint64_t top = hi >> 63;
+        hi = (hi << 1) | (lo >> 63);
+        lo <<= 1;
+        q <<= 1;
+        if (top != 0 || hi >= d)
+        {
+            hi -= d;
+            q |= 1;
+        }
+    }
+    return q;
+    #endif
+}
+
+template<typename Limb>
+struct Reciprocal
+{
+    static constexpr int bits = 8 * sizeof(Limb);
+
+    explicit Reciprocal(Limb divisor) : d(divisor)
+    {
+        assert(divisor != 0);
+        shift = clz_limb(d);
+        dnorm = Limb(d << shift);
+        v = reciprocal_limb(dnorm);
+    }
+
+    // (u1 * B + u0) / dnorm for u1 < dnorm. Returns the quotient and stores the
+    // remainder.
+    Limb divrem_norm(Limb u1, Limb u0, Limb* r) const
+    {
+        Limb q1;
+        Limb q0 = mul_limb(v, u1, &q1);
+        q0 += u0;
+        q1 += u1 + (q0 < u0 ? 1 : 0) + 1;
+
+        // The first adjustment is taken about half the time, so it is done with a
+        // mask instead of a branch; the second is rare
+        Limb rem = Limb(u0 - q1 * dnorm);
+        Limb mask = Limb(0) - Limb(rem > q0 ? 1 : 0);
+        q1 += mask;
+        rem += mask & dnorm;
+        if (rem >= dnorm)
+        {
+            q1 += 1;
+            rem -= dnorm;
+        }
+        *r = rem;
+        return q1;
+    }
+
+    // (r * B + u) / d for r < d. Returns the quotient and replaces r with the
+    // remainder. This is one step of dividing a multi-limb number from the top.
+    Limb divrem(Limb& r, Limb u) const
+    {
+        Limb rn = Limb(r << shift);
+        Limb q = divrem_shifted(rn, u);
+        r = rn >> shift;
+        return q;
+    }
+
+    // The same step with the remainder kept shifted left (rn = r << shift), which
+    // is the remainder of the shifted dividend by dnorm. A loop over many limbs
+    // should carry rn instead of r, which keeps the shifts off the dependency chain
+    // from one step to the next.
+    Limb divrem_shifted(Limb& rn, Limb u) const
+    {
+        // (u >> 1) >> (bits - 1 - shift) is u >> (bits - shift), without an
+        // out-of-range shift when shift is 0
+        return divrem_norm(rn | ((u >> 1) >> (bits - 1 - shift)), Limb(u << shift), &rn);
+    }
+
+    // u mod d
+    Limb mod(Limb u) const
+    {
+        Limb r = 0;
+        divrem(r, u);
+        return r;
+    }
+
+    Limb d;     // the divisor
+    Limb dnorm; // d << shift, with the top bit set
+    Limb v;     // the reciprocal of dnorm
+    int shift;
+};
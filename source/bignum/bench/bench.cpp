@@ -0,0 +1,327 @@
+// ======================================================================================
+// bench.cpp
+// - throughput of the bignum operations across operand sizes
+//
+// Each operation is timed at sizes 1, 2, 5, 10, 20, 50 ... limbs, up to --max-limbs.
+// At each size the operation is run in batches long enough to time (about a
+// millisecond), and the spread of the batch times gives the median and percentiles.
+// An operation stops growing once a single call takes longer than --stop seconds,
+// since the quadratic algorithms can't reach 10^7 limbs in any reasonable time.
+//
+//   bignum-bench [--ops add,mul,...] [--max-limbs N] [--budget S] [--stop S] [--json FILE]
+//
+// The table goes to stdout, and --json writes the same results in a form that two
+// runs can be diffed by. Built with NUM_COUNTERS, both also give the allocations
+// made by one call.
+// ======================================================================================
+
+#include "../Num.h"
+#include "../NumPoly.h"
+#include "../NumRandom.h"
+#include "../../compat/CpuFeatures.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Results are folded into this so that the compiler can't drop the work
+static volatile uint32_t sink;
+
+static uint64_t seed = 0x9E37'79B9'7F4A'7C15ULL;
+
+static uint32_t next_random()
+{
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return uint32_t(seed >> 32);
+}
+
+// A number of exactly limbs digits
+static Num random_num(int limbs)
+{
+    Num n;
+    uint32_t* d = n.resize(limbs);
+    for (int i = 0; i < limbs; i++)
+        d[i] = next_random();
+    d[limbs - 1] |= 0x8000'0000;
+    return n;
+}
+
+// ======================================================================================
+// Operations
+// ======================================================================================
+
+struct Operation
+{
+    const char* name;
+
+    // Set up the operands for a size and return the call to time
+    std::function<std::function<void()>(int limbs)> setup;
+
+    // The algorithm the library picks at a size, following the choices made in
+    // Num_muldiv.cpp, Num_write.cpp, Num.cpp and Num_power.cpp
+    std::function<const char*(int limbs)> tier;
+};
+
+static std::vector<Operation> operations()
+{
+    std::vector<Operation> ops;
+
+    ops.push_back({ "add",
+        [](int limbs) {
+            auto a = std::make_shared<Num>(random_num(limbs));
+            auto b = std::make_shared<Num>(random_num(limbs));
+            return [a, b]() { Num r = *a + *b; sink += r.data.len; };
+        },
+        [](int) { return "schoolbook"; } });
+
+    ops.push_back({ "mul",
+        [](int limbs) {
+            auto a = std::make_shared<Num>(random_num(limbs));
+            auto b = std::make_shared<Num>(random_num(limbs));
+            return [a, b]() { Num r = multiply(*a, *b); sink += r.data.len; };
+        },
+        [](int) { return "schoolbook"; } });
+
+    ops.push_back({ "square",
+        [](int limbs) {
+            auto a = std::make_shared<Num>(random_num(limbs));
+            return [a]() { Num r = multiply(*a, *a); sink += r.data.len; };
+        },
+        [](int) { return "schoolbook-square"; } });
+
+    // A 2n-limb dividend by an n-limb divisor
+    ops.push_back({ "divmod",
+        [](int limbs) {
+            auto a = std::make_shared<Num>(random_num(2 * limbs));
+            auto b = std::make_shared<Num>(random_num(limbs));
+            return [a, b]() { Num q, r; a->divmod(*b, q, r); sink += q.data.len + r.data.len; };
+        },
+        [](int limbs) { return limbs == 1 ? "native64" : "knuth-d"; } });
+
+    ops.push_back({ "to_string",
+        [](int limbs) {
+            auto a = std::make_shared<Num>(random_num(limbs));
+            return [a]() { sink += uint32_t(a->to_string().size()); };
+        },
+        [](int limbs) { return limbs <= 32 ? "divmod-1" : "split"; } });
+
+    ops.push_back({ "from_string",
+        [](int limbs) {
+            auto s = std::make_shared<std::string>(random_num(limbs).to_string());
+            return [s]() { Num r; r.from_string(std::string_view(*s)); sink += r.data.len; };
+        },
+        [](int) { return "mul-add-digit"; } });
+
+    // A one-limb base to the power that gives a result of limbs limbs
+    ops.push_back({ "pow",
+        [](int limbs) {
+            auto b = std::make_shared<Num>(Num((unsigned long long) (next_random() | 0x8000'0001)));
+            auto e = std::make_shared<Num>(limbs);
+            return [b, e]() { Num r = *b; r ^= *e; sink += r.data.len; };
+        },
+        [](int) { return "sliding-window"; } });
+
+    ops.push_back({ "random_bits",
+        [](int limbs) {
+            auto rng = std::make_shared<Philox4x32>(next_random());
+            return [rng, limbs]() { Num r = random_bits(32 * limbs, *rng); sink += r.data.len; };
+        },
+        [](int) { return "philox"; } });
+
+    // Two polynomials of limbs one-limb coefficients
+    ops.push_back({ "poly_mul",
+        [](int limbs) {
+            auto poly = [limbs]() {
+                std::vector<Num> c;
+                for (int i = 0; i < limbs; i++)
+                    c.push_back(random_num(1));
+                return NumPoly(c);
+            };
+            auto a = std::make_shared<NumPoly>(poly());
+            auto b = std::make_shared<NumPoly>(poly());
+            return [a, b]() { NumPoly r = *a * *b; sink += uint32_t(r.coeffs.size()); };
+        },
+        [](int) { return "kronecker"; } });
+
+    return ops;
+}
+
+// ======================================================================================
+// Timing
+// ======================================================================================
+
+struct Result
+{
+    const char* op;
+    int limbs;
+    const char* tier;
+    int samples;
+    int batch;
+    double median_ns, p10_ns, p90_ns, min_ns;
+    uint64_t allocations; // per call, with NUM_COUNTERS
+};
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    double pos = p * double(sorted.size() - 1);
+    size_t i = size_t(pos);
+    if (i + 1 >= sorted.size())
+        return sorted.back();
+    return sorted[i] + (sorted[i + 1] - sorted[i]) * (pos - double(i));
+}
+
+// Returns false if a single call took longer than stop seconds
+static bool measure(const std::function<void()>& call, double budget, double stop, Result& result)
+{
+    NumAllocationGuard counted(false);
+    Clock::time_point start = Clock::now();
+    call();
+    double once = seconds_since(start);
+    result.allocations = counted.allocations();
+    if (once > stop)
+        return false;
+
+    // Batches of about a millisecond, and as many of them as fit in the budget
+    int batch = once > 1e-3 ? 1 : int(1e-3 / std::max(once, 1e-9));
+    int samples = int(budget / (double(batch) * std::max(once, 1e-9)));
+    samples = std::min(std::max(samples, 5), 101);
+
+    std::vector<double> ns;
+    for (int s = 0; s < samples; s++)
+    {
+        Clock::time_point t = Clock::now();
+        for (int i = 0; i < batch; i++)
+            call();
+        ns.push_back(seconds_since(t) * 1e9 / batch);
+    }
+    std::sort(ns.begin(), ns.end());
+
+    result.samples = samples;
+    result.batch = batch;
+    result.median_ns = percentile(ns, 0.5);
+    result.p10_ns = percentile(ns, 0.1);
+    result.p90_ns = percentile(ns, 0.9);
+    result.min_ns = ns.front();
+    return true;
+}
+
+static void write_json(FILE* fp, const std::vector<Result>& results)
+{
+    const CpuFeatures& f = cpu_features();
+    fprintf(fp, "{\n  \"cpu\": \"%s\",\n  \"dispatch\": \"%s\",\n  \"results\": [\n", f.brand, cpu_level_name(cpu_level()));
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        fprintf(fp,
+            "    { \"op\": \"%s\", \"limbs\": %d, \"tier\": \"%s\", \"samples\": %d, \"batch\": %d, "
+            "\"median_ns\": %.1f, \"p10_ns\": %.1f, \"p90_ns\": %.1f, \"min_ns\": %.1f, \"limbs_per_ns\": %.6g",
+            r.op, r.limbs, r.tier, r.samples, r.batch, r.median_ns, r.p10_ns, r.p90_ns, r.min_ns,
+            r.limbs / r.median_ns);
+        if (NUM_COUNTERS)
+            fprintf(fp, ", \"allocations\": %llu", (unsigned long long) r.allocations);
+        fprintf(fp, " }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+// ======================================================================================
+
+static void usage()
+{
+    fprintf(stderr, "usage: bignum-bench [--ops add,mul,square,divmod,to_string,from_string,pow,\n"
+                    "                     random_bits,poly_mul]\n"
+                    "                    [--max-limbs N] [--budget S] [--stop S] [--json FILE]\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    std::string only;
+    int max_limbs = 10'000'000;
+    double budget = 0.2;
+    double stop = 2.0;
+    const char* json = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+            usage();
+        if (0 == strcmp(argv[i], "--ops"))
+            only = std::string(",") + argv[++i] + ",";
+        else if (0 == strcmp(argv[i], "--max-limbs"))
+            max_limbs = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "--budget"))
+            budget = atof(argv[++i]);
+        else if (0 == strcmp(argv[i], "--stop"))
+            stop = atof(argv[++i]);
+        else if (0 == strcmp(argv[i], "--json"))
+            json = argv[++i];
+        else
+            usage();
+    }
+
+    // 1, 2, 5, 10, 20, 50, ...
+    std::vector<int> sizes;
+    for (int64_t decade = 1; decade <= max_limbs; decade *= 10)
+        for (int m : { 1, 2, 5 })
+            if (decade * m <= max_limbs)
+                sizes.push_back(int(decade * m));
+
+    print_cpu_report(stdout);
+    printf("\n%-12s %9s  %-18s %14s %14s %14s %12s%s\n", "op", "limbs", "tier", "median ns", "p10 ns", "p90 ns", "limbs/ns",
+           NUM_COUNTERS ? "   allocs" : "");
+
+    std::vector<Result> results;
+    for (const Operation& op : operations())
+    {
+        if (!only.empty() && only.find(std::string(",") + op.name + ",") == std::string::npos)
+            continue;
+
+        for (int limbs : sizes)
+        {
+            Result r = {};
+            r.op = op.name;
+            r.limbs = limbs;
+            r.tier = op.tier(limbs);
+            if (!measure(op.setup(limbs), budget, stop, r))
+            {
+                printf("%-12s %9d  stopped: one call takes over %g s\n", op.name, limbs, stop);
+                break;
+            }
+            printf("%-12s %9d  %-18s %14.1f %14.1f %14.1f %12.4g",
+                   r.op, r.limbs, r.tier, r.median_ns, r.p10_ns, r.p90_ns, r.limbs / r.median_ns);
+            if (NUM_COUNTERS)
+                printf(" %9llu", (unsigned long long) r.allocations);
+            printf("\n");
+            fflush(stdout);
+            results.push_back(r);
+        }
+    }
+
+    if (json)
+    {
+        FILE* fp = fopen(json, "w");
+        if (!fp)
+        {
+            fprintf(stderr, "can't write %s\n", json);
+            return 1;
+        }
+        write_json(fp, results);
+        fclose(fp);
+    }
+    return 0;
+}
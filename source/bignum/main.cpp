@@ -1,9 +1,23 @@
 // main.cpp
 
 #include "Num.h"
-
+#include "BigFloat.h"
+#include "FixedNum.h"
+#include "Montgomery.h"
+#include "NumBatch.h"
+#include "NumPoly.h"
+#include "NumRandom.h"
+#include "NumRns.h"
+#include "NumSeries.h"
+#include "Rational.h"
+#include "Reciprocal.h"
+#include "../compat/CpuFeatures.h"
+
+#include <cmath>
 #include <cstring>
 #include <ctime>
+#include <set>
+#include <unordered_set>
 
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include "../catch.hpp"
@@ -861,6 +875,111 @@ TEST_CASE("Num - divide", "[Num]")
         result = result / ten_e6;
         REQUIRE(result == ten_e48);
     }
+
+    SECTION("Num - remainders")
+    {
+        // divisor shorter than dividend
+        REQUIRE(ten_e3 % ten_e48 == ten_e3);
+        REQUIRE(ten_e72 % ten_e36 == 0);
+        REQUIRE((ten_e72 + ten_e3) % ten_e36 == ten_e3);
+        Num negative = (Num(0) - ten_e72 - Num(7)) % ten_e36;
+        REQUIRE(negative == -7);
+        REQUIRE(negative.data.sign != 0);
+
+        // 2^576 mod (2^256 + 297) needs the add-back step of the Knuth divide
+        Num two_e256 = Num(2)^Num(256);
+        Num r = (Num(2)^Num(576)) % (two_e256 + Num(297));
+        char numbuf[256];
+        r.to_cstring(numbuf, 256, 16);
+        REQUIRE(0 == strcmp(numbuf, "158910000000000000000"));
+    }
+}
+
+TEST_CASE("Num - exact division", "[Num]")
+{
+    // Binomial coefficients: C(n, k+1) = C(n, k) * (n - k) / (k + 1) is always exact
+    Num c = 1;
+    for (int k = 0; k < 100; k++)
+        c = divexact(c * Num(200 - k), Num(k + 1));
+    Num expected;
+    expected.from_cstring("90548514656103281165404177077484163874504589675413336841320");
+    REQUIRE(c == expected);
+
+    // Multi-digit and even divisors, and signs
+    Num q = (Num(1) << 300) + Num(987654321);
+    Num b = (Num(3) << 100) + Num(1);
+    REQUIRE(divexact(q * b, b) == q);
+    Num even = b << 37;
+    REQUIRE(divexact(q * even, even) == q);
+    Num neg = Num(0) - b;
+    REQUIRE(divexact(q * neg, neg) == q);
+    REQUIRE(divexact(q * b, neg) == Num(0) - q);
+    REQUIRE(divexact(Num(0), b) == 0);
+    REQUIRE(divexact(b, b) == 1);
+
+    REQUIRE(divisible_by(c, 3));
+    REQUIRE(!divisible_by(c, 7));
+    REQUIRE(divisible_by(c, 1));
+    REQUIRE(divisible_by(Num(0), 12));
+    REQUIRE(divisible_by(Num(1) << 70, 1u << 31));
+    REQUIRE(!divisible_by((Num(1) << 70) + Num(2), 4));
+    REQUIRE(divisible_by(q * Num(0xFFFF'FFFB), 0xFFFF'FFFB));
+    REQUIRE(!divisible_by(q * Num(0xFFFF'FFFB) + Num(1), 0xFFFF'FFFB));
+    REQUIRE(divisible_by(q * Num(24), 24));
+    REQUIRE(!divisible_by(q * Num(12), 24));
+}
+
+TEST_CASE("Num - single digit division", "[Num]")
+{
+    // Normalized and unnormalized divisors, and the largest of each size
+    Num a = ((Num(1) << 300) - Num(1)) * Num(12345);
+    uint32_t divisors32[] = { 1, 3, 10, 0x8000'0000, 0xFFFF'FFFF, 1000000007 };
+    for (uint32_t d : divisors32)
+    {
+        Num q, r;
+        a.divmod(Num(d), q, r);
+        Num q1;
+        REQUIRE(divmod_1(a, Reciprocal<uint32_t>(d), &q1) == r.to_uint64());
+        REQUIRE(q1 == q);
+        REQUIRE(divmod_1(a, Reciprocal<uint32_t>(d)) == r.to_uint64());
+    }
+
+    uint64_t divisors64[] = { 1, 7, 10'000'000'000'000'000'000ULL, 0xFFFF'FFFF'FFFF'FFFFULL, 0x1'0000'0001ULL };
+    for (uint64_t d : divisors64)
+    {
+        Num q, r;
+        a.divmod(Num((unsigned long long) d), q, r);
+        Num q1;
+        REQUIRE(divmod_1(a, Reciprocal<uint64_t>(d), &q1) == r.to_uint64());
+        REQUIRE(q1 == q);
+
+        // An odd number of digits puts the top digit in a limb of its own
+        Num b = a;
+        b <<= 32;
+        b += Num(5);
+        b.divmod(Num((unsigned long long) d), q, r);
+        REQUIRE(divmod_1(b, Reciprocal<uint64_t>(d), &b) == r.to_uint64());
+        REQUIRE(b == q);
+    }
+
+    // Many divisors at once
+    Reciprocal<uint32_t> several[] = { Reciprocal<uint32_t>(3), Reciprocal<uint32_t>(0xFFFF'FFFB), Reciprocal<uint32_t>(1 << 20) };
+    uint32_t rems[3];
+    mod_1(rems, a, several, 3);
+    REQUIRE(rems[0] == (a % Num(3)).to_uint64());
+    REQUIRE(rems[1] == (a % Num(0xFFFF'FFFB)).to_uint64());
+    REQUIRE(rems[2] == (a % Num(1 << 20)).to_uint64());
+
+    Num q;
+    REQUIRE(a.divmod(12345, q) == 0);
+    REQUIRE(q == (Num(1) << 300) - Num(1));
+
+    // Text conversion divides by a power of the base, and doesn't touch the sign
+    Num neg = Num(0) - a;
+    char buf[200];
+    neg.to_cstring(buf, sizeof(buf), 16);
+    REQUIRE(neg.data.sign != 0);
+    REQUIRE(std::string(buf) == "-3038" + std::string(71, 'F') + "CFC7");
 }
 
 TEST_CASE("Num - aliasing", "[Num]")
@@ -921,6 +1040,820 @@ TEST_CASE("Num - shift", "[Num]")
     result = 0x0FFF'FFFF'FFFF'FFFFLL;
     result >>= 33;
     REQUIRE(result == 0x7FF'FFFFLL);
+
+    result = 0x0FFF'FFFFLL;
+    result >>= 0;
+    REQUIRE(result == 0x0FFF'FFFFLL);
+
+    result = 0x0FFF'FFFFLL;
+    result <<= 36;
+    REQUIRE(result >> 36 == 0x0FFF'FFFFLL);
+    REQUIRE(result == Num(0x0FFF'FFFFLL) * (Num(1) << 36));
+
+    // Right shift of a negative value rounds toward minus infinity
+    result = -7;
+    result >>= 1;
+    REQUIRE(result == -4);
+
+    result = -8;
+    result >>= 3;
+    REQUIRE(result == -1);
+
+    result = -1;
+    result >>= 100;
+    REQUIRE(result == -1);
+
+    result = -3;
+    result <<= 64;
+    REQUIRE(result >> 64 == -3);
+
+    result = Num(1) << 1000;
+    REQUIRE(result.bit_length() == 1001);
+    REQUIRE((result >> 999) == 2);
+}
+
+TEST_CASE("Num - bitwise", "[Num]")
+{
+    Num a = 0x0F0F'F0F0'1234'5678LL;
+    Num b = 0x00FF'FF00'8765'4321LL;
+
+    REQUIRE((a & b) == (0x0F0F'F0F0'1234'5678LL & 0x00FF'FF00'8765'4321LL));
+    REQUIRE((a | b) == (0x0F0F'F0F0'1234'5678LL | 0x00FF'FF00'8765'4321LL));
+    REQUIRE(Num(a).bit_xor(b) == (0x0F0F'F0F0'1234'5678LL ^ 0x00FF'FF00'8765'4321LL));
+
+    // Negative values behave as infinite two's complement
+    REQUIRE(~Num(0) == -1);
+    REQUIRE(~Num(-1) == 0);
+    REQUIRE(~Num(5) == -6);
+    REQUIRE((Num(-6) & Num(7)) == 2);
+    REQUIRE((Num(-6) & Num(-3)) == -8);
+    REQUIRE((Num(-6) | Num(3)) == -5);
+    REQUIRE(Num(-6).bit_xor(Num(3)) == -7);
+    REQUIRE(Num(-6).bit_xor(Num(-3)) == 7);
+
+    // The non-assigning forms work on const operands
+    const Num& ca = a;
+    const Num& cb = b;
+    REQUIRE(((ca << 3) >> 3) == a);
+    REQUIRE((ca & cb) == (a & b));
+    REQUIRE((ca | cb) == (a | b));
+    REQUIRE(~ca == Num(0) - a - 1);
+
+    // Long operands take the vector path
+    Num ones = (Num(1) << 1024) - 1;
+    Num big = Num(1) << 1000;
+    REQUIRE((ones & big) == big);
+    REQUIRE((ones | big) == ones);
+    REQUIRE(Num(ones).bit_xor(big) == ones - big);
+    REQUIRE(((Num(0) - ones) & big) == 0);
+    REQUIRE(((Num(0) - big) & ones) == (ones - big + 1));
+
+    // Bit queries
+    REQUIRE(Num(0).bit_length() == 0);
+    REQUIRE(Num(1).bit_length() == 1);
+    REQUIRE(Num(0x1'0000'0000LL).bit_length() == 33);
+    REQUIRE(ones.bit_length() == 1024);
+    REQUIRE(ones.popcount() == 1024);
+    REQUIRE(big.popcount() == 1);
+    REQUIRE(big.ctz() == 1000);
+    REQUIRE(Num(12).ctz() == 2);
+    REQUIRE(big.test_bit(1000));
+    REQUIRE(!big.test_bit(999));
+    REQUIRE(!big.test_bit(5000));
+    REQUIRE(Num(-2).test_bit(5000));
+    REQUIRE(!Num(-2).test_bit(0));
+}
+
+TEST_CASE("FixedNum", "[FixedNum]")
+{
+    // Arithmetic is usable in constant expressions
+    constexpr Num256 p("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFC2F", 16);
+    static_assert(p + 1 == Num256("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFC30", 16), "");
+    static_assert(p.bit_length() == 256, "");
+    static_assert(Num256(0) - 1 == ~Num256(0), "");
+    static_assert(-Num256(1) == Num256(-1), "");
+    static_assert((Num256(1) << 255 >> 255) == 1, "");
+    static_assert(Num256(0xFFFF'FFFF'FFFF'FFFFULL) * Num256(0xFFFF'FFFF'FFFF'FFFFULL)
+        == Num256("340282366920938463426481119284349108225"), "");
+    static_assert(sizeof(Num1024) == 128, "");
+
+    // Wraparound
+    Num256 max = ~Num256(0);
+    REQUIRE(max + 1 == 0);
+    REQUIRE(Num256(0) - 1 == max);
+    REQUIRE(max * max == 1);
+    REQUIRE((max << 1) == max - 1);
+    REQUIRE((max >> 200) == (Num256(1) << 56) - 1);
+
+    // Round trip through Num, and agreement with Num arithmetic
+    Num a, b;
+    a.from_cstring("115792089237316195423570985008687907853269984665640564039457584007908834671663");
+    b.from_cstring("340282366920938463463374607431768211297");
+    Num256 fa(a), fb(b);
+    REQUIRE(fa.to_num() == a);
+    REQUIRE(fa == p);
+    REQUIRE((fa / fb).to_num() == a / b);
+    REQUIRE((fa % fb).to_num() == a % b);
+    REQUIRE(fa.mul_wide(fb).to_num() == a * b);
+    REQUIRE((fb * fb).to_num() == b * b);
+    REQUIRE(Num512(fa).to_num() == a);
+    REQUIRE(Num256(Num(-1)) == max);
+    REQUIRE(fa.to_string(16) == "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFC2F");
+
+    Num1024 big = Num1024(fa.mul_wide(fa)) * Num1024(fa.mul_wide(fa));
+    REQUIRE(big.to_num() == a * a * a * a);
+    REQUIRE((big / Num1024(fa)).to_num() == a * a * a);
+    REQUIRE((big % Num1024(fb)).to_num() == (a * a * a * a) % b);
+}
+
+TEST_CASE("Num - small values", "[Num]")
+{
+    // Operands of at most two digits take the 64-bit fast path; check the results
+    // that spill into three and four digits, and the signs of zero results.
+    Num max64 = 0xFFFF'FFFF'FFFF'FFFFULL;
+    Num two64 = Num(1) << 64;
+
+    Num sum = max64 + Num(1);
+    REQUIRE(sum.data.len == 3);
+    REQUIRE(sum == two64);
+
+    Num diff = Num(0) - max64 - max64;
+    REQUIRE(diff.data.len == 3);
+    REQUIRE(diff.data.sign == -1);
+    REQUIRE(diff == (two64 - 1) * Num(-2));
+
+    Num zero = max64 - max64;
+    REQUIRE(zero.data.len == 0);
+    REQUIRE(zero.data.sign == 0);
+    zero = Num(-5) + Num(5);
+    REQUIRE(zero.data.len == 0);
+    REQUIRE(zero.data.sign == 0);
+
+    REQUIRE(Num(7) - Num(9) == Num(-2));
+    REQUIRE(Num(-7) - Num(-9) == Num(2));
+    REQUIRE((Num(-7) - Num(-9)).data.sign == 0);
+
+    Num sq = max64 * max64;
+    REQUIRE(sq.data.len == 4);
+    REQUIRE(sq == (Num(1) << 128) - (Num(1) << 65) + Num(1));
+    REQUIRE((Num(-3) * Num(5)).data.sign == -1);
+    REQUIRE((Num(-3) * Num(0)).data.sign == 0);
+
+    Num q, r;
+    max64.divmod(Num(0x1'0000'0001LL), q, r);
+    REQUIRE(q == 0xFFFF'FFFFLL);
+    REQUIRE(r == 0);
+    Num(1000).divmod(Num(0x1'0000'0000LL), q, r);
+    REQUIRE(q == 0);
+    REQUIRE(r == 1000);
+
+    // A Num with a big buffer still takes the fast path
+    Num big = Num(1) << 512;
+    big = 12345;
+    REQUIRE(big.data.nonlocal);
+    big *= Num(1000);
+    REQUIRE(big == 12345000);
+    big += max64;
+    REQUIRE(big == max64 + Num(12345000));
+}
+
+TEST_CASE("Num - comparison and hashing", "[Num]")
+{
+    // Signed ordering, including values that only differ in sign
+    Num big = Num(1) << 200;
+    Num neg_big = Num(0) - big;
+    Num values[] = { neg_big, Num(-5), Num(-1), Num(0), Num(1), Num(5), big, big + Num(1) };
+    for (size_t i = 0; i < std::size(values); i++)
+    {
+        for (size_t j = 0; j < std::size(values); j++)
+        {
+            REQUIRE((values[i] < values[j]) == (i < j));
+            REQUIRE((values[i] == values[j]) == (i == j));
+            REQUIRE((values[i] >= values[j]) == (i >= j));
+        }
+    }
+    REQUIRE(Num(-5).magcmp(Num(5)) == 0);
+
+    // Long equal prefixes, differing in the lowest digit
+    Num a = (Num(1) << 1000) - Num(1);
+    Num b = a - Num(1);
+    REQUIRE(b < a);
+    REQUIRE(!(a < a));
+    REQUIRE(Num(0) - a < Num(0) - b);
+
+    std::set<Num> sorted(std::begin(values), std::end(values));
+    REQUIRE(*sorted.begin() == neg_big);
+    REQUIRE(*sorted.rbegin() == big + Num(1));
+
+    // The hash depends on the value, not on where the digits live
+    Num small_in_big = Num(1) << 512;
+    small_in_big = 12345;
+    REQUIRE(small_in_big.data.nonlocal);
+    REQUIRE(hash_value(small_in_big) == hash_value(Num(12345)));
+    REQUIRE(hash_value(Num(5)) != hash_value(Num(-5)));
+    REQUIRE(hash_value(Num(5)) != hash_value(Num(5), 1));
+    REQUIRE(hash_value(a) != hash_value(b));
+
+    std::unordered_set<Num> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.insert(Num(i));
+        keys.insert(Num(i) << 500);
+    }
+    REQUIRE(keys.size() == 1999); // 0 << 500 is 0
+    REQUIRE(keys.count(Num(7) << 500) == 1);
+    REQUIRE(keys.count(Num(1000)) == 0);
+}
+
+TEST_CASE("Num - floating point conversion", "[Num]")
+{
+    REQUIRE(Num(0).to_double() == 0.0);
+    REQUIRE(Num(-12345).to_double() == -12345.0);
+    REQUIRE(Num(0xFFFF'FFFF'FFFF'FFFFULL).to_double() == 18446744073709551616.0);
+
+    // 2^53 + 1 is a tie and rounds to even; 2^53 + 3 rounds up
+    Num p53 = Num(1) << 53;
+    REQUIRE((p53 + Num(1)).to_double() == 9007199254740992.0);
+    REQUIRE((p53 + Num(3)).to_double() == 9007199254740996.0);
+
+    // A tie far above the mantissa, broken by a low bit that is set
+    Num tie = (Num(1) << 300) + (Num(1) << 247);
+    REQUIRE(tie.to_double() == std::ldexp(1.0, 300));
+    REQUIRE((tie + Num(1)).to_double() == std::ldexp(1.0 + std::ldexp(1.0, -52), 300));
+
+    // Rounding up can carry into the next power of two, and past the largest double
+    REQUIRE(((Num(1) << 100) - Num(1)).to_double() == std::ldexp(1.0, 100));
+    REQUIRE((Num(1) << 1023).to_double() == std::ldexp(1.0, 1023));
+    REQUIRE(((Num(1) << 1024) - Num(1)).to_double() == HUGE_VAL);
+    REQUIRE((Num(0) - (Num(1) << 1024)).to_double() == -HUGE_VAL);
+    REQUIRE((Num(1) << 1024).to_long_double() == std::ldexp(1.0L, 1024));
+
+    int64_t exp;
+    REQUIRE((Num(1) << 5000).to_double_with_exponent(&exp) == 0.5);
+    REQUIRE(exp == 5001);
+    REQUIRE(Num(-3).to_double_with_exponent(&exp) == -0.75);
+    REQUIRE(exp == 2);
+
+    Num n;
+    REQUIRE(n.from_double(-2.75));
+    REQUIRE(n == -2);
+    REQUIRE(n.from_double(1e300));
+    REQUIRE(n.to_double() == 1e300);
+    REQUIRE(n.from_double(std::ldexp(-1.0, 200)));
+    REQUIRE(n == Num(0) - (Num(1) << 200));
+    REQUIRE(n.from_long_double(std::ldexp(3.0L, 70)));
+    REQUIRE(n == Num(3) << 70);
+    REQUIRE(n.from_double(-0.5));
+    REQUIRE(n == 0);
+    REQUIRE(!n.data.sign);
+    REQUIRE_FALSE(n.from_double(HUGE_VAL));
+    REQUIRE_FALSE(n.from_double(std::nan("")));
+    REQUIRE(n == 0);
+}
+
+TEST_CASE("Num - streaming output", "[Num]")
+{
+    auto written = [](const Num& n, int base) {
+        std::string s;
+        REQUIRE(write_num(n, [&s](const char* p, size_t len) { s.append(p, len); return true; }, base));
+        return s;
+    };
+    auto cstring = [](Num n, int base) {
+        std::vector<char> buf(n.bit_length() + 2);
+        n.to_cstring(buf.data(), int(buf.size()), base);
+        return std::string(buf.data());
+    };
+
+    REQUIRE(written(Num(0), 10) == "0");
+    REQUIRE(written(Num(-1234567), 10) == "-1234567");
+    REQUIRE(written(Num(255), 16) == "FF");
+
+    // Long runs of zeros inside the number have to be padded out at every level
+    Num ten = 10;
+    Num p = ten ^ Num(3000);
+    REQUIRE(written(p + Num(7), 10) == "1" + std::string(2999, '0') + "7");
+
+    Num big = (Num(7) ^ Num(20000)) - Num(1);
+    REQUIRE(written(big, 10) == cstring(big, 10));
+    REQUIRE(written(Num(0) - big, 10) == "-" + cstring(big, 10));
+    REQUIRE(written(big, 2) == cstring(big, 2));
+    REQUIRE(written(big, 36) == cstring(big, 36));
+    REQUIRE(big.to_string() == cstring(big, 10));
+
+    // Either side of the size that is written without splitting, in the smallest and
+    // largest bases, where the buffer is sized tightest and loosest
+    int mismatches = 0;
+    for (int limbs : { 1, 31, 32, 33 })
+        for (Num v : { (Num(1) << (32 * limbs)) - Num(1), Num(1) << (32 * limbs - 1) })
+            for (int base : { 2, 10, 36 })
+                mismatches += written(v, base) == cstring(v, base) ? 0 : 1;
+    REQUIRE(mismatches == 0);
+
+    // The digits come in pieces, and the sink can stop them
+    int pieces = 0;
+    REQUIRE_FALSE(write_num(big, [&pieces](const char*, size_t) { pieces++; return false; }, 2));
+    REQUIRE(pieces == 1);
+
+    FILE* f = tmpfile();
+    REQUIRE(f != nullptr);
+    REQUIRE(write_num(big, f, 16));
+    std::string text(size_t(ftell(f)), ' ');
+    rewind(f);
+    REQUIRE(fread(&text[0], 1, text.size(), f) == text.size());
+    fclose(f);
+    REQUIRE(text == cstring(big, 16));
+}
+
+TEST_CASE("Num - serialization", "[Num]")
+{
+    Num values[] = {
+        Num(0), Num(1), Num(-1), Num(200), Num(-0x1'0000LL), Num(0xFFFF'FFFF'FFFF'FFFFULL),
+        (Num(1) << 100) - 1, Num(0) - (Num(3) << 1000), Num(12345) << 77
+    };
+
+    SECTION("Fixed format round trip")
+    {
+        for (auto& v : values)
+        {
+            uint8_t buf[256];
+            size_t size = serialize(v, buf);
+            REQUIRE(size == serialized_size(v));
+            REQUIRE(size % 4 == 0);
+
+            Num r = 99;
+            REQUIRE(deserialize(r, buf, size) == size);
+            REQUIRE(r == v);
+            REQUIRE(r.data.sign == v.data.sign);
+            REQUIRE(deserialize(r, buf, size - 1) == 0);
+        }
+    }
+
+    SECTION("Compact format round trip")
+    {
+        uint8_t buf[256];
+        REQUIRE(serialize_compact(Num(0), buf) == 1);
+        REQUIRE(serialize_compact(Num(-200), buf) == 2);
+        REQUIRE(serialize_compact(Num(0x1'0000), buf) == 4);
+
+        for (auto& v : values)
+        {
+            size_t size = serialize_compact(v, buf);
+            REQUIRE(size == compact_size(v));
+
+            Num r = 99;
+            REQUIRE(deserialize_compact(r, buf, size) == size);
+            REQUIRE(r == v);
+            REQUIRE(r.data.sign == v.data.sign);
+            REQUIRE(deserialize_compact(r, buf, size - 1) == 0);
+        }
+    }
+
+    SECTION("Non-canonical input")
+    {
+        // Negative zero with a leading zero digit
+        uint8_t buf[] = { 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+        Num r = 5;
+        REQUIRE(deserialize(r, buf, sizeof(buf)) == 12);
+        REQUIRE(r.data.len == 0);
+        REQUIRE(r.data.sign == 0);
+    }
+
+    SECTION("Views of serialized data")
+    {
+        // Serialize a run of values back to back, the way a file of them would be laid
+        // out, then read them in place
+        uint32_t store[1024];
+        uint8_t* p = reinterpret_cast<uint8_t*>(store);
+        size_t total = 0;
+        for (auto& v : values)
+            total += serialize(v, p + total);
+
+        size_t offset = 0;
+        Num sum = 0;
+        for (auto& v : values)
+        {
+            NumView view;
+            size_t used = view_serialized(view, p + offset, total - offset);
+            REQUIRE(used == serialized_size(v));
+            REQUIRE(view.digits == store + offset / 4 + 1);
+            REQUIRE(magcmp(view, v) == 0);
+            REQUIRE(compare(view, v) == 0);
+            REQUIRE(Num(view) == v);
+            REQUIRE(multiply(view, view) == v * v);
+
+            sum += view;
+            offset += used;
+        }
+        REQUIRE(offset == total);
+
+        Num expected = 0;
+        for (auto& v : values)
+            expected += v;
+        REQUIRE(sum == expected);
+
+        REQUIRE(compare(Num(-5), Num(3)) == -1);
+        REQUIRE(compare(Num(-5), Num(-3)) == -1);
+        REQUIRE(compare(Num(5), Num(-30)) == 1);
+        REQUIRE(compare(Num(0), Num(0)) == 0);
+    }
+}
+
+TEST_CASE("NumBatch", "[NumBatch]")
+{
+    // Odd sizes so that the vector loops and the tails both run
+    const int count = 37;
+    const int limbs = 4;
+    Num modulus = Num(1) << (32 * limbs);
+
+    std::vector<Num> xs, ys;
+    Xoshiro256 rng(12345);
+    for (int j = 0; j < count; j++)
+    {
+        Num x = 0, y = 0;
+        int xl = int(rng.next() % (limbs + 1)), yl = int(rng.next() % (limbs + 1));
+        for (int i = 0; i < xl; i++)
+            x = (x << 32) + Num((unsigned long long) (j % 3 == 0 ? 0xFFFF'FFFF : uint32_t(rng.next() >> 32)));
+        for (int i = 0; i < yl; i++)
+            y = (y << 32) + Num((unsigned long long) (j % 5 == 0 ? 0xFFFF'FFFF : uint32_t(rng.next() >> 32)));
+        if (j == 7)
+            y = x;
+        xs.push_back(x);
+        ys.push_back(y);
+    }
+
+    NumBatch a(limbs, count), b(limbs, count);
+    a.gather(xs.data());
+    b.gather(ys.data());
+    for (int j = 0; j < count; j++)
+        REQUIRE(a.get(j) == xs[j]);
+
+    // Every kernel the CPU can run
+    for (int level = 0; level <= int(cpu_max_level()); level++)
+    {
+        set_cpu_level(CpuLevel(level));
+        NumBatch r(limbs, count);
+        add(r, a, b);
+        for (int j = 0; j < count; j++)
+            REQUIRE(r.get(j) == (xs[j] + ys[j]) % modulus);
+
+        sub(r, a, b);
+        for (int j = 0; j < count; j++)
+            REQUIRE(r.get(j) == (xs[j] - ys[j] + modulus) % modulus);
+
+        mul(r, a, b);
+        for (int j = 0; j < count; j++)
+            REQUIRE(r.get(j) == (xs[j] * ys[j]) % modulus);
+
+        NumBatch wide(2 * limbs, count);
+        mul(wide, a, b);
+        std::vector<Num> products(count);
+        wide.scatter(products.data());
+        for (int j = 0; j < count; j++)
+            REQUIRE(products[j] == xs[j] * ys[j]);
+
+        std::vector<int8_t> order(count);
+        compare(order.data(), a, b);
+        for (int j = 0; j < count; j++)
+            REQUIRE(order[j] == (xs[j] < ys[j] ? -1 : xs[j] == ys[j] ? 0 : 1));
+    }
+    set_cpu_level(cpu_max_level());
+
+    // In place, and negative values in two's complement
+    add(a, a, b);
+    REQUIRE(a.get(3) == (xs[3] + ys[3]) % modulus);
+    a.set(0, Num(-1));
+    REQUIRE(a.get(0) == modulus - 1);
+    a.set(0, Num(0) - modulus - Num(5));
+    REQUIRE(a.get(0) == modulus - 5);
+}
+
+TEST_CASE("Num - product and remainder trees", "[Num]")
+{
+    std::vector<Num> moduli = { Num(3), Num(5), Num(7), Num(11), Num(13) };
+    ProductTree tree = product_tree(moduli);
+    REQUIRE(tree.size() == 4);
+    REQUIRE(tree[1].size() == 3);
+    REQUIRE(tree[1][2] == 13);
+    REQUIRE(tree.back()[0] == 15015);
+
+    Num x = (Num(1) << 200) + Num(12345);
+    std::vector<Num> rems = remainder_tree(x, tree);
+    for (size_t i = 0; i < moduli.size(); i++)
+        REQUIRE(rems[i] == x % moduli[i]);
+}
+
+TEST_CASE("Num - residue number system", "[Num]")
+{
+    RnsBasis basis(40);
+    REQUIRE(basis.size() == 40);
+    REQUIRE(basis.primes[0] == 0xFFFF'FFFB);
+    REQUIRE(basis.modulus().bit_length() == 1280);
+
+    Xoshiro256 rng(2024);
+
+    // Round trips, including the edges of the signed range
+    Num half = basis.half;
+    Num values[] = { Num(0), Num(1), Num(-1), random_bits(96, rng), Num(0) - random_bits(640, rng), half, Num(0) - half + Num(1) };
+    for (Num& v : values)
+    {
+        RnsNum r(basis, v);
+        REQUIRE(r.to_num() == v);
+    }
+    Num m = basis.modulus();
+    REQUIRE(RnsNum(basis, Num(-1)).to_unsigned_num() == m - 1);
+    REQUIRE(RnsNum(basis, m + Num(7)).to_num() == 7);
+
+    // An expression whose intermediate values are bigger than its result, evaluated
+    // both ways: a*b - c*d + (a - d)^2
+    Num a = random_bits(288, rng), b = random_bits(256, rng), c = random_bits(288, rng), d = random_bits(256, rng);
+    c = Num(0) - c;
+    Num expected = a * b - c * d + (a - d) * (a - d);
+    RnsNum ra(basis, a), rb(basis, b), rc(basis, c), rd(basis, d);
+    RnsNum diff = ra - rd;
+    RnsNum result = ra * rb - rc * rd + diff * diff;
+    REQUIRE(result.to_num() == expected);
+
+    RnsNum neg = result;
+    neg.negate();
+    REQUIRE(neg.to_num() == Num(0) - expected);
+
+    // A basis of given primes
+    RnsBasis small({ 7, 11, 13 });
+    REQUIRE(small.modulus() == 1001);
+    REQUIRE(RnsNum(small, Num(500)).to_num() == 500);
+    REQUIRE(RnsNum(small, Num(501)).to_num() == -500);
+}
+
+TEST_CASE("Num - polynomials", "[Num]")
+{
+    Philox4x32 rng(49);
+    auto random_poly = [&rng](int count, int bits, bool sparse) {
+        std::vector<Num> c(count);
+        for (Num& x : c)
+        {
+            uint32_t r;
+            rng.fill(&r, 1);
+            if (sparse && r % 3 == 0)
+                continue;
+            x = random_bits(1 + int(r % uint32_t(bits)), rng);
+            if (r & 0x8000'0000)
+                x = Num(0) - x;
+        }
+        return NumPoly(c);
+    };
+
+    // (x - 1)(x + 1) = x^2 - 1, and (x - 1)^2 = x^2 - 2x + 1
+    NumPoly a({ Num(-1), Num(1) }), b({ Num(1), Num(1) });
+    REQUIRE(a * b == NumPoly({ Num(-1), Num(0), Num(1) }));
+    REQUIRE(a * a == NumPoly({ Num(1), Num(-2), Num(1) }));
+    REQUIRE((a * NumPoly()).degree() == -1);
+    REQUIRE((a - a).degree() == -1);
+    REQUIRE(NumPoly({ Num(5), Num(0) }).degree() == 0);
+
+    // Against the schoolbook product, with sizes, signs, zero coefficients and slot
+    // widths on and off digit boundaries
+    int failed = 0;
+    for (int count : { 1, 2, 3, 10, 33 })
+    {
+        for (int bits : { 1, 7, 31, 32, 64, 200 })
+        {
+            for (int sparse = 0; sparse < 2; sparse++)
+            {
+                NumPoly p = random_poly(count, bits, sparse != 0);
+                NumPoly q = random_poly(count + 5, bits / 2 + 1, sparse != 0);
+                failed += p * q == multiply_schoolbook(p, q) ? 0 : 1;
+                failed += q * p == multiply_schoolbook(q, p) ? 0 : 1;
+                failed += p * p == multiply_schoolbook(p, p) ? 0 : 1;
+                NumPoly r = p;
+                r *= r;
+                failed += r == p * p ? 0 : 1;
+
+                // and with the coefficient loop past the cutoff
+                poly_kronecker_bits = 0;
+                failed += p * q == multiply_schoolbook(p, q) ? 0 : 1;
+                poly_kronecker_bits = 384;
+
+                // (p * q)(x) = p(x) * q(x)
+                Num x = random_bits(40, rng);
+                failed += (p * q).evaluate(x) == p.evaluate(x) * q.evaluate(x) ? 0 : 1;
+            }
+        }
+    }
+    REQUIRE(failed == 0);
+
+    // Packing evaluates at 2^w, and unpacking inverts it
+    NumPoly p = random_poly(20, 50, true);
+    Num packed = kronecker_pack(p, 53);
+    REQUIRE(packed == p.evaluate(Num(1) << 53));
+    REQUIRE(kronecker_unpack(packed, 53, 20) == p);
+    REQUIRE(kronecker_unpack(Num(0) - packed, 53, 20) == NumPoly() - p);
+}
+
+TEST_CASE("Num - series and constants", "[Num]")
+{
+    Num big = Num(1) << 300;
+    Num root = isqrt(big);
+    REQUIRE(root == Num(1) << 150);
+    REQUIRE(isqrt(big - Num(1)) == root - Num(1));
+    Num ten = 10;
+    Num p = ten ^ Num(1001);
+    REQUIRE(isqrt(p).to_string() ==
+        "3162277660168379331998893544432718533719555139325216826857504852792594438639238221344248108379300295187347284152840055148548856030453880014690519596700153903344921657179259940659150153474113339484124085316929577090471576461044369257879062037808609941"
+        "82837171154840632855299911859682456420332696160469131433612894979189026652954361267617878135006138818627858046368313495247803114376933467197381951318567840323124179540221830804587284461460025357757970282864402902440797789603454398916334922265261206779");
+    REQUIRE(isqrt(Num(0)) == 0);
+    REQUIRE(isqrt(Num(0xFFFF'FFFF'FFFF'FFFFULL)) == 0xFFFF'FFFFU);
+
+    // sum_{k=1}^{20} 1/(k(k+1)) = 20/21, with p = q = 1 and b = k(k+1)
+    SeriesSum s = binary_split([](int64_t k, Num& p, Num& q, Num& a, Num& b) {
+        p = 1;
+        q = 1;
+        a = 1;
+        b = Num((long long) (k * (k + 1)));
+    }, 1, 21, true, 1);
+    REQUIRE(s.T * Num(21) == s.B * s.Q * Num(20));
+    REQUIRE(s.P == 1);
+
+    const char* pi = "3141592653589793238462643383279502884197169399375105820974944592307816406286";
+    const char* e = "2718281828459045235360287471352662497757247093699959574966967627724076630353";
+    const char* log2 = "693147180559945309417232121458176568075500134360255254120680009493393621969";
+    REQUIRE(pi_digits(75, 1).to_string() == pi);
+    REQUIRE(e_digits(75, 1).to_string() == e);
+    REQUIRE(log2_digits(75, 1).to_string() == log2);
+    REQUIRE(pi_digits(0) == 3);
+
+    // Threads change the order of the work, not the result
+    REQUIRE(pi_digits(3000, 4) == pi_digits(3000, 1));
+    REQUIRE(e_digits(3000, 3) == e_digits(3000, 1));
+}
+
+TEST_CASE("BigFloat", "[BigFloat]")
+{
+    // Ties round to even
+    REQUIRE(BigFloat(Num(21), 0, 4).to_num() == 20);
+    REQUIRE(BigFloat(Num(23), 0, 4).to_num() == 24);
+    REQUIRE(BigFloat(Num(22), 0, 4).mantissa == 11);
+
+    BigFloat two(Num(2), 200);
+    REQUIRE(sqrt(two).to_string(50) == "1.41421356237309504880168872420969807856967187537694");
+    BigFloat third = BigFloat(Num(1), 200) / BigFloat(Num(3), 200);
+    REQUIRE(third.to_string(30) == "0.333333333333333333333333333333");
+    REQUIRE((-third).to_string(5) == "-0.33333");
+    REQUIRE(third * BigFloat(Num(3), 200) == BigFloat(Num(1), 200));
+
+    // At 53 bits the results are those of doubles
+    double x = 1.0 / 7, y = 3.0e-5;
+    REQUIRE((BigFloat(x, 53) + BigFloat(y, 53)).to_double() == x + y);
+    REQUIRE((BigFloat(x, 53) - BigFloat(y, 53)).to_double() == x - y);
+    REQUIRE((BigFloat(x, 53) * BigFloat(y, 53)).to_double() == x * y);
+    REQUIRE((BigFloat(x, 53) / BigFloat(y, 53)).to_double() == x / y);
+    REQUIRE(sqrt(BigFloat(x, 53)).to_double() == std::sqrt(x));
+
+    // Subnormal results are rounded once, to the bits the double keeps: 2.5 + 2^-80
+    // times the smallest subnormal is 3 of them, not 2.5 rounded to 53 bits and then
+    // to even. Half the smallest subnormal is a tie that goes to zero.
+    double smallest = std::ldexp(1.0, -1074);
+    REQUIRE(BigFloat((Num(5) << 80) + Num(1), -1155, 400).to_double() == 3 * smallest);
+    REQUIRE(BigFloat(Num(5), -1075, 400).to_double() == 2 * smallest);
+    REQUIRE(BigFloat(Num(-3), -1076, 400).to_double() == -smallest);
+    REQUIRE(BigFloat(Num(1), -1075, 400).to_double() == 0.0);
+
+    // A sum of very different sizes rounds correctly without lining them up
+    BigFloat big(Num(1), 1'000'000'000'000LL, 64);
+    BigFloat one(Num(1), 64);
+    REQUIRE(big + one == big);
+    REQUIRE(big - one == big);
+    REQUIRE(add(BigFloat(Num(1), 64, 64), one, 65).to_num() == (Num(1) << 64) + Num(1));
+    REQUIRE(add(BigFloat(Num(1), 64, 64), one, 64).to_num() == Num(1) << 64);
+    REQUIRE((big * big).exponent == 2'000'000'000'000LL);
+
+    // e from its series agrees with the binary splitting
+    BigFloat e(Num(0), 300), term(Num(1), 300);
+    for (int k = 1; k < 120; k++)
+    {
+        e += term;
+        term /= BigFloat(Num(k), 300);
+    }
+    std::string digits = e.to_string(80);
+    digits.erase(1, 1);
+    REQUIRE(digits == e_digits(80, 1).to_string());
+
+    REQUIRE(compare(BigFloat(-2.5), BigFloat(-2.25)) < 0);
+    REQUIRE(BigFloat(-2.5).to_num() == -2);
+    REQUIRE(BigFloat(0.0).is_zero());
+}
+
+TEST_CASE("Num - gcd", "[Num]")
+{
+    auto euclid = [](Num x, Num y) {
+        x.data.sign = 0;
+        y.data.sign = 0;
+        while (y.data.len != 0)
+        {
+            Num q, r;
+            x.divmod(y, q, r);
+            x = std::move(y);
+            y = std::move(r);
+        }
+        return x;
+    };
+
+    auto magnitude = [](Num n) {
+        n.data.sign = 0;
+        return n;
+    };
+
+    Num s, t;
+    REQUIRE(gcdext(Num(0), Num(0), s, t) == 0);
+    REQUIRE((s == 0 && t == 0));
+    REQUIRE(gcdext(Num(-5), Num(0), s, t) == 5);
+    REQUIRE((s == -1 && t == 0));
+    REQUIRE(gcdext(Num(240), Num(46), s, t) == 2);
+    REQUIRE((s == -9 && t == 47));
+
+    // Lehmer alone, and the half-GCD with small thresholds so that it recurses
+    // several levels on numbers of a few hundred digits
+    int threshold = gcd_hgcd_threshold;
+    Philox4x32 rng(2024);
+    for (int th : { threshold, 16, 4 })
+    {
+        gcd_hgcd_threshold = th;
+        for (int i = 0; i < 40; i++)
+        {
+            Num g = random_bits(1 + 37 * i, rng);
+            Num a = multiply(random_bits(64 * i + 1, rng), g);
+            Num b = multiply(random_bits(64 * i / (1 + i % 4) + 1, rng), g);
+            if (i % 3 == 1 && a.data.len != 0)
+                a.data.sign = -1;
+            if (i % 5 == 2 && b.data.len != 0)
+                b.data.sign = -1;
+
+            Num expect = euclid(a, b);
+            REQUIRE(gcd(a, b) == expect);
+            REQUIRE(gcdext(a, b, s, t) == expect);
+            Num sum = multiply(a, s);
+            sum += multiply(b, t);
+            REQUIRE(sum == expect);
+            if (b != 0)
+            {
+                Num limit = divexact(magnitude(b), expect);
+                Num twice = magnitude(s);
+                twice <<= 1;
+                REQUIRE(magcmp(twice, limit) <= 0);
+            }
+        }
+    }
+    gcd_hgcd_threshold = threshold;
+}
+
+TEST_CASE("Rational", "[Rational]")
+{
+    REQUIRE(gcd(Num(0), Num(0)) == 0);
+    REQUIRE(gcd(Num(-12), Num(18)) == 6);
+    REQUIRE(gcd(Num(1) << 200, Num(3) << 100) == Num(1) << 100);
+    Num ten = 10;
+    Num p40 = ten ^ Num(40);
+    REQUIRE(gcd(ten ^ Num(50), p40 * Num(7)) == p40);
+
+    Rational h;
+    for (int k = 1; k <= 10; k++)
+        h += Rational(Num(1), Num(k));
+    REQUIRE(h.reduced);
+    REQUIRE(h.to_string() == "7381/2520");
+
+    Rational x(Num(6), Num(-4));
+    REQUIRE(x == Rational(Num(-3), Num(2)));
+    REQUIRE(x.to_string() == "-3/2");
+    REQUIRE(x.to_double() == -1.5);
+    REQUIRE((x * x / x - x).to_string() == "0");
+    REQUIRE((x / Rational(Num(-3))).to_string() == "1/2");
+    REQUIRE(Rational(Num(1), Num(3)) < Rational(Num(1), Num(2)));
+    REQUIRE(-Rational(Num(1), Num(3)) > -Rational(Num(1), Num(2)));
+
+    // Unreduced values are reduced once they have grown enough
+    Rational big(Num(1) << 100, Num(3) << 100);
+    REQUIRE(!big.reduced);
+    Rational r = big;
+    for (int i = 0; i < 20; i++)
+        r *= big;
+    REQUIRE(r.num.bit_length() + r.den.bit_length() < 2000);
+    REQUIRE(r == Rational(Num(1), Num(3) ^ Num(21)));
+
+    // sum of 1/k^2, against the same sum kept in lowest terms by hand
+    Rational s;
+    Num n = 0, d = 1;
+    for (int k = 1; k <= 200; k++)
+    {
+        Num k2 = (long long) k * k;
+        s += Rational(Num(1), k2);
+        n = multiply(n, k2) + d;
+        d = multiply(d, k2);
+        Num g = gcd(n, d);
+        n = divexact(n, g);
+        d = divexact(d, g);
+    }
+    s.normalize();
+    REQUIRE(s.num == n);
+    REQUIRE(s.den == d);
 }
 
 TEST_CASE("Num - exponentiation", "[Num]")
@@ -945,6 +1878,319 @@ TEST_CASE("Num - exponentiation", "[Num]")
     REQUIRE(N <= 1024);
     REQUIRE(N == 102);
     REQUIRE(buf == std::string("10000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000"));
+
+    // Signs and trivial bases, including exponents that don't fit in a digit
+    Num huge_exp = Num(2)^Num(100);
+    REQUIRE((Num(-3)^Num(3)) == -27);
+    REQUIRE((Num(-3)^Num(3)).data.sign != 0);
+    REQUIRE((Num(-3)^Num(4)).data.sign == 0);
+    REQUIRE((Num(7)^Num(0)) == 1);
+    REQUIRE((Num(0)^Num(5)) == 0);
+    REQUIRE((Num(1)^huge_exp) == 1);
+    REQUIRE((Num(0)^huge_exp) == 0);
+    REQUIRE((Num(-1)^huge_exp).data.sign == 0);
+    REQUIRE(((Num(-1)^(huge_exp + Num(1))).data.sign) != 0);
+    REQUIRE((Num(5)^Num(-2)) == 0);
+
+    // Powers of two are written directly
+    Num p2 = Num(2)^Num(100'000);
+    REQUIRE(p2.data.len == 3126);
+    REQUIRE(p2.cdatabuffer()[3125] == 1);
+    REQUIRE((Num(4)^Num(50'000)) == p2);
+    REQUIRE((Num(12)^Num(40)) == (Num(3)^Num(40)) * (Num(2)^Num(80)));
+
+    // Compare sliding windows against repeated multiplication
+    Num base = Num(0x1234'5678'9ABCLL);
+    Num slow = 1;
+    for (int i = 1; i <= 300; i++)
+    {
+        slow *= base;
+        if (i % 37 == 0 || i == 300)
+            REQUIRE((base^Num(i)) == slow);
+    }
+}
+
+TEST_CASE("Num - multi-exponentiation", "[Num]")
+{
+    Xoshiro256 rng(42);
+
+    // Exact products, against separate powers
+    Num bases[] = { Num(3), Num(-5), Num(7), Num(0x1234'5678LL) };
+    Num exps[] = { Num(100), Num(37), Num(0), Num(61) };
+    Num expected = 1;
+    for (int i = 0; i < 4; i++)
+        expected *= bases[i] ^ exps[i];
+    REQUIRE(multi_pow(bases, exps, 4) == expected);
+    REQUIRE(multi_pow(bases, exps, 0) == 1);
+
+    // g^a h^b mod p, with odd (Montgomery) and even moduli, and reduced results
+    // against separate powers, for counts that take both Straus and Pippenger
+    for (Num m : { random_bits(256, rng) | Num(1), random_bits(160, rng) << 3, Num(1), Num(2) })
+    {
+        for (int count : { 1, 2, 5, 200 })
+        {
+            std::vector<Num> b(count), e(count);
+            Num expected_mod = 1;
+            for (int i = 0; i < count; i++)
+            {
+                b[i] = random_bits(192, rng);
+                if (i % 3 == 1)
+                    b[i] = Num(0) - b[i];
+                e[i] = random_bits(32 * (1 + i % 4), rng);
+                Num r = 1;
+                Num x = b[i] % m;
+                for (int bit = e[i].bit_length() - 1; bit >= 0; bit--)
+                {
+                    r = multiply(r, r) % m;
+                    if (e[i].test_bit(bit))
+                        r = multiply(r, x) % m;
+                }
+                expected_mod = multiply(expected_mod, r) % m;
+            }
+            if (expected_mod.data.sign)
+                expected_mod += m;
+            REQUIRE(multi_pow_mod(b.data(), e.data(), count, m) == expected_mod);
+        }
+    }
+}
+
+TEST_CASE("Num - integer operands", "[Num]")
+{
+    Num x = Num(1) << 100;
+    x += 12345;
+    Num seven = 7;
+
+    REQUIRE(x % 7 == x % seven);
+    REQUIRE(x / 7 == x / seven);
+    REQUIRE(5 + x == x + Num(5));
+    REQUIRE(5 - x == Num(5) - x);
+    REQUIRE(3u * x == x * Num(3));
+    REQUIRE(x * int64_t(-3) == x * Num(-3));
+    REQUIRE(x * UINT64_MAX == x * Num((unsigned long long) UINT64_MAX));
+    REQUIRE(100 / Num(7) == 14);
+    REQUIRE(-100 % Num(7) == -2);
+    REQUIRE(100 / x == 0);
+    REQUIRE(-100 % x == -100);
+    REQUIRE(Num(-7) / 2 == 3); // division is of magnitudes, as for Num operands
+    REQUIRE(Num(-7) % 2 == -1);
+    REQUIRE(INT64_MIN + Num(0) == Num((long long) INT64_MIN));
+    REQUIRE(Num(0) - INT64_MIN == Num(1) << 63);
+
+    REQUIRE(x > 5);
+    REQUIRE(5 < x);
+    REQUIRE(Num(-5) < 0u);
+    REQUIRE(Num(-5) == -5);
+    REQUIRE(-5 == Num(-5));
+    REQUIRE(Num(5) != -5);
+    REQUIRE(Num((unsigned long long) UINT64_MAX) == UINT64_MAX);
+    REQUIRE(Num((unsigned long long) UINT64_MAX) > INT64_MAX);
+    REQUIRE(INT64_MIN < Num((long long) INT64_MIN) + 1);
+
+    // Every integer width, on both sides, against the same operation on Nums
+    auto check = [](const Num& a, auto v) {
+        Num n = std::is_signed_v<decltype(v)> ? Num((long long) v) : Num((unsigned long long) v);
+        Num nc = n, ac = a;
+        bool ok = a + v == ac + n && v + a == nc + ac && a - v == ac - n && v - a == nc - ac &&
+                  a * v == ac * n && v * a == nc * ac;
+        if (v != 0)
+            ok = ok && a / v == ac / n && a % v == ac % n;
+        if (a != 0)
+            ok = ok && v / a == nc / ac && v % a == nc % ac;
+        int c = compare(a, n);
+        ok = ok && (a < v) == (c < 0) && (a == v) == (c == 0) && (v < a) == (c > 0) && (v >= a) == (c <= 0);
+
+        Num r = a;
+        r += v;
+        r *= v;
+        r -= v;
+        ok = ok && r == (ac + n) * n - n;
+        if (v != 0)
+        {
+            r /= v;
+            ok = ok && r == ((ac + n) * n - n) / n;
+        }
+        return ok;
+    };
+
+    Xoshiro256 rng(99);
+    int failed = 0;
+    for (int i = 0; i < 500; i++)
+    {
+        Num a = Num((unsigned long long) rng.next()) << (i % 150);
+        if (i % 2)
+            a.data.sign = a.data.len ? -1 : 0;
+        uint64_t u = rng.next() >> (i % 64);
+        failed += !check(a, int32_t(u)) + !check(a, uint32_t(u)) + !check(a, int64_t(u)) +
+                  !check(a, uint64_t(u)) + !check(a, (long long) u);
+    }
+    REQUIRE(failed == 0);
+
+    // Nothing is allocated for a result that fits the Num it goes in
+    {
+        Num sum;
+        sum.reserve(10);
+        sum = x;
+        NumAllocationGuard guard;
+        sum += 12;
+        sum *= 1000;
+        sum -= INT64_MAX;
+        sum /= 3u;
+        REQUIRE(x % 7 < 7);
+        REQUIRE(x > 0);
+        REQUIRE(guard.allocations() == 0);
+    }
+}
+
+TEST_CASE("Num - counters", "[Num]")
+{
+    // Two 32-digit numbers
+    Num a = 1;
+    a <<= 1000;
+    a -= 1;
+    Num b = a;
+
+    // A product is one allocation, for the result
+    NumCounters before = num_counters();
+    Num p = multiply(a, b);
+    NumCounters d = num_counters() - before;
+    if (NUM_COUNTERS)
+    {
+        REQUIRE(d.allocations == 1);
+        REQUIRE(d.calls[int(NumOp::Mul)] == 1);
+        REQUIRE(d.limbs[int(NumOp::Mul)] == 64);
+    }
+
+    // A copy allocates just the digits it needs, and a move allocates nothing
+    before = num_counters();
+    Num c = a;
+    Num m = std::move(c);
+    d = num_counters() - before;
+    if (NUM_COUNTERS)
+    {
+        REQUIRE(d.copies == 1);
+        REQUIRE(d.moves == 1);
+        REQUIRE(d.allocations == 1);
+        REQUIRE(d.bytes_allocated == 32 * sizeof(uint32_t));
+    }
+
+    // Arithmetic into a Num with room for the result doesn't allocate
+    {
+        Num sum;
+        sum.reserve(40);
+        NumAllocationGuard guard;
+        sum = a;
+        sum += b;
+        sum -= a;
+        REQUIRE(sum == b);
+        REQUIRE(guard.allocations() == 0);
+        if (NUM_COUNTERS)
+        {
+            REQUIRE(guard.counted().calls[int(NumOp::Add)] == 1);
+            REQUIRE(guard.counted().calls[int(NumOp::Sub)] == 1);
+            REQUIRE(guard.counted().limbs[int(NumOp::Add)] == 64);
+        }
+    }
+
+    // Montgomery multi-exponentiation counts the digits of its tables too, and frees
+    // all of them
+    {
+        Montgomery mont(a);
+        std::vector<uint32_t> x(mont.size()), y(mont.size()), r(mont.size());
+        mont.to_mont(x.data(), 3);
+        mont.to_mont(y.data(), 5);
+        const uint32_t* bases[] = { x.data(), y.data() };
+        Num exps[] = { Num(12345), Num(678) };
+        NumAllocationGuard guard(false);
+        mont.multi_pow(r.data(), bases, exps, 2);
+        if (NUM_COUNTERS)
+        {
+            REQUIRE(guard.allocations() > 2);
+            REQUIRE(guard.counted().frees == guard.allocations());
+        }
+    }
+
+    // Without NUM_COUNTERS the counters stay at zero
+    if (!NUM_COUNTERS)
+    {
+        REQUIRE(num_counters().allocations == 0);
+        REQUIRE(num_counters().calls[int(NumOp::Mul)] == 0);
+    }
+    REQUIRE(0 == strcmp(num_op_name(NumOp::Bitwise), "bitwise"));
+}
+
+TEST_CASE("Num - random", "[Num]")
+{
+    // Known answers from the generators' reference implementations
+    uint32_t out[4];
+    uint32_t key[2] = { 0xA409'3822, 0x299F'31D0 };
+    Philox4x32::block(key, 0x85A3'08D3'243F'6A88ULL, 0x0370'7344'1319'8A2EULL, out);
+    REQUIRE(out[0] == 0xD16C'FE09);
+    REQUIRE(out[1] == 0x94FD'CCEB);
+    REQUIRE(out[2] == 0x5001'E420);
+    REQUIRE(out[3] == 0x2412'6EA1);
+
+    Xoshiro256 x(1, 2, 3, 4);
+    REQUIRE(x.next() == 11520);
+    REQUIRE(x.next() == 0);
+    REQUIRE(x.next() == 1509978240);
+
+    // Every kernel gives the same stream, however it is split up
+    std::vector<uint32_t> whole(1001), parts(1001);
+    set_cpu_level(CpuLevel::Scalar);
+    Philox4x32(99, 3).fill(whole.data(), whole.size());
+    for (int level = 0; level <= int(cpu_max_level()); level++)
+    {
+        set_cpu_level(CpuLevel(level));
+        Philox4x32 p(99, 3);
+        p.fill(parts.data(), 3);
+        p.fill(parts.data() + 3, 6);
+        p.fill(parts.data() + 9, 992);
+        REQUIRE(parts == whole);
+
+        Philox4x32 q(99, 3);
+        q.seek(501);
+        q.fill(parts.data(), 500);
+        REQUIRE(std::equal(parts.begin(), parts.begin() + 500, whole.begin() + 501));
+    }
+    set_cpu_level(cpu_max_level());
+
+    // random_bits fills exactly the bits asked for
+    Philox4x32 rng(1);
+    int top_set = 0;
+    for (int bits : { 1, 31, 32, 33, 100, 1000 })
+    {
+        for (int i = 0; i < 20; i++)
+        {
+            Num r = random_bits(bits, rng);
+            REQUIRE(r.data.sign == 0);
+            REQUIRE(r.bit_length() <= bits);
+            top_set += r.bit_length() == bits ? 1 : 0;
+        }
+    }
+    REQUIRE(top_set > 30);
+    REQUIRE(random_bits(0, rng) == 0);
+
+    // random_below stays below the bound, and is reproducible from the seed
+    Num bound = Num(1) << 100;
+    bound += 12345;
+    Xoshiro256 a(7), b(7);
+    for (int i = 0; i < 100; i++)
+    {
+        Num r = random_below(bound, a);
+        REQUIRE(r < bound);
+        REQUIRE(r == random_below(bound, b));
+    }
+
+    // and is uniform: six buckets of 6000 draws should each get close to 1000
+    int counts[6] = {};
+    for (int i = 0; i < 6000; i++)
+    {
+        int64_t r = random_below(Num(6), rng).to_int64();
+        if (r >= 0 && r < 6)
+            counts[r]++;
+    }
+    for (int c : counts)
+        REQUIRE((c > 850 && c < 1150));
 }
 
 TEST_CASE("Num - Mersenne primes", "[Num]")
@@ -1055,6 +2301,56 @@ TEST_CASE("Num - conversions", "[Num]")
     }
 }
 
+TEST_CASE("Num - primes", "[Num]")
+{
+    SECTION("Small values")
+    {
+        long long primes[] = { 2, 3, 5, 7, 11, 13, 2039, 2053, 65521, 4294967291 };
+        long long composites[] = { 0, 1, 4, 9, 561, 2047, 4157521, 65535 };
+        for (long long p : primes)
+            REQUIRE(is_probable_prime(Num(p)));
+        for (long long c : composites)
+            REQUIRE_FALSE(is_probable_prime(Num(c)));
+        REQUIRE_FALSE(is_probable_prime(Num(-7)));
+    }
+
+    SECTION("Pseudoprimes")
+    {
+        // strong pseudoprimes to bases 2, 3, 5 and 7 (and to all bases up to 23)
+        REQUIRE_FALSE(is_probable_prime(Num(3215031751LL)));
+        REQUIRE_FALSE(is_probable_prime(Num(3825123056546413051LL)));
+        REQUIRE_FALSE(is_probable_prime(Num(3825123056546413051LL), 10));
+    }
+
+    SECTION("Large values")
+    {
+        Num m127 = (Num(2)^Num(127)) - Num(1);
+        Num m521 = (Num(2)^Num(521)) - Num(1);
+        REQUIRE(is_probable_prime(m127));
+        REQUIRE(is_probable_prime(m521, 5));
+        REQUIRE_FALSE(is_probable_prime((Num(2)^Num(128)) + Num(1)));
+        REQUIRE_FALSE(is_probable_prime(m127 * m521));
+        REQUIRE_FALSE(is_probable_prime(m127 * m127));
+    }
+
+    SECTION("next_prime")
+    {
+        REQUIRE(next_prime(Num(0)) == 2);
+        REQUIRE(next_prime(Num(2)) == 3);
+        REQUIRE(next_prime(Num(2039)) == 2053);
+        REQUIRE(next_prime(Num(1000000)) == 1000003);
+
+        Num ten_e20;
+        ten_e20.from_string(std::string_view("100000000000000000000"));
+        REQUIRE(next_prime(ten_e20) == ten_e20 + Num(39));
+
+        Num two_e256 = Num(2)^Num(256);
+        REQUIRE(next_prime(two_e256) == two_e256 + Num(297));
+        Num two_e521 = Num(2)^Num(521);
+        REQUIRE(next_prime(two_e521) == two_e521 + Num(887));
+    }
+}
+
 #if 0
 
 TEST_CASE("Num - multiply and divide", "[Num]")
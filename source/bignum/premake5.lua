@@ -1,11 +1,20 @@
 local BUILD = "../../build/bignum" -- we are two levels from the top
 
+-- premake5 --num-counters <action> builds with the allocation and operation counters
+-- in NumCounters.h turned on
+newoption {
+   trigger     = "num-counters",
+   description = "Count Num allocations, copies and limbs touched (see NumCounters.h)"
+}
+
 project "bignum"
     location(BUILD)
     kind "ConsoleApp"
     --language "C++"
     --cppdialect "C++14"
-    files { "**.cpp", "**.h", "../catch.hpp" }
+    files { "**.cpp", "**.h", "../catch.hpp", "../compat/CpuFeatures.cpp", "../compat/CpuFeatures.h",
+            "../tasks/TaskPool.cpp", "../tasks/TaskPool.h", "../tasks/WorkDeque.h" }
+    removefiles { "bench/**" }
     --warnings "Extra"
 
     --filter { "action:vs*" }
@@ -14,8 +23,21 @@ project "bignum"
     --filter { "action:xcode*" }
     --    buildoptions { '-std=c++1' }
 
-    -- should this be done at the workspace level or the project level? If one library
-    -- is using lzcnt intrinsics, we expect all of them to be compatible with that.
-    -- is this a link issue?
-    filter { "action:xcode*" }
-      buildoptions { "-mlzcnt" }
+    -- the series and tree code runs on the task pool
+    filter { "system:linux" }
+      links { "pthread" }
+    filter { "options:num-counters" }
+      defines { "NUM_COUNTERS=1" }
+
+-- throughput across operand sizes: the library without the tests, and bench/
+project "bignum-bench"
+    location(BUILD)
+    kind "ConsoleApp"
+    files { "*.cpp", "*.h", "bench/**.cpp", "../compat/CpuFeatures.cpp", "../compat/CpuFeatures.h",
+            "../tasks/TaskPool.cpp", "../tasks/TaskPool.h", "../tasks/WorkDeque.h" }
+    removefiles { "main.cpp" }
+
+    filter { "system:linux" }
+      links { "pthread" }
+    filter { "options:num-counters" }
+      defines { "NUM_COUNTERS=1" }
@@ -0,0 +1,222 @@
+// CpuFeatures.cpp
+
+#include "CpuFeatures.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(CPU_X86)
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(CPU_X86)
+#include <cpuid.h>
+#endif
+
+#if defined(CPU_X86)
+
+// eax, ebx, ecx, edx of a CPUID leaf
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t r[4])
+{
+    #if defined(_MSC_VER)
+    int x[4];
+    __cpuidex(x, int(leaf), int(subleaf));
+    for (int i = 0; i < 4; i++)
+        r[i] = uint32_t(x[i]);
+    #else
+    __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+    #endif
+}
+
+// The register state the OS saves (XCR0)
+static uint64_t xgetbv0()
+{
+    #if defined(_MSC_VER)
+    return _xgetbv(0);
+    #else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (uint64_t(hi) << 32) | lo;
+    #endif
+}
+
+static bool bit(uint32_t v, int i)
+{
+    return (v >> i) & 1;
+}
+
+static CpuFeatures detect()
+{
+    CpuFeatures f;
+    uint32_t r[4];
+
+    cpuid(0, 0, r);
+    uint32_t max_leaf = r[0];
+    memcpy(f.vendor + 0, &r[1], 4);
+    memcpy(f.vendor + 4, &r[3], 4);
+    memcpy(f.vendor + 8, &r[2], 4);
+
+    cpuid(0x8000'0000, 0, r);
+    uint32_t max_ext = r[0];
+    if (max_ext >= 0x8000'0001)
+    {
+        cpuid(0x8000'0001, 0, r);
+        f.lzcnt = bit(r[2], 5);
+    }
+    if (max_ext >= 0x8000'0004)
+    {
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            cpuid(0x8000'0002 + i, 0, r);
+            memcpy(f.brand + 16 * i, r, 16);
+        }
+    }
+
+    if (max_leaf < 7)
+        return f;
+
+    // AVX needs the OS to save the YMM state (XCR0 bits 1 and 2), and AVX-512 the
+    // mask and ZMM state as well (bits 5 to 7)
+    cpuid(1, 0, r);
+    bool osxsave = bit(r[2], 27);
+    uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+    bool ymm = (xcr0 & 0x06) == 0x06;
+    bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+    cpuid(7, 0, r);
+    uint32_t ebx = r[1];
+    f.bmi2 = bit(ebx, 8);
+    f.adx = bit(ebx, 19);
+    f.avx2 = ymm && bit(ebx, 5);
+    f.avx512f = zmm && bit(ebx, 16);
+    f.avx512bw = f.avx512f && bit(ebx, 30);
+    f.avx512ifma = f.avx512f && bit(ebx, 21);
+    return f;
+}
+
+#else
+
+static CpuFeatures detect()
+{
+    return CpuFeatures();
+}
+
+#endif
+
+const CpuFeatures& cpu_features()
+{
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+// ======================================================================================
+
+static const char* const level_names[] = { "scalar", "avx2", "avx512" };
+
+const char* cpu_level_name(CpuLevel level)
+{
+    return level_names[int(level)];
+}
+
+CpuLevel cpu_max_level()
+{
+    const CpuFeatures& f = cpu_features();
+    if (f.avx512f && f.avx512bw)
+        return CpuLevel::AVX512;
+    if (f.avx2)
+        return CpuLevel::AVX2;
+    return CpuLevel::Scalar;
+}
+
+static int initial_level()
+{
+    int level = int(cpu_max_level());
+    if (const char* env = getenv("CPU_LEVEL"))
+    {
+        for (int i = 0; i < level; i++)
+            if (0 == strcmp(env, level_names[i]))
+                level = i;
+    }
+    return level;
+}
+
+static std::atomic<int>& current_level()
+{
+    static std::atomic<int> level(initial_level());
+    return level;
+}
+
+CpuLevel cpu_level()
+{
+    return CpuLevel(current_level().load(std::memory_order_relaxed));
+}
+
+void set_cpu_level(CpuLevel level)
+{
+    if (level > cpu_max_level())
+        level = cpu_max_level();
+    current_level().store(int(level), std::memory_order_relaxed);
+}
+
+// ======================================================================================
+
+// What the compiler was told it may use everywhere (-m flags or /arch)
+#if defined(__LZCNT__)
+static constexpr bool baseline_lzcnt = true;
+#else
+static constexpr bool baseline_lzcnt = false;
+#endif
+#if defined(__BMI2__)
+static constexpr bool baseline_bmi2 = true;
+#else
+static constexpr bool baseline_bmi2 = false;
+#endif
+#if defined(__ADX__)
+static constexpr bool baseline_adx = true;
+#else
+static constexpr bool baseline_adx = false;
+#endif
+#if defined(__AVX2__)
+static constexpr bool baseline_avx2 = true;
+#else
+static constexpr bool baseline_avx2 = false;
+#endif
+#if defined(__AVX512F__)
+static constexpr bool baseline_avx512f = true;
+#else
+static constexpr bool baseline_avx512f = false;
+#endif
+#if defined(__AVX512BW__)
+static constexpr bool baseline_avx512bw = true;
+#else
+static constexpr bool baseline_avx512bw = false;
+#endif
+#if defined(__AVX512IFMA__)
+static constexpr bool baseline_avx512ifma = true;
+#else
+static constexpr bool baseline_avx512ifma = false;
+#endif
+
+void print_cpu_report(FILE* fp)
+{
+    const CpuFeatures& f = cpu_features();
+    fprintf(fp, "cpu:      %s %s\n", f.vendor[0] ? f.vendor : "(not x86)", f.brand);
+
+    struct { const char* name; bool detected; bool compiled; } rows[] = {
+        { "lzcnt", f.lzcnt, baseline_lzcnt },
+        { "bmi2", f.bmi2, baseline_bmi2 },
+        { "adx", f.adx, baseline_adx },
+        { "avx2", f.avx2, baseline_avx2 },
+        { "avx512f", f.avx512f, baseline_avx512f },
+        { "avx512bw", f.avx512bw, baseline_avx512bw },
+        { "avx512ifma", f.avx512ifma, baseline_avx512ifma },
+    };
+
+    // A feature in the baseline that the CPU lacks means this binary can fault
+    fprintf(fp, "%-12s %-4s %s\n", "feature", "cpu", "baseline");
+    for (auto& row : rows)
+        fprintf(fp, "%-12s %-4s %s%s\n", row.name, row.detected ? "yes" : "no", row.compiled ? "yes" : "no",
+                row.compiled && !row.detected ? "  <- unsupported" : "");
+
+    fprintf(fp, "dispatch: %s (best %s)\n", cpu_level_name(cpu_level()), cpu_level_name(cpu_max_level()));
+}
@@ -0,0 +1,79 @@
+// CpuFeatures.h
+// - run-time detection of x86 instruction set extensions
+//
+// Kernels that use AVX2 or AVX-512 are compiled into every build (with a target
+// attribute on gcc and clang, so the rest of the program is built for the baseline
+// ISA), and a dispatch table picks the best one the running CPU supports. This keeps
+// one binary correct on older CPUs and fast on newer ones.
+//
+// The extensions are checked with CPUID, and the vector ones also with XGETBV, since
+// an OS that doesn't save the wider registers on a context switch makes them unusable
+// even on a CPU that has them.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+// Compile one function for an extension the rest of the file isn't built for. MSVC
+// allows any intrinsic anywhere, so it needs nothing.
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CPU_TARGET(isa)
+#endif
+
+// GCC 12 warns that '__Y' may be used uninitialized in AVX-512 intrinsics that start
+// from _mm512_undefined_*, such as the shifts and mul_epu32, once they are inlined
+// into a kernel (GCC bug 105593, fixed in GCC 13). The AVX-512 kernels go between
+// these, which turn that warning off for them alone.
+#if defined(__GNUC__) && !defined(__clang__)
+#define CPU_AVX512_BEGIN _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+#define CPU_AVX512_END _Pragma("GCC diagnostic pop")
+#else
+#define CPU_AVX512_BEGIN
+#define CPU_AVX512_END
+#endif
+
+struct CpuFeatures
+{
+    bool lzcnt = false;
+    bool bmi2 = false;
+    bool adx = false;
+    bool avx2 = false;       // including OS support for the YMM registers
+    bool avx512f = false;    // including OS support for the ZMM and mask registers
+    bool avx512bw = false;
+    bool avx512ifma = false;
+    char vendor[13] = {};
+    char brand[49] = {};
+};
+
+// The features of the running CPU, detected on the first call
+const CpuFeatures& cpu_features();
+
+// The vector kernels a dispatch table can pick, in increasing order
+enum class CpuLevel
+{
+    Scalar,
+    AVX2,   // AVX2
+    AVX512, // AVX-512 F and BW
+};
+
+const char* cpu_level_name(CpuLevel level);
+
+// The best level the CPU supports
+CpuLevel cpu_max_level();
+
+// The level dispatch tables use. It starts at cpu_max_level(), or lower if the
+// CPU_LEVEL environment variable names a lower one ("scalar", "avx2"), and can be
+// lowered (for tests and benchmarks) with set_cpu_level. It is never set above
+// cpu_max_level().
+CpuLevel cpu_level();
+void set_cpu_level(CpuLevel level);
+
+// Write the detected features, the compile-time baseline and the dispatch level
+void print_cpu_report(FILE* fp);
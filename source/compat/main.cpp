@@ -1,10 +1,14 @@
 // main.cpp
 
-// This only exists because the Visual C++ compiler doesn't offer a way to dump
-// out all the predefined macros
+// Report the CPU features this machine has, and which of them the build assumes.
+// With --macros, dump the predefined macros instead; this exists because the Visual
+// C++ compiler doesn't offer a way to dump them out.
+
+#include "CpuFeatures.h"
 
 #include <iostream>
 #include <cassert>
+#include <cstring>
 
 #define SHOW(DEFINE) std::cout << "#define " #DEFINE " " << DEFINE << std::endl
 
@@ -124,8 +128,14 @@ void dev()
     #endif
 }
 
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
+    if (argc < 2 || 0 != strcmp(argv[1], "--macros"))
+    {
+        print_cpu_report(stdout);
+        return 0;
+    }
+
     cstandard();
     Windows();
     Clang();
@@ -7,6 +7,11 @@
 #include <cstring>
 
 #include "ascii85.h"
+#include "../compat/CpuFeatures.h"
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
 
 // Convert a single 4-byte value into a 5-character string
 // (p points to at least 5 allocated bytes)
@@ -30,34 +35,161 @@ uint32_t A85ToQuad(char* a85)
     return v;
 }
 
-void ToAscii85(Ascii85Buf& buf)
+// Encode nquads groups of 4 octets, returning the number of chars written (5 per
+// group, or 1 for a zero group). out has room for 5 * nquads chars.
+static int QuadsTo85Scalar(const uint8_t* data, int nquads, char* out)
 {
-    int len = buf.dataLen;
-    uint8_t* data = buf.data;
-
-    // Convert groups of 4 octects - end is handled specially
-    // Note that if we really cared about speed, this is completely parallelizable,
-    // each quad can be converted independently of other quads; not multithreading,
-    // but instruction-level parallelism, or maybe using x86 SSE instructions.
-    while (len >= 4)
+    char* p = out;
+    for (int q = 0; q < nquads; q++, data += 4)
     {
         // get a big-endian int (we expect compilers to turn this into efficient code)
         uint32_t v = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | (data[3]);
-        len -= 4;
-        data += 4;
 
         // If it's zero, we just output a single char
         if (v == 0)
-            buf.putA85('z');
+            *p++ = 'z';
 
         // Otherwise, do the 4to5 encoding and write it
         else
         {
-            buf.reserveA85(5);
-            QuadTo85(v, buf.a85 + buf.a85Len);
-            buf.a85Len += 5;
+            QuadTo85(v, p);
+            p += 5;
+        }
+    }
+    return int(p - out);
+}
+
+// Each quad converts independently of the others, so the vector versions do a
+// vector of quads at once. v / 85 is (v * 0xC0C0C0C1) >> 38 for any 32-bit v, and
+// the 64-bit products come from the even and odd lanes separately. A vector that
+// holds a zero quad (which turns into 'z') goes through the scalar code instead.
+
+#if defined(CPU_X86)
+
+CPU_TARGET("avx2")
+static int QuadsTo85AVX2(const uint8_t* data, int nquads, char* out)
+{
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i magic = _mm256_set1_epi32(int(0xC0C0'C0C1));
+    const __m256i n85 = _mm256_set1_epi32(85);
+    const __m256i bang = _mm256_set1_epi32('!');
+
+    char* p = out;
+    int q = 0;
+    for (; q + 8 <= nquads; q += 8)
+    {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*) (data + 4 * q)), bswap);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(v, _mm256_setzero_si256())) != 0)
+        {
+            p += QuadsTo85Scalar(data + 4 * q, 8, p);
+            continue;
+        }
+
+        // Digits from the last char to the first; the first four chars of each quad
+        // are packed into one 32-bit lane
+        __m256i head = _mm256_setzero_si256(), last = _mm256_setzero_si256();
+        for (int i = 4; i >= 0; i--)
+        {
+            __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(v, magic), 38);
+            __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(v, 32), magic), 38);
+            __m256i quot = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+            __m256i digit = _mm256_add_epi32(_mm256_sub_epi32(v, _mm256_mullo_epi32(quot, n85)), bang);
+            if (i == 4)
+                last = digit;
+            else
+                head = _mm256_or_si256(head, _mm256_slli_epi32(digit, 8 * i));
+            v = quot;
+        }
+
+        alignas(32) uint32_t heads[8], lasts[8];
+        _mm256_store_si256((__m256i*) heads, head);
+        _mm256_store_si256((__m256i*) lasts, last);
+        for (int k = 0; k < 8; k++, p += 5)
+        {
+            memcpy(p, &heads[k], 4);
+            p[4] = char(lasts[k]);
+        }
+    }
+    p += QuadsTo85Scalar(data + 4 * q, nquads - q, p);
+    return int(p - out);
+}
+
+CPU_AVX512_BEGIN
+
+CPU_TARGET("avx512f,avx512bw")
+static int QuadsTo85AVX512(const uint8_t* data, int nquads, char* out)
+{
+    const __m512i bswap = _mm512_set4_epi32(0x0C0D'0E0F, 0x0809'0A0B, 0x0405'0607, 0x0001'0203);
+    const __m512i magic = _mm512_set1_epi32(int(0xC0C0'C0C1));
+    const __m512i n85 = _mm512_set1_epi32(85);
+    const __m512i bang = _mm512_set1_epi32('!');
+
+    char* p = out;
+    int q = 0;
+    for (; q + 16 <= nquads; q += 16)
+    {
+        __m512i v = _mm512_shuffle_epi8(_mm512_loadu_si512(data + 4 * q), bswap);
+        if (_mm512_cmpeq_epi32_mask(v, _mm512_setzero_si512()) != 0)
+        {
+            p += QuadsTo85Scalar(data + 4 * q, 16, p);
+            continue;
+        }
+
+        __m512i head = _mm512_setzero_si512(), last = _mm512_setzero_si512();
+        for (int i = 4; i >= 0; i--)
+        {
+            __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(v, magic), 38);
+            __m512i odd = _mm512_srli_epi64(_mm512_mul_epu32(_mm512_srli_epi64(v, 32), magic), 38);
+            __m512i quot = _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+            __m512i digit = _mm512_add_epi32(_mm512_sub_epi32(v, _mm512_mullo_epi32(quot, n85)), bang);
+            if (i == 4)
+                last = digit;
+            else
+                head = _mm512_or_si512(head, _mm512_slli_epi32(digit, 8 * i));
+            v = quot;
+        }
+
+        alignas(64) uint32_t heads[16], lasts[16];
+        _mm512_store_si512(heads, head);
+        _mm512_store_si512(lasts, last);
+        for (int k = 0; k < 16; k++, p += 5)
+        {
+            memcpy(p, &heads[k], 4);
+            p[4] = char(lasts[k]);
         }
     }
+    p += QuadsTo85Scalar(data + 4 * q, nquads - q, p);
+    return int(p - out);
+}
+
+CPU_AVX512_END
+
+#endif
+
+// Indexed by CpuLevel
+static int (*const QuadsTo85Kernels[])(const uint8_t* data, int nquads, char* out) = {
+    QuadsTo85Scalar,
+    #if defined(CPU_X86)
+    QuadsTo85AVX2,
+    QuadsTo85AVX512,
+    #endif
+};
+
+void ToAscii85(Ascii85Buf& buf)
+{
+    int len = buf.dataLen;
+    uint8_t* data = buf.data;
+
+    // Convert groups of 4 octects - end is handled specially
+    int nquads = len / 4;
+    if (nquads != 0)
+    {
+        buf.reserveA85(5 * nquads);
+        buf.a85Len += QuadsTo85Kernels[int(cpu_level())](data, nquads, buf.a85 + buf.a85Len);
+        data += 4 * nquads;
+        len -= 4 * nquads;
+    }
 
     // If there are octets left, pad before converting. This cannot use zero-encoding,
     // because we would then lose the idea of final length.
@@ -236,3 +368,34 @@ TEST_CASE("ToAscii85", "[ascii85]")
     FromAscii85(from85);
     REQUIRE(0 == strncmp((char*)from85.data, rawdata, to85.dataLen));
 }
+
+TEST_CASE("ToAscii85 kernels", "[ascii85]")
+{
+    // Every kernel gives the same output as the plain one, for lengths around the
+    // vector sizes and with zero groups in some vectors
+    uint8_t raw[1000];
+    uint32_t seed = 1;
+    for (int i = 0; i < 1000; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        raw[i] = (i / 4) % 11 == 3 ? 0 : uint8_t(seed >> 24);
+    }
+
+    for (int len : { 0, 3, 4, 31, 32, 33, 64, 67, 100, 1000 })
+    {
+        char expected[1250];
+        int n = QuadsTo85Scalar(raw, len / 4, expected);
+        for (int level = 0; level <= int(cpu_max_level()); level++)
+        {
+            set_cpu_level(CpuLevel(level));
+            Ascii85Buf to85;
+            to85.data = raw;
+            to85.dataLen = len;
+            ToAscii85(to85);
+            REQUIRE(to85.a85Len >= n);
+            REQUIRE(0 == memcmp(to85.a85, expected, n));
+            free(to85.a85);
+        }
+    }
+    set_cpu_level(cpu_max_level());
+}
@@ -15,11 +15,9 @@ workspace "playground"
 	filter { "toolset:msc*" }
 	    defines { "_ITERATOR_DEBUG_LEVEL=0", "_CRT_SECURE_NO_WARNINGS", "_SCL_SECURE_NO_WARNINGS" }
 
-    -- should this be done at the workspace level or the project level? If one library
-    -- is using lzcnt intrinsics, we expect all of them to be compatible with that.
-    -- is this a link issue?
-    filter { "action:xcode* or toolset:clang*" }
-        buildoptions { "-mlzcnt" }
+    -- No instruction set flags (-mlzcnt, -mavx2, /arch): code built with them can
+    -- fault on older CPUs. Kernels that need newer instructions are picked at run
+    -- time instead, see compat/CpuFeatures.h.
 
 newoption {
    trigger     = "something",
@@ -32,6 +30,7 @@ include "compat"
 include "file"
 include "operators"
 include "postscript"
+include "tasks"
 include "timer"
 include "unicode"
 include "win32app"
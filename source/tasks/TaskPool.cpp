@@ -0,0 +1,196 @@
+// ======================================================================================
+// TaskPool.cpp
+//
+// A worker looks for a task in its own deque, then the shared queue, then the deques
+// of the other workers starting from a random one. When there is none, it yields for
+// a while, and then goes to sleep.
+//
+// Going to sleep can't miss a task being forked: the worker counts itself in sleeping
+// and then looks once more, and submit() puts the task where that last look would
+// see it and then reads sleeping. With a full fence between the two steps on both
+// sides, at least one of them sees the other, so either the worker finds the task or
+// submit() wakes it.
+// ======================================================================================
+
+#include "TaskPool.h"
+
+#include <cassert>
+
+// Rounds of looking for a task, with a yield between, before a worker sleeps
+static constexpr int kSpins = 64;
+
+thread_local TaskPool::Worker* TaskPool::this_thread_worker = nullptr;
+
+static uint64_t xorshift(uint64_t& x)
+{
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+TaskPool::TaskPool(int threads)
+{
+    if (threads <= 0)
+        threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+    for (int i = 0; i < threads - 1; i++)
+    {
+        workers.emplace_back(new Worker);
+        Worker* w = workers.back().get();
+        w->pool = this;
+        w->rng = 0x9E37'79B9'7F4A'7C15ULL * uint64_t(i + 1);
+    }
+
+    // Started only once every deque exists, since they steal from each other
+    for (auto& w : workers)
+        w->thread = std::thread(&TaskPool::work, this, w.get());
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& w : workers)
+        w->thread.join();
+    assert(injected.empty() && "TaskPool destroyed with tasks not waited on");
+}
+
+TaskPool& TaskPool::shared()
+{
+    static TaskPool pool;
+    return pool;
+}
+
+TaskPool::Worker* TaskPool::current_worker()
+{
+    Worker* w = this_thread_worker;
+    return w != nullptr && w->pool == this ? w : nullptr;
+}
+
+void TaskPool::submit(Task* task)
+{
+    if (Worker* w = current_worker())
+    {
+        w->deque.push(task);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(injected_mutex);
+        injected.push_back(task);
+        injected_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake();
+}
+
+void TaskPool::wake()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed) == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        epoch++;
+    }
+    sleep_cv.notify_one();
+}
+
+bool TaskPool::has_task() const
+{
+    if (injected_count.load(std::memory_order_relaxed) != 0)
+        return true;
+    for (auto& w : workers)
+        if (!w->deque.empty())
+            return true;
+    return false;
+}
+
+Task* TaskPool::find_task(Worker* self)
+{
+    Task* task;
+    if (self != nullptr && self->deque.pop(task))
+        return task;
+
+    if (injected_count.load(std::memory_order_relaxed) != 0)
+    {
+        std::lock_guard<std::mutex> lock(injected_mutex);
+        if (!injected.empty())
+        {
+            task = injected.front();
+            injected.pop_front();
+            injected_count.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+
+    int n = int(workers.size());
+    if (n == 0)
+        return nullptr;
+    static thread_local uint64_t outside_rng = 0x2545'F491'4F6C'DD1DULL ^ uint64_t(reinterpret_cast<uintptr_t>(&outside_rng));
+    uint64_t& rng = self != nullptr ? self->rng : outside_rng;
+    int start = int(xorshift(rng) % uint64_t(n));
+    for (int i = 0; i < n; i++)
+    {
+        Worker* victim = workers[(start + i) % n].get();
+        if (victim != self && victim->deque.steal(task))
+            return task;
+    }
+    return nullptr;
+}
+
+// The task is deleted before the count goes down, since the group can be gone as soon
+// as it does
+void TaskPool::run(Task* task)
+{
+    task->fn();
+    std::atomic<int>& pending = task->group->pending;
+    delete task;
+    pending.fetch_sub(1, std::memory_order_release);
+}
+
+void TaskPool::wait_for(const std::atomic<int>& pending)
+{
+    Worker* self = current_worker();
+    while (pending.load(std::memory_order_acquire) != 0)
+    {
+        if (Task* task = find_task(self))
+            run(task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void TaskPool::work(Worker* self)
+{
+    this_thread_worker = self;
+    while (true)
+    {
+        Task* task = find_task(self);
+        for (int i = 0; task == nullptr && i < kSpins; i++)
+        {
+            std::this_thread::yield();
+            task = find_task(self);
+        }
+        if (task != nullptr)
+        {
+            run(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        if (stopping)
+            return;
+        sleeping.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!has_task())
+        {
+            uint64_t e = epoch;
+            sleep_cv.wait(lock, [this, e]() { return epoch != e || stopping; });
+        }
+        sleeping.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
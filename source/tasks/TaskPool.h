@@ -0,0 +1,229 @@
+// ======================================================================================
+// TaskPool.h
+// - a work-stealing thread pool, with fork/join, parallel_for and parallel_reduce
+//
+// A TaskPool of n threads runs n - 1 workers, and the thread that waits on a
+// TaskGroup works as the n-th while it waits. Each worker has a WorkDeque: a task a
+// worker forks goes on the bottom of its own deque, it runs its own tasks newest
+// first, and an idle worker steals the oldest task of another worker. Tasks forked
+// from outside the pool go on a shared queue that the workers also take from.
+//
+// In a divide-and-conquer computation the newest task is the smallest piece, with its
+// data still in cache, and the oldest is the biggest, so a steal moves as much work
+// as it can in one go and steals are rare. That makes it cheap to fork much more
+// work than there are threads, and let the pool balance it.
+//
+// A thread waiting on a TaskGroup runs other tasks until the group is done, so tasks
+// can fork and wait on groups of their own without tying up threads. Idle workers
+// sleep, and are woken when a task is forked.
+//
+// Tasks must not throw. A pool of one thread runs each task as it is forked.
+//
+//   TaskGroup g;
+//   g.run([&] { left = sum(a, m); });
+//   right = sum(m, b);
+//   g.wait();
+// ======================================================================================
+
+#pragma once
+
+#include "WorkDeque.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class TaskGroup;
+
+struct Task
+{
+    std::function<void()> fn;
+    TaskGroup* group;
+};
+
+class TaskPool
+{
+public:
+    // threads in all, counting the one that waits (0 for one per core)
+    explicit TaskPool(int threads = 0);
+
+    // Waits for the workers to finish, so every TaskGroup must have been waited on
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    // One thread per core, made on first use and shared by everything in the process
+    static TaskPool& shared();
+
+    // The number of threads that run tasks
+    int size() const { return int(workers.size()) + 1; }
+
+    // Queue a task: on the calling worker's deque, or the shared queue for a thread
+    // outside the pool
+    void submit(Task* task);
+
+    // Run tasks until pending is zero
+    void wait_for(const std::atomic<int>& pending);
+
+private:
+    struct Worker
+    {
+        TaskPool* pool;
+        WorkDeque<Task*> deque;
+        uint64_t rng; // for picking victims
+        std::thread thread;
+    };
+
+    static void run(Task* task);
+    void work(Worker* self);
+    Task* find_task(Worker* self);
+    bool has_task() const;
+    void wake();
+    Worker* current_worker();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    static thread_local Worker* this_thread_worker; // of whichever pool it belongs to
+
+    // Tasks from threads outside the pool
+    std::mutex injected_mutex;
+    std::deque<Task*> injected;
+    std::atomic<int> injected_count{ 0 };
+
+    // Sleeping workers wait for epoch to change
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<int> sleeping{ 0 };
+    uint64_t epoch = 0;    // under sleep_mutex
+    bool stopping = false; // under sleep_mutex
+};
+
+// ======================================================================================
+// TaskGroup
+// - tasks forked together and waited on together
+
+class TaskGroup
+{
+public:
+    explicit TaskGroup(TaskPool& pool = TaskPool::shared()) : pool(pool) {}
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Fork f to run on any thread of the pool
+    template <typename F>
+    void run(F&& f)
+    {
+        if (pool.size() == 1)
+        {
+            f();
+            return;
+        }
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.submit(new Task{ std::forward<F>(f), this });
+    }
+
+    // Join: returns once every task forked on this group has run
+    void wait() { pool.wait_for(pending); }
+
+private:
+    friend class TaskPool;
+
+    TaskPool& pool;
+    std::atomic<int> pending{ 0 };
+};
+
+// ======================================================================================
+// Loops
+//
+// The range is split in half, recursively, with one half forked and the other run in
+// place, down to pieces of grain indices. A grain of 0 picks one that makes about
+// eight pieces per thread.
+
+namespace task_detail
+{
+    inline int64_t pick_grain(int64_t n, int64_t grain, const TaskPool& pool)
+    {
+        return grain > 0 ? grain : std::max<int64_t>(1, n / (8 * int64_t(pool.size())));
+    }
+
+    template <typename F>
+    void for_range(int64_t begin, int64_t end, const F& f, int64_t grain, TaskPool& pool)
+    {
+        if (end - begin <= grain)
+        {
+            for (int64_t i = begin; i < end; i++)
+                f(i);
+            return;
+        }
+
+        int64_t mid = begin + (end - begin) / 2;
+        TaskGroup g(pool);
+        g.run([=, &f, &pool]() { for_range(mid, end, f, grain, pool); });
+        for_range(begin, mid, f, grain, pool);
+        g.wait();
+    }
+
+    template <typename T, typename Map, typename Combine>
+    T reduce_range(int64_t begin, int64_t end, const T& identity, const Map& map, const Combine& combine,
+                   int64_t grain, TaskPool& pool)
+    {
+        if (end - begin <= grain)
+        {
+            T r = identity;
+            for (int64_t i = begin; i < end; i++)
+                r = combine(std::move(r), map(i));
+            return r;
+        }
+
+        int64_t mid = begin + (end - begin) / 2;
+        T right;
+        TaskGroup g(pool);
+        g.run([=, &right, &identity, &map, &combine, &pool]() {
+            right = reduce_range(mid, end, identity, map, combine, grain, pool);
+        });
+        T left = reduce_range(begin, mid, identity, map, combine, grain, pool);
+        g.wait();
+        return combine(std::move(left), std::move(right));
+    }
+}
+
+// f(i) for each i in [begin, end), in any order and on any thread
+template <typename F>
+void parallel_for(int64_t begin, int64_t end, const F& f, int64_t grain = 0, TaskPool& pool = TaskPool::shared())
+{
+    if (begin < end)
+        task_detail::for_range(begin, end, f, task_detail::pick_grain(end - begin, grain, pool), pool);
+}
+
+// combine(... combine(combine(identity, map(begin)), map(begin + 1)) ..., map(end - 1))
+// with the combines grouped differently, so combine must be associative. It need not
+// be commutative: the operands are always in index order.
+template <typename T, typename Map, typename Combine>
+T parallel_reduce(int64_t begin, int64_t end, const T& identity, const Map& map, const Combine& combine,
+                  int64_t grain = 0, TaskPool& pool = TaskPool::shared())
+{
+    if (begin >= end)
+        return identity;
+    return task_detail::reduce_range(begin, end, identity, map, combine,
+                                     task_detail::pick_grain(end - begin, grain, pool), pool);
+}
+
+// Run a and b in parallel, and return when both are done
+template <typename A, typename B>
+void parallel_invoke(const A& a, const B& b, TaskPool& pool = TaskPool::shared())
+{
+    TaskGroup g(pool);
+    g.run(b);
+    a();
+    g.wait();
+}
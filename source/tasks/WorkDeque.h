@@ -0,0 +1,139 @@
+// ======================================================================================
+// WorkDeque.h
+// - the Chase-Lev work-stealing deque
+//
+// One thread owns the deque and pushes and pops at the bottom, like a stack. Any
+// number of other threads steal from the top, so they take the oldest items, which in
+// a fork/join computation are the biggest pieces of work left. The owner and the
+// thieves only contend for the last item; everything else is a plain load and store.
+//
+// This is the version of Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (PPoPP 2013), with the C11 fences from that
+// paper, except that push publishes an item with a release store to bottom instead
+// of a release fence and a relaxed store. That is no weaker, and it is an ordering
+// ThreadSanitizer can see.
+//
+// The array grows when full. A thief can still be reading the old array after it has
+// been replaced, so old arrays are kept until the deque is destroyed; since each is
+// half the size of the next, that at most doubles the memory.
+//
+// T must be trivially copyable (it is a pointer in TaskPool).
+// ======================================================================================
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+template <typename T>
+class WorkDeque
+{
+    static_assert(std::is_trivially_copyable<T>::value, "WorkDeque holds plain values");
+
+public:
+    // capacity is rounded up to a power of two
+    explicit WorkDeque(int64_t capacity = 256)
+    {
+        int64_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        arrays.emplace_back(new Array(size));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkDeque(const WorkDeque&) = delete;
+    WorkDeque& operator=(const WorkDeque&) = delete;
+
+    // Owner only
+    void push(T x)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array* a = array.load(std::memory_order_relaxed);
+        if (b - t > a->mask)
+            a = grow(a, t, b);
+        a->put(b, x);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only: the newest item, or false if there is none
+    bool pop(T& x)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // Empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        x = a->get(b);
+        if (t < b)
+            return true;
+
+        // The last item: whoever moves top past it has it
+        bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    // Any thread: the oldest item, or false if there is none or another thread got
+    // to it first
+    bool steal(T& x)
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return false;
+
+        Array* a = array.load(std::memory_order_acquire);
+        x = a->get(t);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // A snapshot, which may be out of date by the time it is looked at
+    bool empty() const
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_relaxed);
+        return t >= b;
+    }
+
+private:
+    struct Array
+    {
+        explicit Array(int64_t size) : mask(size - 1), items(new std::atomic<T>[size]) {}
+
+        T get(int64_t i) const { return items[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T x) { items[i & mask].store(x, std::memory_order_relaxed); }
+
+        int64_t mask; // size - 1
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    // Owner only: a copy of a at twice the size, which replaces it
+    Array* grow(Array* a, int64_t t, int64_t b)
+    {
+        Array* bigger = new Array(2 * (a->mask + 1));
+        for (int64_t i = t; i < b; i++)
+            bigger->put(i, a->get(i));
+        arrays.emplace_back(bigger);
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    // Thieves write top and the owner writes bottom, so they get a cache line each
+    alignas(64) std::atomic<int64_t> top{ 0 };
+    alignas(64) std::atomic<int64_t> bottom{ 0 };
+    std::atomic<Array*> array{ nullptr };
+    std::vector<std::unique_ptr<Array>> arrays; // the current one last, owner only
+};
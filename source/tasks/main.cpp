@@ -0,0 +1,127 @@
+// main.cpp
+// - tests for the work-stealing deque and the task pool
+
+#include "TaskPool.h"
+#include "WorkDeque.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "../catch.hpp"
+
+TEST_CASE("WorkDeque", "[tasks]")
+{
+    // The owner's end is a stack and the thieves' end a queue, and it grows past its
+    // starting size
+    WorkDeque<int> d(4);
+    int x = 0;
+    REQUIRE_FALSE(d.pop(x));
+    REQUIRE_FALSE(d.steal(x));
+    for (int i = 0; i < 100; i++)
+        d.push(i);
+    REQUIRE((d.steal(x) && x == 0));
+    REQUIRE((d.pop(x) && x == 99));
+    int wrong = 0;
+    for (int i = 98; i >= 1; i--)
+        wrong += d.pop(x) && x == i ? 0 : 1;
+    REQUIRE(wrong == 0);
+    REQUIRE(d.empty());
+
+    // One owner pushing and popping against three thieves: every item comes out
+    // exactly once
+    const int kItems = 200000;
+    WorkDeque<int> shared(16);
+    std::vector<std::atomic<int>> seen(kItems);
+    for (auto& s : seen)
+        s.store(0);
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; t++)
+        thieves.emplace_back([&]() {
+            int v;
+            while (!done.load())
+                if (shared.steal(v))
+                    seen[v].fetch_add(1);
+        });
+    for (int i = 0; i < kItems; i++)
+    {
+        shared.push(i);
+        if (i % 3 == 0 && shared.pop(x))
+            seen[x].fetch_add(1);
+    }
+    while (shared.pop(x))
+        seen[x].fetch_add(1);
+    done.store(true);
+    for (auto& t : thieves)
+        t.join();
+
+    int bad = 0;
+    for (auto& s : seen)
+        bad += s.load() == 1 ? 0 : 1;
+    REQUIRE(bad == 0);
+}
+
+static int64_t fib(int n, TaskPool& pool)
+{
+    if (n < 2)
+        return n;
+    int64_t a = 0, b = 0;
+    TaskGroup g(pool);
+    g.run([&]() { a = fib(n - 1, pool); });
+    b = fib(n - 2, pool);
+    g.wait();
+    return a + b;
+}
+
+TEST_CASE("TaskPool", "[tasks]")
+{
+    for (int threads : { 1, 2, 4 })
+    {
+        TaskPool pool(threads);
+        REQUIRE(pool.size() == threads);
+
+        // Nested fork/join
+        REQUIRE(fib(22, pool) == 17711);
+
+        // Every index once
+        std::vector<std::atomic<int>> hits(10000);
+        for (auto& h : hits)
+            h.store(0);
+        parallel_for(0, 10000, [&](int64_t i) { hits[i].fetch_add(1); }, 0, pool);
+        int bad = 0;
+        for (auto& h : hits)
+            bad += h.load() == 1 ? 0 : 1;
+        REQUIRE(bad == 0);
+
+        // A reduction, and one that isn't commutative, which must keep index order
+        int64_t sum = parallel_reduce(int64_t(1), int64_t(100001), int64_t(0),
+            [](int64_t i) { return i; }, [](int64_t a, int64_t b) { return a + b; }, 0, pool);
+        REQUIRE(sum == 5000050000);
+        std::string s = parallel_reduce(0, 26, std::string(),
+            [](int64_t i) { return std::string(1, char('a' + i)); },
+            [](std::string a, const std::string& b) { return a + b; }, 1, pool);
+        REQUIRE(s == "abcdefghijklmnopqrstuvwxyz");
+
+        // Tasks forked from several threads outside the pool at once
+        std::atomic<int> count{ 0 };
+        std::vector<std::thread> outside;
+        for (int t = 0; t < 3; t++)
+            outside.emplace_back([&]() {
+                TaskGroup g(pool);
+                for (int i = 0; i < 1000; i++)
+                    g.run([&]() { count.fetch_add(1); });
+                g.wait();
+            });
+        for (auto& t : outside)
+            t.join();
+        REQUIRE(count.load() == 3000);
+    }
+
+    // The shared pool
+    int a = 0, b = 0;
+    parallel_invoke([&]() { a = 1; }, [&]() { b = 2; });
+    REQUIRE(a + b == 3);
+}
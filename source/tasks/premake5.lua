@@ -0,0 +1,11 @@
+local BUILD = "../../build/tasks" -- we are two levels from the top
+
+-- the work-stealing task pool and its tests. Other projects that use it add
+-- TaskPool.cpp to their own files, the way they do with compat/CpuFeatures.cpp
+project "tasks"
+    location(BUILD)
+    kind "ConsoleApp"
+    files { "**.cpp", "**.h", "../catch.hpp" }
+
+    filter { "system:linux" }
+      links { "pthread" }
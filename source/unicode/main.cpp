@@ -8,12 +8,15 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include "../catch.hpp"
 
+#include "utf8.h"
+#include "../compat/CpuFeatures.h"
+
 #include <assert.h>
 #include <iostream>
+#include <string>
 
 int ConvertUTF8toUTF16(uint8_t* utf8, uint16_t* utf16);
 int ConvertUTF16toUTF8(uint16_t* utf16, uint8_t* utf8);
-bool IsUTF8Char(uint8_t* utf8);
 
 #if 0
 TEST_CASE("UTF-8 roundtrip", "[Unicode]")
@@ -107,6 +110,33 @@ void TrackRange(bool& wasValid, bool isValid, uint32_t& start, uint32_t pos, int
         count += 1;
 }
 
+TEST_CASE("UTF-8 buffers", "[Unicode]")
+{
+    // ASCII runs of every length around the vector sizes, followed by multi-byte
+    // characters, a bad byte and a cut-off character
+    for (int level = 0; level <= int(cpu_max_level()); level++)
+    {
+        set_cpu_level(CpuLevel(level));
+        for (size_t n = 0; n < 200; n++)
+        {
+            std::string s(n, 'a');
+            const uint8_t* p = (const uint8_t*) s.data();
+            REQUIRE(ASCIIPrefixLength(p, s.size()) == n);
+            REQUIRE(IsUTF8(p, s.size()));
+
+            std::string t = s + "\xC3\xA9" + s + "\xE2\x82\xAC\xF0\x9F\x98\x80" + s;
+            p = (const uint8_t*) t.data();
+            REQUIRE(ASCIIPrefixLength(p, t.size()) == n);
+            REQUIRE(IsUTF8(p, t.size()));
+            REQUIRE(!IsUTF8(p, t.size() - n - 1));
+
+            std::string u = s + "\x80" + s;
+            REQUIRE(!IsUTF8((const uint8_t*) u.data(), u.size()));
+        }
+    }
+    set_cpu_level(cpu_max_level());
+}
+
 TEST_CASE("Illegal UTF-8 1-byte sequences", "[Unicode]")
 {
     int count = 0;
@@ -0,0 +1,121 @@
+// utf8.cpp
+// - UTF-8 validation of whole buffers
+//
+// ASCII runs are skipped a vector at a time (a byte is ASCII when its top bit is
+// clear, so a whole vector is checked with one movemask), and every other character
+// goes through IsUTF8Char.
+
+#include "utf8.h"
+#include "../compat/CpuFeatures.h"
+
+#include <cstring>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Bytes before the first one with its top bit set, at most n
+static size_t ASCIITail(const uint8_t* p, size_t i, size_t n)
+{
+    while (i < n && p[i] < 0x80)
+        i++;
+    return i;
+}
+
+static size_t ASCIIPrefixScalar(const uint8_t* p, size_t n)
+{
+    // Eight bytes at a time in a 64-bit word
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        if (w & 0x8080'8080'8080'8080ULL)
+            break;
+    }
+    return ASCIITail(p, i, n);
+}
+
+#if defined(CPU_X86)
+
+// Index of the lowest set bit of a non-zero mask
+static int FirstSetBit(uint64_t v)
+{
+    #if defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, uint32_t(v)))
+        return int(index);
+    _BitScanForward(&index, uint32_t(v >> 32));
+    return 32 + int(index);
+    #else
+    return __builtin_ctzll(v);
+    #endif
+}
+
+CPU_TARGET("avx2")
+static size_t ASCIIPrefixAVX2(const uint8_t* p, size_t n)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (p + i));
+        uint32_t high = uint32_t(_mm256_movemask_epi8(v));
+        if (high != 0)
+            return i + FirstSetBit(high);
+    }
+    return ASCIITail(p, i, n);
+}
+
+CPU_TARGET("avx512f,avx512bw")
+static size_t ASCIIPrefixAVX512(const uint8_t* p, size_t n)
+{
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        __m512i v = _mm512_loadu_si512(p + i);
+        uint64_t high = _mm512_movepi8_mask(v);
+        if (high != 0)
+            return i + FirstSetBit(high);
+    }
+    return ASCIITail(p, i, n);
+}
+
+#endif
+
+// Indexed by CpuLevel
+static size_t (*const ASCIIPrefixKernels[])(const uint8_t* p, size_t n) = {
+    ASCIIPrefixScalar,
+    #if defined(CPU_X86)
+    ASCIIPrefixAVX2,
+    ASCIIPrefixAVX512,
+    #endif
+};
+
+size_t ASCIIPrefixLength(const uint8_t* p, size_t n)
+{
+    return ASCIIPrefixKernels[int(cpu_level())](p, n);
+}
+
+bool IsUTF8(const uint8_t* p, size_t n)
+{
+    size_t i = 0;
+    while (true)
+    {
+        i += ASCIIPrefixLength(p + i, n - i);
+        if (i == n)
+            return true;
+
+        // The lead byte gives the length. IsUTF8Char checks every byte it needs, so
+        // a character cut off at the end fails on the zero padding.
+        uint8_t lead = p[i];
+        size_t len = lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+        uint8_t c[5] = {};
+        memcpy(c, p + i, len < n - i ? len : n - i);
+        if (!IsUTF8Char(c))
+            return false;
+        i += len;
+    }
+}
@@ -0,0 +1,18 @@
+// utf8.h
+// - UTF-8 validation of single characters and whole buffers
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Is the character starting at utf8 legal UTF-8? This looks at up to 4 bytes.
+bool IsUTF8Char(uint8_t* utf8);
+
+// The number of bytes at the start of p that are ASCII (below 0x80). Most text is
+// long runs of ASCII, so this is the inner loop of a scan, and it uses the widest
+// vectors the CPU has.
+size_t ASCIIPrefixLength(const uint8_t* p, size_t n);
+
+// Is all of p[0..n) legal UTF-8, with no character cut off at the end?
+bool IsUTF8(const uint8_t* p, size_t n);